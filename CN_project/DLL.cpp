@@ -1,39 +1,544 @@
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <cstring>
+#include <random>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
 
 using namespace std;
 
+// Packs "AA:BB:CC:DD:EE:FF" into the low 48 bits of an integer for table lookups
+uint64_t macKey(const string& mac) {
+    uint64_t key = 0;
+    for (char c : mac) {
+        if (c >= '0' && c <= '9') {
+            key = (key << 4) | (uint64_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            key = (key << 4) | (uint64_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            key = (key << 4) | (uint64_t)(c - 'A' + 10);
+        }
+    }
+    return key & 0xFFFFFFFFFFFFULL;
+}
+
+// Ethernet FCS: CRC-32 with the reflected polynomial 0xEDB88320. The portable path uses
+// slice-by-8 tables, eight bytes per step. On CPUs with carry-less multiply the bulk of a
+// frame is folded 64 bytes at a time with PCLMULQDQ instead; SSE4.2's CRC32 instruction
+// computes the Castagnoli polynomial, not Ethernet's, so it can't be used here.
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int slice = 1; slice < 8; slice++) {
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables crc32_tables;
+
+// All crc32* functions take and return the running register, i.e. without the final inversion
+uint32_t crc32Bytewise(uint32_t crc, const uint8_t* data, size_t length) {
+    const uint32_t (&table)[8][256] = crc32_tables.table;
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ table[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+uint32_t crc32SliceBy8(uint32_t crc, const uint8_t* data, size_t length) {
+    const uint32_t (&table)[8][256] = crc32_tables.table;
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc; // Little-endian host assumed, like the rest of the simulator
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    return crc32Bytewise(crc, data, length);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_CLMUL 1
+// Folding constants for the reflected polynomial (Gopal et al., "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ", Intel 2009). Needs at least 64 bytes.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32Clmul(uint32_t crc, const uint8_t* data, size_t length) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    size_t tail = length & 15;
+    length -= tail;
+
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)data), _mm_cvtsi32_si128(crc));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+    data += 64;
+    length -= 64;
+    while (length >= 64) { // Four independent lanes, 64 bytes per step
+        __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), y1), _mm_loadu_si128((const __m128i*)data));
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), y2), _mm_loadu_si128((const __m128i*)(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), y3), _mm_loadu_si128((const __m128i*)(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), y4), _mm_loadu_si128((const __m128i*)(data + 48)));
+        data += 64;
+        length -= 64;
+    }
+    // Fold the lanes, then any remaining 16-byte blocks, into one 128-bit value
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x2);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x3);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x4);
+    while (length >= 16) {
+        __m128i next = _mm_loadu_si128((const __m128i*)data);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), next);
+        data += 16;
+        length -= 16;
+    }
+    // 128 -> 64 bits, then Barrett reduction to 32
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00), x2);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return crc32SliceBy8((uint32_t)_mm_extract_epi32(x1, 1), data, tail);
+}
+#endif
+
+// Picks the fastest implementation the CPU supports, once
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+#ifdef CRC32_HAVE_CLMUL
+    static const bool clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (clmul && length >= 64) {
+        return crc32Clmul(crc, data, length);
+    }
+#endif
+    return crc32SliceBy8(crc, data, length);
+}
+
+uint32_t crc32(const void* data, size_t length) {
+    return ~crc32Update(0xFFFFFFFFu, (const uint8_t*)data, length);
+}
+
+// Fixed-capacity MAC forwarding database keyed by packed 48-bit MACs. Open addressing over
+// groups of 16 slots with one control byte per slot (Swiss-table layout): a full slot's
+// control byte holds 7 bits of the key's hash, so a whole group is matched with a single
+// SSE2 compare. When the table is full the least recently used unpinned entry is evicted.
+template <typename Value>
+class MacForwardingTable {
+private:
+    static constexpr int8_t EMPTY = -128;  // 0x80
+    static constexpr int8_t DELETED = -2;  // 0xFE; a full slot is 0..127, so "free" is the high bit
+    static constexpr uint32_t NIL = 0xFFFFFFFF;
+    static constexpr size_t GROUP_SIZE = 16;
+
+    vector<int8_t> ctrl;
+    vector<uint64_t> keys;
+    vector<Value> values;
+    vector<uint8_t> pinned;
+    vector<uint32_t> lru_prev; // Intrusive LRU list over unpinned slots, head = most recent
+    vector<uint32_t> lru_next;
+    uint32_t lru_head;
+    uint32_t lru_tail;
+    size_t group_mask;
+    size_t max_entries;
+    size_t count;
+    size_t tombstones;
+    long long eviction_count;
+
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    uint32_t matchTag(size_t group, int8_t tag) const {
+        const int8_t* bytes = &ctrl[group * GROUP_SIZE];
+#ifdef __SSE2__
+        __m128i block = _mm_loadu_si128((const __m128i*)bytes);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(tag)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++) {
+            mask |= (uint32_t)(bytes[i] == tag) << i;
+        }
+        return mask;
+#endif
+    }
+
+    uint32_t matchFree(size_t group) const {
+        const int8_t* bytes = &ctrl[group * GROUP_SIZE];
+#ifdef __SSE2__
+        return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)bytes));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++) {
+            mask |= (uint32_t)(bytes[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+    static int lowestBit(uint32_t mask) {
+        return __builtin_ctz(mask);
+    }
+
+    uint32_t findSlot(uint64_t key) const {
+        uint64_t h = hash(key);
+        int8_t tag = (int8_t)(h & 0x7F);
+        size_t group = (h >> 7) & group_mask;
+        for (size_t probe = 1; probe <= group_mask + 1; probe++) {
+            for (uint32_t mask = matchTag(group, tag); mask != 0; mask &= mask - 1) {
+                uint32_t slot = group * GROUP_SIZE + lowestBit(mask);
+                if (keys[slot] == key) {
+                    return slot;
+                }
+            }
+            if (matchTag(group, EMPTY) != 0) {
+                return NIL;
+            }
+            group = (group + probe) & group_mask; // Triangular probing visits every group
+        }
+        return NIL;
+    }
+
+    void lruUnlink(uint32_t slot) {
+        if (lru_prev[slot] != NIL) {
+            lru_next[lru_prev[slot]] = lru_next[slot];
+        } else {
+            lru_head = lru_next[slot];
+        }
+        if (lru_next[slot] != NIL) {
+            lru_prev[lru_next[slot]] = lru_prev[slot];
+        } else {
+            lru_tail = lru_prev[slot];
+        }
+    }
+
+    void lruPushFront(uint32_t slot) {
+        lru_prev[slot] = NIL;
+        lru_next[slot] = lru_head;
+        if (lru_head != NIL) {
+            lru_prev[lru_head] = slot;
+        }
+        lru_head = slot;
+        if (lru_tail == NIL) {
+            lru_tail = slot;
+        }
+    }
+
+    void eraseSlot(uint32_t slot) {
+        if (!pinned[slot]) {
+            lruUnlink(slot);
+        }
+        // A group that still has an empty slot never made a probe continue past it,
+        // so the slot can go straight back to EMPTY instead of leaving a tombstone
+        size_t group = slot / GROUP_SIZE;
+        if (matchTag(group, EMPTY) != 0) {
+            ctrl[slot] = EMPTY;
+        } else {
+            ctrl[slot] = DELETED;
+            tombstones++;
+        }
+        count--;
+    }
+
+    void placeNew(uint64_t key, const Value& value, bool pin) {
+        uint64_t h = hash(key);
+        size_t group = (h >> 7) & group_mask;
+        for (size_t probe = 1;; probe++) {
+            uint32_t mask = matchFree(group);
+            if (mask != 0) {
+                uint32_t slot = group * GROUP_SIZE + lowestBit(mask);
+                if (ctrl[slot] == DELETED) {
+                    tombstones--;
+                }
+                ctrl[slot] = (int8_t)(h & 0x7F);
+                keys[slot] = key;
+                values[slot] = value;
+                pinned[slot] = pin;
+                if (!pin) {
+                    lruPushFront(slot);
+                }
+                count++;
+                return;
+            }
+            group = (group + probe) & group_mask;
+        }
+    }
+
+    // Rebuilds the table in place to clear tombstones, keeping LRU order
+    void rehash() {
+        vector<uint32_t> order;
+        for (uint32_t slot = lru_tail; slot != NIL; slot = lru_prev[slot]) {
+            order.push_back(slot);
+        }
+        vector<tuple<uint64_t, Value, bool>> live;
+        for (uint32_t slot = 0; slot < ctrl.size(); slot++) {
+            if (ctrl[slot] >= 0 && pinned[slot]) {
+                live.emplace_back(keys[slot], values[slot], true);
+            }
+        }
+        for (uint32_t slot : order) {
+            live.emplace_back(keys[slot], values[slot], false);
+        }
+        fill(ctrl.begin(), ctrl.end(), EMPTY);
+        lru_head = lru_tail = NIL;
+        count = 0;
+        tombstones = 0;
+        for (const auto& entry : live) {
+            placeNew(get<0>(entry), get<1>(entry), get<2>(entry));
+        }
+    }
+
+public:
+    explicit MacForwardingTable(size_t capacity = 8192) {
+        max_entries = max(capacity, (size_t)1);
+        size_t groups = 1;
+        while (groups * GROUP_SIZE * 7 < max_entries * 8) { // Keep load at or below 7/8
+            groups *= 2;
+        }
+        group_mask = groups - 1;
+        size_t slots = groups * GROUP_SIZE;
+        ctrl.assign(slots, EMPTY);
+        keys.assign(slots, 0);
+        values.assign(slots, Value());
+        pinned.assign(slots, 0);
+        lru_prev.assign(slots, NIL);
+        lru_next.assign(slots, NIL);
+        lru_head = lru_tail = NIL;
+        count = 0;
+        tombstones = 0;
+        eviction_count = 0;
+    }
+
+    // Pointer to the entry's value (nullptr if absent); a hit refreshes its LRU position
+    Value* find(uint64_t key) {
+        uint32_t slot = findSlot(key);
+        if (slot == NIL) {
+            return nullptr;
+        }
+        if (!pinned[slot] && lru_head != slot) {
+            lruUnlink(slot);
+            lruPushFront(slot);
+        }
+        return &values[slot];
+    }
+
+    // Inserts or overwrites. Pinned entries are never evicted. Returns false only when
+    // the table is full of pinned entries.
+    bool insert(uint64_t key, const Value& value, bool pin = false) {
+        uint32_t slot = findSlot(key);
+        if (slot != NIL) {
+            values[slot] = value;
+            if (pinned[slot] != (uint8_t)pin) {
+                if (pin) {
+                    lruUnlink(slot);
+                } else {
+                    lruPushFront(slot);
+                }
+                pinned[slot] = pin;
+            } else if (!pin) {
+                lruUnlink(slot);
+                lruPushFront(slot);
+            }
+            return true;
+        }
+        if (count >= max_entries) {
+            if (lru_tail == NIL) {
+                return false;
+            }
+            eraseSlot(lru_tail);
+            eviction_count++;
+        }
+        if (tombstones > ctrl.size() / 8) {
+            rehash();
+        }
+        placeNew(key, value, pin);
+        return true;
+    }
+
+    bool erase(uint64_t key) {
+        uint32_t slot = findSlot(key);
+        if (slot == NIL) {
+            return false;
+        }
+        eraseSlot(slot);
+        return true;
+    }
+
+    // Removes every entry whose value matches the predicate (full walk; for rare events like a port going down)
+    template <typename Predicate>
+    void eraseIf(Predicate predicate) {
+        for (uint32_t slot = 0; slot < ctrl.size(); slot++) {
+            if (ctrl[slot] >= 0 && predicate(values[slot])) {
+                eraseSlot(slot);
+            }
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return max_entries;
+    }
+
+    long long evictions() const {
+        return eviction_count;
+    }
+};
+
 class FlowControlProtocol {
 public:
     virtual bool canSendPacket() = 0;
 };
 
+// IEEE 802.1Q: 12-bit VLAN IDs, 0 and 4095 reserved
+const int VLAN_ID_COUNT = 4096;
+const uint16_t DEFAULT_VLAN = 1;
+
+// MAC -> VLAN membership. Stations in different VLANs can't reach each other.
+class MACFilteringProtocol {
+private:
+    MacForwardingTable<uint16_t> mac_table;
+
+public:
+    MACFilteringProtocol(size_t capacity = 8192) : mac_table(capacity) {}
+
+    // Accepts "VLAN12" as well as "12"
+    void addEntry(string mac_address, string vlan) {
+        size_t digits = vlan.find_first_of("0123456789");
+        if (digits == string::npos) {
+            throw invalid_argument("Invalid VLAN: " + vlan);
+        }
+        addEntry(mac_address, (uint16_t)stoi(vlan.substr(digits)));
+    }
+
+    void addEntry(string mac_address, uint16_t vlan) {
+        if (vlan == 0 || vlan >= VLAN_ID_COUNT - 1) {
+            throw invalid_argument("Invalid VLAN ID");
+        }
+        mac_table.insert(macKey(mac_address), vlan, true);
+    }
+
+    // VLAN of a MAC, 0 if it has none
+    uint16_t getVlan(const string& mac_address) {
+        uint16_t* vlan = mac_table.find(macKey(mac_address));
+        return vlan != nullptr ? *vlan : 0;
+    }
+
+    bool isAuthorized(string src_mac, string dst_mac) {
+        uint16_t src_vlan = getVlan(src_mac);
+        return src_vlan != 0 && src_vlan == getVlan(dst_mac);
+    }
+};
+
 class Bridge {
 private:
     string name;
-    unordered_map<string, FlowControlProtocol*> forwarding_table;
+    MacForwardingTable<FlowControlProtocol*> forwarding_table;
+    double frame_error_rate; // Fraction of frames that pick up a bit error on the way out
+    minstd_rand error_rng;
+    long long fcs_errors;
+
+    // Destination MAC, our (zero) source MAC, EtherType and the data padded to 60 bytes, then the FCS
+    static vector<uint8_t> buildFrame(const string& dst_mac, const string& data) {
+        vector<uint8_t> frame(max<size_t>(14 + data.size(), 60) + 4, 0);
+        uint64_t dst = macKey(dst_mac);
+        for (int i = 0; i < 6; i++) {
+            frame[i] = (uint8_t)(dst >> (40 - 8 * i));
+        }
+        frame[12] = 0x08;
+        memcpy(frame.data() + 14, data.data(), data.size());
+        size_t body = frame.size() - 4;
+        uint32_t fcs = crc32(frame.data(), body);
+        memcpy(frame.data() + body, &fcs, 4); // Transmitted least significant byte first
+        return frame;
+    }
+
+    static bool checkFrame(const vector<uint8_t>& frame) {
+        uint32_t fcs;
+        memcpy(&fcs, frame.data() + frame.size() - 4, 4);
+        return crc32(frame.data(), frame.size() - 4) == fcs;
+    }
 
 public:
     Bridge(string name) {
         this->name = name;
+        frame_error_rate = 0;
+        fcs_errors = 0;
+    }
+
+    void setFrameErrorRate(double rate) {
+        frame_error_rate = rate;
+    }
+
+    long long getFcsErrors() {
+        return fcs_errors;
     }
 
    void addForwardingTableEntry(string mac_address, FlowControlProtocol* protocol) {
     if (mac_address.size() != 17) { // check that MAC address has correct format
         throw invalid_argument("Invalid MAC address");
     }
-    forwarding_table[mac_address] = protocol;
+    forwarding_table.insert(macKey(mac_address), protocol, true); // Configured entries are static
 }
 
 
     void sendPacket(string dst_mac, string data) {
-    if (forwarding_table.count(dst_mac) == 0) { // check that MAC address exists in forwarding table
+    FlowControlProtocol** entry = forwarding_table.find(macKey(dst_mac));
+    if (entry == nullptr) { // check that MAC address exists in forwarding table
         cout << "Packet dropped: MAC address not found in forwarding table" << endl;
         return;
     }
-    FlowControlProtocol* protocol = forwarding_table[dst_mac];
+    FlowControlProtocol* protocol = *entry;
     if (protocol->canSendPacket()) {
+        vector<uint8_t> frame = buildFrame(dst_mac, data);
+        if (frame_error_rate > 0 && uniform_real_distribution<double>(0, 1)(error_rng) < frame_error_rate) {
+            size_t bit = error_rng() % (frame.size() * 8);
+            frame[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        }
+        if (!checkFrame(frame)) { // Receiver side of the link
+            fcs_errors++;
+            cout << "Packet dropped: FCS mismatch" << endl;
+            return;
+        }
         cout << "Packet sent from " << name << " to " << dst_mac << " with data: " << data << endl;
     } else {
         cout << "Packet dropped due to flow control protocol overflow" << endl;
@@ -43,15 +548,41 @@ public:
 };
 class Switch : public FlowControlProtocol {
 private:
-    unordered_map<string, Bridge*> forwarding_table;
+    MacForwardingTable<Bridge*> forwarding_table; // One table per VLAN, keyed by VLAN ID above the 48-bit MAC
+    MACFilteringProtocol* vlan_membership;
+
+    static uint64_t vlanKey(uint16_t vlan, const string& mac_address) {
+        return ((uint64_t)vlan << 48) | macKey(mac_address);
+    }
 
 public:
+    Switch(MACFilteringProtocol* membership = nullptr) {
+        vlan_membership = membership;
+    }
+
+    // Entries go into the MAC's own VLAN, or VLAN 1 without a membership table
     void addForwardingTableEntry(string mac_address, Bridge* bridge) {
-        forwarding_table[mac_address] = bridge;
+        uint16_t vlan = vlan_membership != nullptr ? vlan_membership->getVlan(mac_address) : DEFAULT_VLAN;
+        addForwardingTableEntry(mac_address, bridge, vlan != 0 ? vlan : DEFAULT_VLAN);
+    }
+
+    void addForwardingTableEntry(string mac_address, Bridge* bridge, uint16_t vlan) {
+        forwarding_table.insert(vlanKey(vlan, mac_address), bridge);
     }
 
-    Bridge* getBridgeForMacAddress(string mac_address) {
-        return forwarding_table[mac_address];
+    // nullptr if the MAC hasn't been added
+    Bridge* getBridgeForMacAddress(string mac_address, uint16_t vlan = DEFAULT_VLAN) {
+        Bridge** entry = forwarding_table.find(vlanKey(vlan, mac_address));
+        return entry != nullptr ? *entry : nullptr;
+    }
+
+    // Looks the destination up in the sender's VLAN only, so frames never cross VLANs
+    Bridge* getBridgeForFrame(string src_mac, string dst_mac) {
+        uint16_t vlan = vlan_membership != nullptr ? vlan_membership->getVlan(src_mac) : DEFAULT_VLAN;
+        if (vlan == 0) {
+            return nullptr;
+        }
+        return getBridgeForMacAddress(dst_mac, vlan);
     }
 
     bool canSendPacket() {
@@ -119,19 +650,6 @@ public:
     }
 };
 
-class MACFilteringProtocol {
-private:
-    unordered_map<string, string> mac_table;
-
-public:
-    void addEntry(string mac_address, string vlan) {
-        mac_table[mac_address] = vlan;
-    }
-
-    bool isAuthorized(string src_mac, string dst_mac) {
-        return mac_table.find(src_mac) != mac_table.end() && mac_table.find(dst_mac) != mac_table.end() && mac_table[src_mac] == mac_table[dst_mac];
-    }
-};
 int main() {
     Bridge bridge1("Bridge1");
     Bridge bridge2("Bridge2");
@@ -1,6 +1,12 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <queue>
+#include <deque>
+#include <random>
+#include <functional>
+#include <string>
 
 using namespace std;
 
@@ -44,6 +50,7 @@ class Hub {
     string hub_name;
     vector<EndDevice*> connected_devices;
     vector<Hub*> connected_hubs;
+    vector<Hub*> forwarding_hubs; // Hub links left active by the spanning tree
 
   public:
     Hub(int id, string name) {
@@ -88,13 +95,442 @@ class Hub {
       connected_hubs.erase(remove(connected_hubs.begin(), connected_hubs.end(), hub), connected_hubs.end());
       // additional logic for disconnecting from another hub
     }
+
+    vector<Hub*> getForwardingHubs() {
+      return forwarding_hubs;
+    }
+
+    void setForwardingHubs(vector<Hub*> hubs) {
+      forwarding_hubs = hubs;
+    }
+
+    // Repeats a transmission to every attached device, then on along the spanning tree.
+    // Tree links only, so every hub is reached exactly once.
+    void repeat(EndDevice* sender) {
+      vector<pair<Hub*, Hub*>> pending = {{this, nullptr}}; // hub, hub it was heard from
+      while (!pending.empty()) {
+        Hub* hub = pending.back().first;
+        Hub* from = pending.back().second;
+        pending.pop_back();
+        for (EndDevice* device : hub->connected_devices) {
+          if (device != sender) {
+            cout << "Received data at " << device->getDeviceName() << endl;
+          }
+        }
+        for (auto it = hub->forwarding_hubs.rbegin(); it != hub->forwarding_hubs.rend(); ++it) {
+          if (*it != from) {
+            pending.push_back({*it, hub});
+          }
+        }
+      }
+    }
 };
 
-int main() {
+// Spanning tree over the hub graph, so a broadcast can't circulate forever around a cycle.
+// Hub links count in both directions. The lowest hub ID in each connected group is the root,
+// and every other hub keeps only its link to the lowest-ID neighbour one hop closer to the
+// root: the tree 802.1D picks when all links cost the same. Returns how many links are blocked.
+int computeSpanningTree(vector<Hub*>& hubs) {
+  unordered_map<Hub*, vector<Hub*>> neighbours;
+  for (Hub* hub : hubs) {
+    for (Hub* other : hub->getConnectedHubs()) {
+      if (other != hub) {
+        neighbours[hub].push_back(other);
+        neighbours[other].push_back(hub);
+      }
+    }
+  }
+  auto byId = [](Hub* a, Hub* b) { return a->getHubId() < b->getHubId(); };
+  int links = 0;
+  for (auto& entry : neighbours) {
+    vector<Hub*>& list = entry.second;
+    sort(list.begin(), list.end(), byId);
+    list.erase(unique(list.begin(), list.end()), list.end());
+    links += list.size();
+  }
+  links /= 2;
+
+  vector<Hub*> order = hubs;
+  sort(order.begin(), order.end(), byId);
+  unordered_map<Hub*, int> distance;
+  unordered_map<Hub*, vector<Hub*>> tree;
+  int tree_links = 0;
+  for (Hub* root : order) {
+    if (distance.count(root) > 0) {
+      continue;
+    }
+    distance[root] = 0;
+    queue<Hub*> frontier;
+    frontier.push(root);
+    while (!frontier.empty()) {
+      Hub* hub = frontier.front();
+      frontier.pop();
+      // Neighbours are sorted, so the first one a hop closer is the lowest-ID choice
+      for (Hub* other : neighbours[hub]) {
+        auto known = distance.find(other);
+        if (known == distance.end()) {
+          distance[other] = distance[hub] + 1;
+          frontier.push(other);
+        } else if (known->second == distance[hub] - 1 && tree[hub].empty()) {
+          tree[hub].push_back(other);
+          tree[other].push_back(hub);
+          tree_links++;
+        }
+      }
+    }
+  }
+  for (Hub* hub : hubs) {
+    vector<Hub*> active = tree[hub];
+    sort(active.begin(), active.end(), byId);
+    hub->setForwardingHubs(active);
+  }
+  return links - tree_links;
+}
+
+// Token-passing access for a ring, after IEEE 802.5. Only the station holding the free token
+// may transmit, and it must pass the token on once its token holding time (THT) is used up, so
+// every station's wait is bounded. Each token carries a priority: a station may only seize it
+// with a frame of at least that priority, and stations with more urgent frames reserve a raise
+// as the current holder's frames go by. The station that raises the priority remembers the old
+// level and lowers it again once nobody needs it. Station 0 is the active monitor: when no
+// token has gone by for MONITOR_TIMEOUT it purges the ring and issues a new one.
+// Times are in microseconds.
+class TokenRing {
+  public:
+    static const int PRIORITIES = 8;
+    static constexpr double BIT_RATE = 16;             // Mbit/s, so bits per microsecond
+    static constexpr double STATION_DELAY_BITS = 4;    // Repeater latency at each station
+    static constexpr double HOP_PROPAGATION = 0.5;     // 100 m of cable between stations
+    static constexpr double TOKEN_BITS = 24;
+    static constexpr int FRAME_OVERHEAD_BYTES = 21;
+    static constexpr double MONITOR_TIMEOUT = 10000;
+
+    struct Stats {
+      long long frames_sent = 0;
+      long long token_passes = 0;
+      long long priority_raises = 0;
+      long long tokens_lost = 0;
+      double busy_time = 0;
+      double recovery_time = 0;
+      double max_access[PRIORITIES] = {}; // From a frame reaching the head of its queue to sending it
+      double total_access[PRIORITIES] = {};
+      long long accesses[PRIORITIES] = {};
+    };
+
+  private:
+    struct Source {
+      int station;
+      int priority;
+      double rate; // Frames per microsecond
+    };
+
+    struct Raise {
+      int station;
+      int old_priority;
+      int raised_priority;
+    };
+
+    int stations;
+    double tht;
+    bool early_release;
+    double token_loss;
+    double now;
+    int position;                          // Station the free token is at
+    int token_priority;
+    vector<Raise> raises;                  // The stacking stations, innermost last
+    vector<vector<deque<double>>> queues;  // Arrival times per station and priority
+    vector<vector<int>> frame_bytes;
+    vector<vector<bool>> saturated;
+    vector<vector<double>> head_since;
+    int pending[PRIORITIES];               // Non-empty queues per priority, ring-wide
+    vector<Source> sources;
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> arrivals;
+    int longest_frame;
+    mt19937 gen;
+    function<void(int, int, double)> on_transmit;
+    Stats stats;
+
+    double frameTime(int bytes) {
+      return (bytes + FRAME_OVERHEAD_BYTES) * 8 / BIT_RATE;
+    }
+
+    double hopTime() {
+      return STATION_DELAY_BITS / BIT_RATE + HOP_PROPAGATION;
+    }
+
+    void push(int station, int priority, double arrival) {
+      deque<double>& queue = queues[station][priority];
+      if (queue.empty()) {
+        pending[priority]++;
+        head_since[station][priority] = arrival;
+      }
+      queue.push_back(arrival);
+    }
+
+    void admit() {
+      while (!arrivals.empty() && arrivals.top().first <= now) {
+        double at = arrivals.top().first;
+        int index = arrivals.top().second;
+        arrivals.pop();
+        Source& source = sources[index];
+        push(source.station, source.priority, at);
+        exponential_distribution<double> gap(source.rate);
+        arrivals.push({at + gap(gen), index});
+      }
+    }
+
+    int highestPending(int station) {
+      for (int priority = PRIORITIES - 1; priority >= 0; priority--) {
+        if (!queues[station][priority].empty()) {
+          return priority;
+        }
+      }
+      return -1;
+    }
+
+    // The highest reservation the other stations could have written into passing frames
+    int highestReservation(int station) {
+      for (int priority = PRIORITIES - 1; priority >= 0; priority--) {
+        if (pending[priority] > (queues[station][priority].empty() ? 0 : 1)) {
+          return priority;
+        }
+      }
+      return -1;
+    }
+
+    void hold(int station) {
+      double held = 0;
+      while (true) {
+        admit();
+        int priority = highestPending(station);
+        if (priority < token_priority) {
+          break;
+        }
+        double duration = frameTime(frame_bytes[station][priority]);
+        if (held > 0 && held + duration > tht) {
+          break;
+        }
+        double access = now - head_since[station][priority];
+        stats.max_access[priority] = max(stats.max_access[priority], access);
+        stats.total_access[priority] += access;
+        stats.accesses[priority]++;
+        if (on_transmit) {
+          on_transmit(station, priority, now);
+        }
+        now += duration;
+        held += duration;
+        stats.busy_time += duration;
+        stats.frames_sent++;
+
+        deque<double>& queue = queues[station][priority];
+        queue.pop_front();
+        if (saturated[station][priority]) {
+          queue.push_back(now);
+        }
+        if (queue.empty()) {
+          pending[priority]--;
+        } else {
+          head_since[station][priority] = max(queue.front(), now);
+        }
+      }
+      if (!early_release) {
+        now += ringLatency(); // Wait for the last frame to come back round
+      }
+      admit();
+      int wanted = max(highestReservation(station), highestPending(station));
+      if (wanted > token_priority) {
+        raises.push_back({station, token_priority, wanted});
+        token_priority = wanted;
+        stats.priority_raises++;
+      }
+    }
+
+  public:
+    TokenRing(int stations, double tht = 10000, bool early_release = true) {
+      this->stations = max(stations, 1);
+      this->tht = tht;
+      this->early_release = early_release;
+      token_loss = 0;
+      now = 0;
+      position = 0;
+      token_priority = 0;
+      queues.assign(this->stations, vector<deque<double>>(PRIORITIES));
+      frame_bytes.assign(this->stations, vector<int>(PRIORITIES, 1500));
+      saturated.assign(this->stations, vector<bool>(PRIORITIES, false));
+      head_since.assign(this->stations, vector<double>(PRIORITIES, 0));
+      fill(pending, pending + PRIORITIES, 0);
+      longest_frame = 0;
+      gen.seed(1);
+    }
+
+    void setTokenLoss(double probability_per_pass) {
+      token_loss = probability_per_pass;
+    }
+
+    void onTransmit(function<void(int, int, double)> callback) {
+      on_transmit = callback;
+    }
+
+    // Queues one frame at the station now
+    void enqueue(int station, int priority, int bytes) {
+      frame_bytes[station][priority] = bytes;
+      longest_frame = max(longest_frame, bytes);
+      push(station, priority, now);
+    }
+
+    // Poisson traffic of the given frames per second
+    void addTraffic(int station, int priority, double frames_per_second, int bytes) {
+      frame_bytes[station][priority] = bytes;
+      longest_frame = max(longest_frame, bytes);
+      sources.push_back({station, priority, frames_per_second / 1e6});
+      exponential_distribution<double> gap(sources.back().rate);
+      arrivals.push({now + gap(gen), (int)sources.size() - 1});
+    }
+
+    // The station always has another frame of this priority waiting
+    void setSaturated(int station, int priority, int bytes) {
+      frame_bytes[station][priority] = bytes;
+      longest_frame = max(longest_frame, bytes);
+      if (!saturated[station][priority]) {
+        saturated[station][priority] = true;
+        push(station, priority, now);
+      }
+    }
+
+    // Passes the token one station along, letting the station it reaches use it first
+    void step() {
+      admit();
+      if (token_loss > 0 && uniform_real_distribution<double>(0, 1)(gen) < token_loss) {
+        // The monitor times out, purges the ring and issues a fresh token
+        double resumed = now + MONITOR_TIMEOUT + ringLatency();
+        stats.tokens_lost++;
+        stats.recovery_time += resumed - now;
+        now = resumed;
+        position = 0;
+        token_priority = 0;
+        raises.clear();
+        admit();
+      }
+      int station = position;
+      // A stacking station lowers the priority it raised once no one is asking for it
+      while (!raises.empty() && raises.back().station == station && raises.back().raised_priority == token_priority) {
+        int wanted = max(highestReservation(station), highestPending(station));
+        if (wanted >= token_priority) {
+          break;
+        }
+        if (wanted > raises.back().old_priority) {
+          raises.back().raised_priority = wanted;
+          token_priority = wanted;
+          break;
+        }
+        token_priority = raises.back().old_priority;
+        raises.pop_back();
+      }
+      if (highestPending(station) >= token_priority) {
+        hold(station);
+      }
+      now += hopTime();
+      position = (position + 1) % stations;
+      stats.token_passes++;
+    }
+
+    void runUntil(double time) {
+      while (now < time) {
+        step();
+      }
+    }
+
+    // Runs until every queued frame is out; saturated stations never empty
+    void runUntilIdle() {
+      while (any_of(pending, pending + PRIORITIES, [](int count) { return count > 0; })) {
+        step();
+      }
+    }
+
+    // A free token's trip round an idle ring
+    double ringLatency() {
+      return stations * hopTime() + TOKEN_BITS / BIT_RATE;
+    }
+
+    // Longest a station keeps the token, waiting for its own frame included
+    double holdLimit() {
+      return max(tht, frameTime(longest_frame)) + (early_release ? 0 : ringLatency());
+    }
+
+    // Worst-case wait when all traffic shares one priority: every other station holds the
+    // token as long as it may, then the token travels round to this one
+    double accessBound() {
+      return (stations - 1) * holdLimit() + ringLatency();
+    }
+
+    // Worst-case wait for the highest priority in use: the current holder runs out its THT,
+    // the raised token goes once round, and one rotation covers the reservation riding a frame
+    double priorityAccessBound() {
+      return holdLimit() + 2 * ringLatency();
+    }
+
+    // Time from losing the token to the monitor issuing a new one
+    double recoveryBound() {
+      return MONITOR_TIMEOUT + ringLatency();
+    }
+
+    // Worst-case wait across one lost token: the new token starts at the monitor, so the
+    // stations ahead of this one may all hold it again
+    double lossAccessBound() {
+      return accessBound() + recoveryBound() + (stations - 1) * holdLimit();
+    }
+
+    double getTime() {
+      return now;
+    }
+
+    const Stats& getStats() {
+      return stats;
+    }
+};
+
+// PhysicalLayer token-ring
+// Worst-case token access against ring size at 16 Mbit/s with early token release and a 1 ms
+// THT, each bound next to the largest wait measured over 1000 worst-case rotations:
+// every station saturated with 1500-byte frames; the same plus one station sending sporadic
+// priority-6 frames; and the saturated ring again, losing the token once in 100 rotations.
+void runTokenRingStudy() {
+  cout << "stations,ring_latency_us,bound_us,measured_us,priority_bound_us,priority_measured_us,loss_bound_us,"
+       << "loss_measured_us,tokens_lost,utilisation" << endl;
+  const double tht = 1000;
+  for (int stations : {4, 8, 16, 32, 64, 128, 250}) {
+    TokenRing saturated(stations, tht);
+    TokenRing priority(stations, tht);
+    TokenRing lossy(stations, tht);
+    for (int i = 0; i < stations; i++) {
+      saturated.setSaturated(i, 0, 1500);
+      priority.setSaturated(i, 0, 1500);
+      lossy.setSaturated(i, 0, 1500);
+    }
+    priority.addTraffic(stations / 2, 6, 20, 64);
+    lossy.setTokenLoss(0.01 / stations);
+    double duration = 1000 * saturated.accessBound();
+    saturated.runUntil(duration);
+    priority.runUntil(duration);
+    lossy.runUntil(duration);
+    cout << stations << "," << saturated.ringLatency() << "," << saturated.accessBound() << ","
+         << saturated.getStats().max_access[0] << "," << priority.priorityAccessBound() << ","
+         << priority.getStats().max_access[6] << "," << lossy.lossAccessBound() << ","
+         << lossy.getStats().max_access[0] << "," << lossy.getStats().tokens_lost << ","
+         << saturated.getStats().busy_time / saturated.getTime() << endl;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && string(argv[1]) == "token-ring") {
+    runTokenRingStudy();
+    return 0;
+  }
+
   int num_devices;
   string topology;
   
-  cout << "Enter the network topology (star/mesh/bus): ";
+  cout << "Enter the network topology (star/mesh/bus/ring): ";
   cin >> topology;
   cout << "Enter the number of end devices: ";
   cin >> num_devices;
@@ -140,21 +576,53 @@ int main() {
     for (int i = 0; i < devices.size(); i++) {
       hub->connectDevice(devices[i]);
     }
+  } else if (topology == "ring") {
+    // Create a hub for each device and connect each hub to the next, closing the loop
+    for (int i = 0; i < devices.size(); i++) {
+      Hub* hub = new Hub(i + 1, "Hub " + to_string(i + 1));
+      hubs.push_back(hub);
+      if (i > 0) {
+        hub->connectHub(hubs[i - 1]);
+      }
+      hub->connectDevice(devices[i]);
+    }
+    if (hubs.size() > 2) {
+      hubs.back()->connectHub(hubs.front());
+    }
   } else {
-    cout << "Invalid topology. Please enter 'star', 'mesh', or 'bus'." << endl;
+    cout << "Invalid topology. Please enter 'star', 'mesh', 'bus', or 'ring'." << endl;
     return 0;
   }
 
-  // Send and receive data
+  if (hubs.size() > 1) {
+    int blocked = computeSpanningTree(hubs);
+    cout << "Spanning tree: " << blocked << " redundant hub links blocked" << endl;
+  }
+
+  // On a ring, devices take turns as the token comes round
+  if (topology == "ring") {
+    TokenRing ring(devices.size());
+    ring.onTransmit([&](int station, int, double start) {
+      cout << "Sending data from " << devices[station]->getDeviceName() << " with the token at " << start << " us..." << endl;
+      hubs[station]->repeat(devices[station]);
+    });
+    for (int i = devices.size() - 1; i >= 0; i--) {
+      ring.enqueue(i, 0, 1500);
+    }
+    ring.runUntilIdle();
+    cout << "Token ring: worst-case access " << ring.accessBound() << " us for " << devices.size() << " stations" << endl;
+    return 0;
+  }
+
+  // Send and receive data: each device transmits into the first hub it is plugged into
   for (int i = 0; i < devices.size(); i++) {
     EndDevice* device = devices[i];
     cout << "Sending data from " << device->getDeviceName() << "..." << endl;
     for (int j = 0; j < hubs.size(); j++) {
       vector<EndDevice*> connected_devices = hubs[j]->getConnectedDevices();
-      for (int k = 0; k < connected_devices.size(); k++) {
-        if (connected_devices[k] != device) {
-          cout << "Received data at " << connected_devices[k]->getDeviceName() << endl;
-        }
+      if (find(connected_devices.begin(), connected_devices.end(), device) != connected_devices.end()) {
+        hubs[j]->repeat(device);
+        break;
       }
     }
   }
@@ -6,6 +6,9 @@
 #include <random>
 #include <chrono>
 #include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <map>
 #include <windows.h>
 
 using namespace std;
@@ -18,11 +21,221 @@ const int TIMEOUT = 1000;
 const int HTTP_PORT = 80;
 const int SSH_PORT = 22;
 
+typedef long long SimTime; // Virtual time in nanoseconds
+
+const SimTime MILLISECOND = 1000000;
+const SimTime SECOND = 1000 * MILLISECOND;
+
+// Virtual clock shared by every device, so cache aging does not depend on host speed
+class VirtualClock {
+private:
+    SimTime current_time = 0;
+
+public:
+    SimTime now() const {
+        return current_time;
+    }
+
+    void advance(SimTime delta) {
+        current_time += delta;
+    }
+};
+
+VirtualClock simulationClock;
+
+bool verbose = true; // Per-segment and per-ACK traces; long transfers turn them off
+
+// Per-interface ARP cache. Entries are packed into 16 bytes (IPv4 as 32 bits, MAC and
+// state sharing 64 bits) in a slab, and aging is driven by a hashed timing wheel: the
+// cache is advanced lazily on every access and only the buckets for the elapsed ticks
+// are visited, so expiry never scans the whole table.
+class ArpCache {
+public:
+    enum State { INCOMPLETE = 0, REACHABLE = 1, STALE = 2 };
+
+private:
+    struct Entry {
+        uint32_t ip;
+        uint32_t expires;  // Tick at which the entry changes state
+        uint64_t mac_state; // Low 48 bits MAC, high byte state (0 = free slot)
+    };
+
+    vector<Entry> entries;
+    vector<uint32_t> free_slots;
+    unordered_map<uint32_t, uint32_t> index; // IP -> slot
+    vector<vector<uint32_t>> wheel;          // Tick % wheel size -> slots due then; allocated on first insert
+    size_t wheel_size;
+    size_t capacity;
+    SimTime tick_length;
+    uint32_t reachable_ticks;
+    uint32_t stale_ticks;
+    uint32_t current_tick;
+
+    static int stateOf(const Entry& entry) {
+        return (int)(entry.mac_state >> 56);
+    }
+
+    static uint64_t pack(uint64_t mac, int state) {
+        return (mac & 0xFFFFFFFFFFFFULL) | ((uint64_t)state << 56);
+    }
+
+    void schedule(uint32_t slot) {
+        wheel[entries[slot].expires % wheel_size].push_back(slot);
+    }
+
+    void release(uint32_t slot) {
+        index.erase(entries[slot].ip);
+        entries[slot].mac_state = 0;
+        free_slots.push_back(slot);
+    }
+
+    // REACHABLE entries fall back to STALE; STALE entries are removed
+    void expire(uint32_t slot) {
+        Entry& entry = entries[slot];
+        while (stateOf(entry) != 0 && entry.expires <= current_tick) {
+            if (stateOf(entry) == REACHABLE) {
+                entry.mac_state = pack(entry.mac_state, STALE);
+                entry.expires += stale_ticks;
+            } else {
+                release(slot);
+                return;
+            }
+        }
+        schedule(slot);
+    }
+
+    void advance(SimTime now) {
+        uint32_t target = (uint32_t)(now / tick_length);
+        if (wheel.empty()) {
+            current_tick = target;
+            return;
+        }
+        // Past one full revolution every bucket is due, so visit each once
+        if (target - current_tick > wheel_size) {
+            current_tick = target - wheel_size;
+        }
+        while (current_tick < target) {
+            current_tick++;
+            vector<uint32_t> due;
+            due.swap(wheel[current_tick % wheel_size]);
+            for (uint32_t slot : due) {
+                const Entry& entry = entries[slot];
+                if (stateOf(entry) == 0 || entry.expires % wheel_size != current_tick % wheel_size) {
+                    continue; // Freed or rescheduled since; drop the stale reference
+                }
+                if (entry.expires > current_tick) {
+                    wheel[current_tick % wheel_size].push_back(slot); // Due on a later revolution
+                } else {
+                    expire(slot);
+                }
+            }
+        }
+    }
+
+    // Frees the live entry closest to expiry to keep the table within capacity
+    void evictOne() {
+        for (size_t offset = 0; offset <= wheel_size; offset++) {
+            size_t position = (current_tick + offset) % wheel_size;
+            for (uint32_t slot : wheel[position]) {
+                const Entry& entry = entries[slot];
+                if (stateOf(entry) != 0 && entry.expires % wheel_size == position) { // Skip slots refreshed since
+                    release(slot);
+                    return;
+                }
+            }
+        }
+    }
+
+public:
+    ArpCache(size_t maxEntries = 4096, SimTime reachableTime = 30 * SECOND, SimTime staleTime = 60 * SECOND, SimTime tick = SECOND, size_t wheelSize = 256) {
+        capacity = maxEntries;
+        tick_length = tick;
+        reachable_ticks = (uint32_t)(reachableTime / tick);
+        stale_ticks = (uint32_t)(staleTime / tick);
+        current_tick = 0;
+        wheel_size = wheelSize;
+    }
+
+    static uint32_t packIP(const string& ip) {
+        unsigned a = 0, b = 0, c = 0, d = 0;
+        sscanf(ip.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d);
+        return (a << 24) | (b << 16) | (c << 8) | d;
+    }
+
+    static uint64_t packMAC(const string& mac) {
+        unsigned bytes[6] = {0, 0, 0, 0, 0, 0};
+        sscanf(mac.c_str(), "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]);
+        uint64_t packed = 0;
+        for (unsigned byte : bytes) {
+            packed = (packed << 8) | (byte & 0xFF);
+        }
+        return packed;
+    }
+
+    static string unpackMAC(uint64_t mac) {
+        char text[18];
+        snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+                 (unsigned)(mac >> 40) & 0xFF, (unsigned)(mac >> 32) & 0xFF, (unsigned)(mac >> 24) & 0xFF,
+                 (unsigned)(mac >> 16) & 0xFF, (unsigned)(mac >> 8) & 0xFF, (unsigned)mac & 0xFF);
+        return text;
+    }
+
+    // Adds or confirms a mapping; the entry becomes REACHABLE again
+    void insert(const string& ipAddress, const string& macAddress, SimTime now) {
+        if (wheel.empty()) {
+            wheel.resize(wheel_size);
+        }
+        advance(now);
+        uint32_t ip = packIP(ipAddress);
+        auto it = index.find(ip);
+        uint32_t slot;
+        if (it != index.end()) {
+            slot = it->second;
+        } else {
+            if (index.size() >= capacity) {
+                evictOne();
+            }
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                slot = entries.size();
+                entries.push_back(Entry());
+            }
+            index[ip] = slot;
+        }
+        entries[slot].ip = ip;
+        entries[slot].expires = current_tick + max(reachable_ticks, 1u);
+        entries[slot].mac_state = pack(packMAC(macAddress), REACHABLE);
+        schedule(slot);
+    }
+
+    // Returns the MAC ("" on a miss); state receives REACHABLE or STALE
+    string lookup(const string& ipAddress, SimTime now, State* state = nullptr) {
+        advance(now);
+        auto it = index.find(packIP(ipAddress));
+        if (it == index.end()) {
+            return "";
+        }
+        const Entry& entry = entries[it->second];
+        if (state != nullptr) {
+            *state = (State)stateOf(entry);
+        }
+        return unpackMAC(entry.mac_state);
+    }
+
+    size_t size() const {
+        return index.size();
+    }
+};
+
+class EndDevice;
+
 class Network {
 private:
     string network_ip;
     int next_subnet;
-    unordered_map<string, string> arpCache; // ARP cache: IP Address -> MAC Address
+    vector<EndDevice*> devices; // Every device on this subnet shares one broadcast domain
 
 public:
     Network(string ip) {
@@ -38,18 +251,13 @@ public:
     string getNetworkIP() {
         return network_ip;
     }
-    
-    void addToARPCache(const string& ipAddress, const string& macAddress) {
-        arpCache[ipAddress] = macAddress;
-    }
 
-    string getMacAddressFromARPCache(const string& ipAddress) {
-        if (arpCache.count(ipAddress) > 0) {
-            return arpCache[ipAddress];
-        }
-        return "";
+    void registerDevice(EndDevice* device) {
+        devices.push_back(device);
     }
-    
+
+    // Delivers an ARP request to every other device on the subnet; returns the number of frames sent
+    int broadcastArpRequest(EndDevice* sender, const string& targetIP);
 };
 
 class RoutingTable {
@@ -145,86 +353,191 @@ public:
     virtual void receive(const string& data, const string& sourceIP, const string& destinationIP, int sourcePort, int destinationPort) = 0;
 };
 
+// Go-Back-N over a lossy link, with both ends simulated in virtual time. send() cuts the data
+// into segments of segmentSize bytes and keeps at most windowSize of them unacknowledged, in a
+// ring buffer indexed by sequence number. The receiver accepts only the next segment in order,
+// discards anything else and answers every arrival with a cumulative ACK for the last segment
+// it accepted. One timer runs for the oldest outstanding segment; when it expires the sender
+// goes back and resends every outstanding segment.
 class GoBackNProtocol : public TransportLayerProtocol {
 private:
+    struct Segment {
+        int seq;
+        string payload;
+    };
+
+    struct Arrival {
+        bool ack;    // ACK at the sender, otherwise a segment at the receiver
+        int seq;
+        string payload;
+    };
+
     int windowSize;
-    int Sf;
-    int Sn;
-    int timer; // Timer variable to track the timeout
+    int segmentSize;
+    SimTime linkDelay;
+    double lossRate;
+    SimTime timeout;
+    mt19937 gen;
+
+    int Sf;                  // Oldest unacknowledged segment
+    int Sn;                  // Next segment to send
+    vector<Segment> window;  // Segments in [Sf, Sn), slot seq % windowSize
+    SimTime timerExpiry;     // -1 while no segment is outstanding
+    int Rn;                  // Next segment the receiver will accept
+    string delivered;        // What the receiver has passed up, in order
+    multimap<SimTime, Arrival> inFlight; // Equal times keep their sending order
+
+    long long segmentsSent;
+    long long retransmissions;
+    long long timeouts;
+
+    bool lost() {
+        return lossRate > 0 && uniform_real_distribution<double>(0, 1)(gen) < lossRate;
+    }
+
+    void transmitSegment(int seq, bool resend) {
+        segmentsSent++;
+        retransmissions += resend;
+        bool dropped = lost();
+        if (verbose) {
+            cout << (resend ? "Resending" : "Sending") << " packet with sequence number " << seq << (dropped ? " (lost)" : "") << endl;
+        }
+        if (dropped) {
+            return;
+        }
+        inFlight.insert({simulationClock.now() + linkDelay, {false, seq, window[seq % windowSize].payload}});
+    }
+
+    void receiveSegment(int seq, const string& payload) {
+        if (seq == Rn) {
+            if (verbose) {
+                cout << "Received packet with sequence number " << seq << endl;
+            }
+            delivered += payload;
+            Rn++;
+        } else if (verbose) {
+            cout << "Packet with sequence number " << seq << " is out of order (expecting " << Rn << "). Discarding..." << endl;
+        }
+        if (Rn > 0) {
+            sendAck(Rn - 1);
+        }
+    }
+
+    void receiveAck(int ackNum) {
+        if (ackNum < Sf || ackNum >= Sn) {
+            return; // Duplicate or stale
+        }
+        if (verbose) {
+            cout << "Received acknowledgement for packet with sequence number " << ackNum << endl;
+        }
+        Sf = ackNum + 1;
+        timerExpiry = Sf == Sn ? -1 : simulationClock.now() + timeout;
+    }
 
 public:
-    GoBackNProtocol(int size) : windowSize(5), Sf(5), Sn(10), timer(1000) {}
+    GoBackNProtocol(int size) : windowSize(max(size, 1)), segmentSize(4), linkDelay(10 * MILLISECOND), lossRate(0),
+                                timeout(40 * MILLISECOND), gen(1), Sf(0), Sn(0), timerExpiry(-1), Rn(0),
+                                segmentsSent(0), retransmissions(0), timeouts(0) {
+        window.resize(windowSize);
+    }
+
+    // One-way delay and loss probability for segments and ACKs alike. The timeout should
+    // cover a round trip; loss is capped so every transfer finishes.
+    void setLink(SimTime delay, double loss, SimTime timeout) {
+        linkDelay = delay;
+        lossRate = min(max(loss, 0.0), 0.9);
+        this->timeout = timeout;
+    }
+
+    void setSegmentSize(int bytes) {
+        segmentSize = max(bytes, 1);
+    }
 
      void send(const string& data, const string& sourceIP, const string& destinationIP, int sourcePort, int destinationPort, const string& destinationMac) override {
-    // Implement Go-Back-N protocol for sending data
     cout << "Sending data using Go-Back-N protocol" << endl;
-    cout << "Data: " << data << endl;
+    if (verbose) {
+        cout << "Data: " << data << endl;
+    }
     cout << "Source IP: " << sourceIP << endl;
     cout << "Destination IP: " << destinationIP << endl;
     cout << "Source Port: " << sourcePort << endl;
     cout << "Destination Port: " << destinationPort << endl;
     cout << "Window Size: " << windowSize << endl;
 
-    // Start the timer
-    timer = 1000; // Setting the timer value to 1000 (example value)
-
-    // Iterate over the packets to be sent
-    for (int seqNum = Sf; seqNum < data.size(); seqNum++) {
-        // Check if the window is not full
-        if (Sn < Sf + windowSize) {
-            cout << "Sending packet with sequence number " << seqNum << endl;
-            Sn++;
-        } else {
-            cout << "Window is full. Waiting for acknowledgements..." << endl;
-
-            // Wait for acknowledgements or timeout
-            while (timer > 0) {
-                // Simulate passage of time (decrease timer value)
-                timer--;
-
-                // Check for incoming acknowledgements
-                // ...
-
-                // Simulate delay before re-checking
-                Sleep(100); // Delay for 100 milliseconds
+    int segments = (data.size() + segmentSize - 1) / segmentSize;
+    Sf = Sn = Rn = 0;
+    timerExpiry = -1;
+    delivered.clear();
+    inFlight.clear();
+    segmentsSent = retransmissions = timeouts = 0;
+    SimTime start = simulationClock.now();
+
+    while (Sf < segments) {
+        while (Sn < segments && Sn < Sf + windowSize) {
+            window[Sn % windowSize] = {Sn, data.substr((size_t)Sn * segmentSize, segmentSize)};
+            transmitSegment(Sn++, false);
+            if (timerExpiry < 0) {
+                timerExpiry = simulationClock.now() + timeout;
             }
-
-            // Timeout occurred, retransmit packets
-            cout << "Timeout occurred. Retransmitting packets..." << endl;
-            seqNum = Sf - 1; // Decrement seqNum to retransmit the packet
-            Sn = Sf; // Reset the next sequence number to send
-            timer = 1000; // Reset the timer value
+        }
+        if (inFlight.empty() || timerExpiry < inFlight.begin()->first) {
+            simulationClock.advance(timerExpiry - simulationClock.now());
+            timeouts++;
+            if (verbose) {
+                cout << "Timeout occurred. Retransmitting packets " << Sf << " to " << Sn - 1 << "..." << endl;
+            }
+            for (int seq = Sf; seq < Sn; seq++) {
+                transmitSegment(seq, true);
+            }
+            timerExpiry = simulationClock.now() + timeout;
+            continue;
+        }
+        auto next = inFlight.begin();
+        simulationClock.advance(next->first - simulationClock.now());
+        Arrival arrival = next->second;
+        inFlight.erase(next);
+        if (arrival.ack) {
+            receiveAck(arrival.seq);
+        } else {
+            receiveSegment(arrival.seq, arrival.payload);
         }
     }
 
+    SimTime elapsed = simulationClock.now() - start;
+    cout << "Transfer complete: " << segments << " segments, " << segmentsSent << " sent (" << retransmissions
+         << " retransmitted, " << timeouts << " timeouts) in " << elapsed / MILLISECOND << " ms" << endl;
+    if (elapsed > 0) {
+        cout << "Goodput: " << data.size() * 8.0 * SECOND / elapsed << " bit/s" << endl;
+    }
     cout << endl;
 }
     void receive(const string& data, const string& sourceIP, const string& destinationIP, int sourcePort, int destinationPort) override {
-        // Implement Go-Back-N protocol for receiving data
         cout << "Receiving data using Go-Back-N protocol" << endl;
-        cout << "Data: " << data << endl;
+        if (verbose) {
+            cout << "Data: " << data << endl;
+        }
         cout << "Source IP: " << sourceIP << endl;
         cout << "Destination IP: " << destinationIP << endl;
         cout << "Source Port: " << sourcePort << endl;
         cout << "Destination Port: " << destinationPort << endl;
         cout << "Window Size: " << windowSize << endl;
-        cout << endl;
-
-        // Process received packets
-        for (int i = 0; i < data.size(); i++) {
-            if (i >= Sf && i < Sn) {
-                cout << "Received packet with sequence number " << i << endl;
-                // Send acknowledgement for the received packet
-                sendAck(i);
-            } else {
-                cout << "Packet with sequence number " << i << " is outside the window. Discarding..." << endl;
-            }
+        if (verbose) {
+            cout << "Delivered in order: " << delivered << endl;
         }
+        cout << (delivered == data ? "Matches the data sent" : "Does not match the data sent") << endl;
+        cout << endl;
     }
 
+    // Cumulative: everything up to ackNum has arrived in order
     void sendAck(int ackNum) {
-        // Send acknowledgement for the received packet
-        cout << "Sending acknowledgement for packet with sequence number " << ackNum << endl;
+        bool dropped = lost();
+        if (verbose) {
+            cout << "Sending acknowledgement for packet with sequence number " << ackNum << (dropped ? " (lost)" : "") << endl;
+        }
+        if (dropped) {
+            return;
+        }
+        inFlight.insert({simulationClock.now() + linkDelay, {true, ackNum, ""}});
     }
 };
 
@@ -266,7 +579,7 @@ private:
     Network* network;
     TransportLayerProtocol* transportProtocol;
     vector<ApplicationLayerService*> services;
-    unordered_map<string, string> arpCache; 
+    ArpCache arpCache; // ARP cache of this device's interface
 
 public:
     EndDevice(int id, string name, Network* net, string mac, string mask) {
@@ -277,10 +590,11 @@ public:
         mac_address = mac;
         subnet_mask = mask;
         transportProtocol = nullptr;
+        network->registerDevice(this);
     }
 
     void addToARPCache(const string& ipAddress, const string& macAddress) {
-        network->addToARPCache(ipAddress, macAddress);
+        arpCache.insert(ipAddress, macAddress, simulationClock.now());
     }
 
 
@@ -330,22 +644,37 @@ public:
         cout << endl;
     }
 
+    // Cache hit, or an ARP request broadcast on the subnet; "" when nobody owns the IP
     string resolveMacAddress(const string& ipAddress) {
-        string macAddress = network->getMacAddressFromARPCache(ipAddress);
+        string macAddress = arpCache.lookup(ipAddress, simulationClock.now());
         if (macAddress.empty()) {
-            // Perform ARP lookup to find the MAC address
-            // Here, you can implement the logic to send ARP request and receive ARP response
-            // For demonstration purposes, let's assume the MAC address is found
-            macAddress = "12:34:56:78:90:AB";
-            addToARPCache(ipAddress, macAddress);
+            network->broadcastArpRequest(this, ipAddress);
+            macAddress = arpCache.lookup(ipAddress, simulationClock.now());
         }
         return macAddress;
     }
 
+    // Answers a broadcast ARP request if it is for this device, learning the sender on the way
+    void handleArpRequest(EndDevice* sender, const string& senderIP, const string& senderMac, const string& targetIP) {
+        if (targetIP != ip_address) {
+            return;
+        }
+        addToARPCache(senderIP, senderMac);
+        sender->handleArpReply(ip_address, mac_address);
+    }
+
+    void handleArpReply(const string& senderIP, const string& senderMac) {
+        addToARPCache(senderIP, senderMac);
+    }
+
 
     void sendData(const string& data, const string& destinationIP, int destinationPort) {
         if (transportProtocol != nullptr) {
             string destinationMac = resolveMacAddress(destinationIP);
+            if (destinationMac.empty()) {
+                cout << "ARP resolution failed for " << destinationIP << ". Packet dropped." << endl;
+                return;
+            }
             transportProtocol->send(data, ip_address, destinationIP, 0, destinationPort, destinationMac);
         }
     }
@@ -357,12 +686,62 @@ public:
     }
 };
 
-int main() {
+int Network::broadcastArpRequest(EndDevice* sender, const string& targetIP) {
+    int frames = 0;
+    for (EndDevice* device : devices) {
+        if (device != sender) {
+            device->handleArpRequest(sender, sender->getIpAddress(), sender->getMacAddress(), targetIP);
+            frames++;
+        }
+    }
+    return frames;
+}
+
+// Streams ARP confirmations for a million hosts through one cache in virtual time and
+// reports how large the table stays; aging keeps it bounded without any full scans
+void runArpScaleTest() {
+    const int hosts = 1000000;
+    const SimTime interval = MILLISECOND; // 1000 new neighbours per virtual second
+    ArpCache cache(1 << 20);
+    size_t peak = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < hosts; i++) {
+        string ip = "10." + to_string((i >> 16) & 255) + "." + to_string((i >> 8) & 255) + "." + to_string(i & 255);
+        cache.insert(ip, ArpCache::unpackMAC(0x020000000000ULL + i), simulationClock.now());
+        simulationClock.advance(interval);
+        peak = max(peak, cache.size());
+    }
+    double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Inserted " << hosts << " hosts over " << simulationClock.now() / SECOND << " s virtual time" << endl;
+    cout << "Peak ARP cache size: " << peak << ", final size: " << cache.size() << endl;
+    cout << "Wall time: " << elapsedMs << " ms" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "arp-scale") {
+        runArpScaleTest();
+        return 0;
+    }
+
+    // Pro_Submission2 gbn [bytes] [loss]: one long transfer, summary only
+    if (argc > 1 && string(argv[1]) == "gbn") {
+        verbose = false;
+        int bytes = argc > 2 ? atoi(argv[2]) : 100000;
+        double loss = argc > 3 ? atof(argv[3]) : 0.01;
+        string data(max(bytes, 1), 'x');
+        GoBackNProtocol protocol(WINDOW_SIZE);
+        protocol.setLink(10 * MILLISECOND, loss, 40 * MILLISECOND);
+        protocol.send(data, "192.168.0.1", "192.168.0.2", 12345, 80, "");
+        protocol.receive(data, "192.168.0.1", "192.168.0.2", 12345, 80);
+        return 0;
+    }
+
     Network network("192.168.0");
     RoutingTable routingTable;
     RIP rip(&routingTable);
     OSPF ospf(&routingTable);
     GoBackNProtocol goBackNProtocol(10);
+    goBackNProtocol.setLink(10 * MILLISECOND, 0.2, 40 * MILLISECOND);
     HTTPService httpService;
     SSHService sshService;
 
@@ -11,14 +11,14 @@ private:
     int num_interface;
     bool active;
     std::vector<std::pair<IPNetwork, std::string>> interface;
-    std::vector<int> connected_to_interface;
+    std::vector<Router*> connected_to_interface;
     std::unordered_map<IPNetwork, std::vector<std::string>> router_table;
     std::unordered_map<IPAddress, std::string> stored_arp;
 
 public:
     Router(int id, int num_interface, bool active = true)
         : id(id), num_interface(num_interface), active(active),
-          interface(num_interface), connected_to_interface(num_interface) {}
+          interface(num_interface), connected_to_interface(num_interface, nullptr) {}
 
     void make_active() {
         active = true;
@@ -37,21 +37,31 @@ public:
         }
     }
 
-    int arp_res(std::unordered_map<std::string, std::vector<IPNetwork>> msg_data, Router& device) {
+    // Answers an ARP request with the address of the interface facing the requester
+    std::unordered_map<std::string, std::vector<IPNetwork>> arp_res(std::unordered_map<std::string, std::vector<IPNetwork>> msg_data, Router& device) {
+        std::unordered_map<std::string, std::vector<IPNetwork>> ret;
         if (msg_data["header_3"][1].network() == msg_data["header_3"][0].network()) {
             std::cout << "Router " << id << " rejected the ARP Request" << std::endl;
-            return 0;
+            return ret;
+        }
+        int i = find_interface(device);
+        if (i >= 0) {
+            ret["address"].push_back(interface[i].first);
         }
-        return 0;
+        return ret;
     }
 
     std::unordered_map<std::string, std::vector<IPNetwork>> arp_request(std::unordered_map<std::string, std::vector<IPNetwork>> msg_data, int interface) {
-        std::unordered_map<std::string, std::vector<IPNetwork>> ret;
         std::cout << "ARP Request Sent By Device " << id << std::endl;
-        int i = connected_to_interface[interface];
-        ret = i.arp_res(msg_data, *this);
-        msg_data["header_2"].push_back(ret["address"]);
-        std::cout << msg_data << std::endl;
+        Router* neighbour = connected_to_interface[interface];
+        if (neighbour == nullptr) {
+            std::cout << "Nothing connected to interface " << interface << std::endl;
+            return msg_data;
+        }
+        std::unordered_map<std::string, std::vector<IPNetwork>> ret = neighbour->arp_res(msg_data, *this);
+        if (!ret["address"].empty()) {
+            msg_data["header_2"].push_back(ret["address"].front());
+        }
         return msg_data;
     }
 
@@ -84,9 +94,9 @@ public:
                         msg_data = arp_request(msg_data, entry.second[2]);
                         stored_arp[msg_data["header_3"][1]] = msg_data["header_2"][1];
                         stored_arp[msg_data["header_3"][0]] = msg_data["header_2"][0];
-                        return connected_to_interface[entry.second[2]].reply(msg_data, *this, ack_msg);
+                        return connected_to_interface[entry.second[2]]->reply(msg_data, *this, ack_msg);
                     }
-                    return connected_to_interface[entry.second.back()].reply(msg_data, *this, ack_msg);
+                    return connected_to_interface[entry.second.back()]->reply(msg_data, *this, ack_msg);
                 }
             }
         }
@@ -2,11 +2,33 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <set>
 #include <algorithm>
 #include <iterator>
 #include <random>
 #include <chrono>
 #include <thread>
+#include <queue>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <memory>
+#include <map>
+#include <cstdint>
+#include <tuple>
+#include <cstdio>
+#include <iomanip>
+#include <bitset>
+#include <deque>
+#include <cstring>
+#include <atomic>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
 
 using namespace std;
 
@@ -21,655 +43,8781 @@ class FlowControlProtocol;
 class AccessControlProtocol;
 class ApplicationLayer;
 
-class Network {
+typedef long long SimTime; // Virtual time in nanoseconds
+
+const SimTime MICROSECOND = 1000;
+const SimTime MILLISECOND = 1000 * MICROSECOND;
+const SimTime SECOND = 1000 * MILLISECOND;
+
+// Discrete event scheduler that drives the simulation in virtual time
+class EventScheduler {
 private:
-    string network_ip;
-    int next_subnet;
+    struct Event {
+        SimTime time;
+        long long seq; // Keeps events at the same time in FIFO order
+        function<void()> action;
+    };
+
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.time > b.time || (a.time == b.time && a.seq > b.seq);
+        }
+    };
+
+    priority_queue<Event, vector<Event>, Later> events;
+    SimTime current_time;
+    long long next_seq;
 
 public:
-    Network(string ip) {
-        network_ip = ip;
-        next_subnet = 0;
+    EventScheduler() {
+        current_time = 0;
+        next_seq = 0;
     }
 
-    string assignIPAddress() {
-        string subnet = to_string(next_subnet++);
-        return network_ip + "." + subnet;
+    SimTime now() const {
+        return current_time;
     }
-};
-
-class RoutingTable {
-private:
-    unordered_map<string, string> staticRoutes; // Destination IP -> Next hop IP
-    unordered_map<string, string> dynamicRoutes; // Destination IP -> Next hop IP
 
-public:
-    void addStaticRoute(const string& destinationIP, const string& nextHopIP) {
-        staticRoutes[destinationIP] = nextHopIP;
+    void schedule(SimTime delay, function<void()> action) {
+        scheduleAt(current_time + delay, action);
     }
 
-    void addDynamicRoute(const string& destinationIP, const string& nextHopIP) {
-        dynamicRoutes[destinationIP] = nextHopIP;
+    void scheduleAt(SimTime time, function<void()> action) {
+        events.push({max(time, current_time), next_seq++, action});
     }
 
-    string getNextHop(const string& destinationIP) {
-        if (staticRoutes.count(destinationIP) > 0) {
-            return staticRoutes[destinationIP];
+    // Runs every event due at or before the given time, then parks the clock there
+    void runUntil(SimTime time) {
+        while (!events.empty() && events.top().time <= time) {
+            Event event = events.top();
+            events.pop();
+            current_time = event.time;
+            event.action();
         }
-        if (dynamicRoutes.count(destinationIP) > 0) {
-            return dynamicRoutes[destinationIP];
+        current_time = max(current_time, time);
+    }
+
+    void run() {
+        while (!events.empty()) {
+            Event event = events.top();
+            events.pop();
+            current_time = event.time;
+            event.action();
         }
-        return "";
     }
 
-    void printRoutingTable() {
-        cout << "Routing Table: " << endl;
-        cout << "Destination IP\tNext Hop IP" << endl;
-        for (const auto& route : staticRoutes) {
-            cout << route.first << "\t\t" << route.second << " (Static)" << endl;
+    bool empty() const {
+        return events.empty();
+    }
+
+    void reset() {
+        events = priority_queue<Event, vector<Event>, Later>();
+        current_time = 0;
+        next_seq = 0;
+    }
+};
+
+EventScheduler simulator; // Shared virtual clock for every device in the simulation
+
+const SimTime LINK_DELAY = 1 * MICROSECOND; // Propagation delay of every simulated cable
+const SimTime LACP_TIMEOUT = 3 * SECOND;    // Three missed fast-rate LACPDUs take a member out of its aggregate
+const long long DEFAULT_PORT_SPEED = 1000000000LL; // 1 Gb/s
+const int ETHERNET_WIRE_OVERHEAD = 20;     // Preamble, start delimiter and inter-frame gap, in bytes
+
+const int ETHERNET_PREAMBLE = 8;           // Preamble and start delimiter, ahead of the header
+const int ETHERNET_HEADER = 14;            // Destination, source and EtherType
+
+// Time to clock a frame of the given size onto a link
+SimTime serializationTime(long long bytes, long long bits_per_second) {
+    return (bytes + ETHERNET_WIRE_OVERHEAD) * 8 * SECOND / bits_per_second;
+}
+
+// Ethernet FCS: CRC-32 with the reflected polynomial 0xEDB88320. The portable path uses
+// slice-by-8 tables, eight bytes per step. On CPUs with carry-less multiply the bulk of a
+// frame is folded 64 bytes at a time with PCLMULQDQ instead; SSE4.2's CRC32 instruction
+// computes the Castagnoli polynomial, not Ethernet's, so it can't be used here.
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            table[0][i] = crc;
         }
-        for (const auto& route : dynamicRoutes) {
-            cout << route.first << "\t\t" << route.second << " (Dynamic)" << endl;
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int slice = 1; slice < 8; slice++) {
+                table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+            }
         }
     }
 };
 
-class RoutingProtocol {
-public:
-    virtual void updateRoutingTable(const unordered_map<string, string>& routingTable) = 0;
-};
+const Crc32Tables crc32_tables;
 
-class RIP : public RoutingProtocol {
-private:
-    RoutingTable* routingTable; // Pointer to the routing table
+// All crc32* functions take and return the running register, i.e. without the final inversion
+uint32_t crc32Bytewise(uint32_t crc, const uint8_t* data, size_t length) {
+    const uint32_t (&table)[8][256] = crc32_tables.table;
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ table[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
 
-public:
-    RIP(RoutingTable* rt) {
-        routingTable = rt;
+uint32_t crc32SliceBy8(uint32_t crc, const uint8_t* data, size_t length) {
+    const uint32_t (&table)[8][256] = crc32_tables.table;
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc; // Little-endian host assumed, like the rest of the simulator
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    return crc32Bytewise(crc, data, length);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_CLMUL 1
+// Folding constants for the reflected polynomial (Gopal et al., "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ", Intel 2009). Needs at least 64 bytes.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32Clmul(uint32_t crc, const uint8_t* data, size_t length) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    size_t tail = length & 15;
+    length -= tail;
+
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)data), _mm_cvtsi32_si128(crc));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+    data += 64;
+    length -= 64;
+    while (length >= 64) { // Four independent lanes, 64 bytes per step
+        __m128i y1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        __m128i y2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        __m128i y3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        __m128i y4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), y1), _mm_loadu_si128((const __m128i*)data));
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), y2), _mm_loadu_si128((const __m128i*)(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), y3), _mm_loadu_si128((const __m128i*)(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), y4), _mm_loadu_si128((const __m128i*)(data + 48)));
+        data += 64;
+        length -= 64;
+    }
+    // Fold the lanes, then any remaining 16-byte blocks, into one 128-bit value
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x2);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x3);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x4);
+    while (length >= 16) {
+        __m128i next = _mm_loadu_si128((const __m128i*)data);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), next);
+        data += 16;
+        length -= 16;
+    }
+    // 128 -> 64 bits, then Barrett reduction to 32
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00), x2);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return crc32SliceBy8((uint32_t)_mm_extract_epi32(x1, 1), data, tail);
+}
+#endif
+
+// Picks the fastest implementation the CPU supports, once
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+#ifdef CRC32_HAVE_CLMUL
+    static const bool clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (clmul && length >= 64) {
+        return crc32Clmul(crc, data, length);
     }
+#endif
+    return crc32SliceBy8(crc, data, length);
+}
 
-    void updateRoutingTable(const unordered_map<string, string>& routingTable) override {
-        for (const auto& route : routingTable) {
-            this->routingTable->addDynamicRoute(route.first, route.second);
+uint32_t crc32(const void* data, size_t length) {
+    return ~crc32Update(0xFFFFFFFFu, (const uint8_t*)data, length);
+}
+
+bool verbose = true; // Large studies turn this off to silence per-device connect/disconnect logs
+
+const string BROADCAST_MAC = "FF:FF:FF:FF:FF:FF";
+const int ETHERTYPE_IPV4 = 0x0800;
+const int ETHERTYPE_ARP = 0x0806;
+const int ARP_REQUEST = 1;
+const int ARP_REPLY = 2;
+const uint8_t IP_PROTO_TCP = 6;
+const uint8_t IP_PROTO_UDP = 17;
+
+const uint64_t BROADCAST_KEY = 0xFFFFFFFFFFFFULL;
+
+// IEEE 802.1Q: 12-bit VLAN IDs, 0 and 4095 reserved, ports default to VLAN 1
+const int VLAN_ID_COUNT = 4096;
+const uint16_t DEFAULT_VLAN = 1;
+
+// Packs "AA:BB:CC:DD:EE:FF" into the low 48 bits of an integer for table lookups
+uint64_t macKey(const string& mac) {
+    uint64_t key = 0;
+    for (char c : mac) {
+        if (c >= '0' && c <= '9') {
+            key = (key << 4) | (uint64_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            key = (key << 4) | (uint64_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            key = (key << 4) | (uint64_t)(c - 'A' + 10);
         }
     }
-};
-
-class OSPF : public RoutingProtocol {
-private:
-    RoutingTable* routingTable; // Pointer to the routing table
+    return key & 0xFFFFFFFFFFFFULL;
+}
 
-public:
-    OSPF(RoutingTable* rt) {
-        routingTable = rt;
+// Rapid Spanning Tree (IEEE 802.1w). BPDUs go to a link-local group address that bridges never forward.
+const string STP_MULTICAST_MAC = "01:80:C2:00:00:00";
+const uint64_t STP_MULTICAST_KEY = 0x0180C2000000ULL;
+const uint16_t STP_DEFAULT_PRIORITY = 32768;
+const uint32_t STP_DEFAULT_PATH_COST = 20000; // 1 Gb/s
+const SimTime STP_HELLO_TIME = 2 * SECOND;
+const SimTime STP_FORWARD_DELAY = 15 * SECOND;
+const int BPDU_PROPOSAL = 1;
+const int BPDU_AGREEMENT = 2;
+const int BPDU_TOPOLOGY_CHANGE = 4;
+const int BPDU_ROLE_DESIGNATED = 8; // Sent by a designated port; only these carry port priority information
+
+enum StpPortRole { STP_ROLE_DISABLED, STP_ROLE_ROOT, STP_ROLE_DESIGNATED, STP_ROLE_ALTERNATE, STP_ROLE_BACKUP };
+
+// Spanning tree priority vector; compared field by field, smaller is better
+struct PriorityVector {
+    uint64_t root_id = ~0ULL;
+    uint32_t root_path_cost = 0;
+    uint64_t bridge_id = ~0ULL;   // Designated bridge
+    uint16_t port_id = 0xFFFF;    // Designated port on that bridge
+
+    bool operator<(const PriorityVector& other) const {
+        return tie(root_id, root_path_cost, bridge_id, port_id) <
+               tie(other.root_id, other.root_path_cost, other.bridge_id, other.port_id);
     }
 
-    void updateRoutingTable(const unordered_map<string, string>& routingTable) override {
-        this->routingTable->addDynamicRoute(routingTable.begin()->first, routingTable.begin()->second);
+    bool operator==(const PriorityVector& other) const {
+        return !(*this < other) && !(other < *this);
     }
 };
 
-class EndDevice{
-    
-private:
-    int device_id;
-    string device_name;
-    string ip_address;
-    string mac_address;
-protected:
-    string subnet_mask;
-    Network* network;
-    int connecting_device_id;
-    string connecting_device_name;
-    
+struct Bpdu {
+    PriorityVector priority;
+    int flags = 0; // BPDU_* bits
+};
+
+// Ethernet frame as carried through Hubs and Switches
+struct Frame {
+    string src_mac;
+    string dst_mac;
+    uint64_t src_key = 0; // Packed MACs filled in by the sender so switches never parse strings
+    uint64_t dst_key = 0;
+    uint16_t vlan_id = 0; // 802.1Q tag; 0 means untagged
+    int ether_type = ETHERTYPE_IPV4;
+    int arp_op = 0;       // ARP_REQUEST or ARP_REPLY for ARP frames
+    string sender_ip;     // ARP sender / IPv4 source
+    string target_ip;     // ARP target / IPv4 destination
+    uint8_t ttl = 64;        // IPv4 time to live; each router hop takes one off
+    uint8_t ip_protocol = 0; // IPv4 protocol and transport ports, for access lists
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    string payload;
+    SimTime created_at = 0; // When the packet was handed to the sender, for latency accounting
+    Bpdu bpdu;              // Only for frames to STP_MULTICAST_MAC
+    uint32_t fcs = 0;        // Frame check sequence, filled in by the sending NIC
+};
+
+// Size on the wire: Ethernet header and FCS, an optional 802.1Q tag, and the ARP or IPv4 packet padded to 46 bytes
+int frameBytes(const Frame& frame) {
+    int packet = frame.ether_type == ETHERTYPE_ARP ? 28 : 20 + (int)frame.payload.size();
+    return 18 + (frame.vlan_id != 0 ? 4 : 0) + max(packet, 46);
+}
 
+// How a device treats the segments it joins. A repeater (hub) shares one medium across all
+// its cables; a bridge (switch) gives each cable its own collision domain but floods
+// broadcasts between them; a router ends both. A host never joins its cables together.
+enum DomainRole { DOMAIN_HOST, DOMAIN_REPEATER, DOMAIN_BRIDGE, DOMAIN_ROUTER };
+
+// Live count of collision and broadcast domains, kept by union-find over the cables. Every
+// cable is an element; a device joins its cables' elements when its role carries that kind of
+// domain across, and a domain is a set holding at least one cable. Connecting costs O(α(N)).
+// Union-find can't split, so each kind also keeps a spanning forest: a cable that first joins
+// two devices' domains is a tree cable. Removing any other cable, or one whose end has no other
+// cable in the domain, just leaves a tombstone. Removing a tree cable walks both halves of its
+// tree in lockstep, so the work is bounded by the cables of the smaller half, and then either
+// promotes a cable that still bridges the halves or moves the smaller half into a set of its own.
+class DomainTracker {
 public:
-    EndDevice(int con_id, string con_name,  int id, string name, Network* net, string mac, string mask) {
-        
-        connecting_device_id = con_id;
-        connecting_device_name = con_name;
-        device_id = id;
-        device_name = name;
-        network = net;
-        ip_address = network->assignIPAddress();
-        mac_address = mac;
-        subnet_mask = mask;
+    enum Kind { COLLISION = 0, BROADCAST = 1 };
+
+    DomainTracker() {
+        live_links = 0;
+        rebuilds = 0;
+        splits = 0;
+        replacements = 0;
+        search_steps = 0;
+        stamp_clock = 0;
     }
 
-    int getconnectingDeviceID(){
-        return connecting_device_id;
+    void connect(const void* a, DomainRole a_role, const void* b, DomainRole b_role) {
+        if (a == b) {
+            return;
+        }
+        uint32_t id;
+        if (!free_links.empty()) {
+            id = free_links.back();
+            free_links.pop_back();
+        } else {
+            id = links.size();
+            links.emplace_back();
+        }
+        Link& link = links[id];
+        link.alive = true;
+        link.ends[0] = a;
+        link.ends[1] = b;
+        live_links++;
+        Node* ends[2] = {&node(a, a_role), &node(b, b_role)};
+        link.nodes[0] = ends[0];
+        link.nodes[1] = ends[1];
+        for (int side = 0; side < 2; side++) {
+            link.slot[side] = ends[side]->links.size();
+            ends[side]->links.push_back(id);
+        }
+        for (int kind = 0; kind < 2; kind++) {
+            attach(kind, link);
+            maybeCompact(kind);
+        }
     }
 
-    string getconnectingDeviceName(){
-        return connecting_device_name;
+    // Removes one cable between a and b, if there is one
+    void disconnect(const void* a, const void* b) {
+        auto na = nodes.find(a);
+        auto nb = nodes.find(b);
+        if (a == b || na == nodes.end() || nb == nodes.end()) {
+            return;
+        }
+        // Scan whichever end has fewer cables; for a host that's its only one
+        bool from_a = na->second.links.size() <= nb->second.links.size();
+        const void* other = from_a ? b : a;
+        for (uint32_t id : (from_a ? na : nb)->second.links) {
+            if (links[id].ends[0] == other || links[id].ends[1] == other) {
+                removeLink(id);
+                return;
+            }
+        }
     }
 
-    int getDeviceId() {
-        return device_id;
+    // Drops every cable of a device that is going away
+    void removeNode(const void* device) {
+        auto it = nodes.find(device);
+        if (it == nodes.end()) {
+            return;
+        }
+        while (!it->second.links.empty()) {
+            removeLink(it->second.links.back());
+        }
+        nodes.erase(it);
     }
 
-    string getDeviceName() {
-        return device_name;
+    size_t count(Kind kind) const {
+        return sets[kind].domains;
     }
 
-    string getIpAddress() {
-        return ip_address;
+    size_t collisionDomains() const {
+        return count(COLLISION);
     }
 
-    string getMacAddress() {
-        return mac_address;
+    size_t broadcastDomains() const {
+        return count(BROADCAST);
     }
 
-    string getSubnetMask(){
-        return subnet_mask;
+    size_t getLinkCount() const {
+        return live_links;
     }
 
-    void connect() {
-        cout << device_name << " connected" << endl;
+    long long getRebuilds() const {
+        return rebuilds;
     }
 
-    void disconnect() {
-        cout << device_name << " disconnected" << endl;
+    long long getSplits() const {
+        return splits;
     }
- 
-    
-};
 
-class Hub : public EndDevice {
-private:
-    int hub_id;
-    string hub_name;
-    vector<EndDevice*> connected_devices;
-    vector<Hub*> connected_hubs;
+    long long getReplacements() const {
+        return replacements;
+    }
 
-public:
-    Hub(int id, string name, int device_id, string device_name, string ip_address, string mac_address, Network* net)
-        : EndDevice(connecting_device_id, connecting_device_name, device_id, device_name, net, mac_address, subnet_mask) {
-        hub_id = id;
-        hub_name = name;
-        network = net;
+    long long getSearchSteps() const {
+        return search_steps;
     }
 
-    int getHubId() {
-        return hub_id;
+private:
+    struct DisjointSets {
+        vector<uint32_t> parent;
+        vector<uint8_t> rank;
+        vector<uint32_t> cables; // Live cables in the set, valid at roots
+        size_t domains = 0;      // Sets with at least one live cable
+
+        uint32_t add(uint32_t cable_count) {
+            uint32_t element = parent.size();
+            parent.push_back(element);
+            rank.push_back(0);
+            cables.push_back(cable_count);
+            domains += cable_count > 0;
+            return element;
+        }
+
+        uint32_t find(uint32_t element) {
+            while (parent[element] != element) {
+                parent[element] = parent[parent[element]]; // Path halving
+                element = parent[element];
+            }
+            return element;
+        }
+
+        void unite(uint32_t a, uint32_t b) {
+            a = find(a);
+            b = find(b);
+            if (a == b) {
+                return;
+            }
+            if (cables[a] > 0 && cables[b] > 0) {
+                domains--;
+            }
+            if (rank[a] < rank[b]) {
+                swap(a, b);
+            }
+            parent[b] = a;
+            cables[a] += cables[b];
+            rank[a] += rank[a] == rank[b];
+        }
+
+        void clear() {
+            parent.clear();
+            rank.clear();
+            cables.clear();
+            domains = 0;
+        }
+    };
+
+    struct Node {
+        DomainRole role;
+        vector<uint32_t> links;          // Cable ids
+        uint32_t element[2];             // Per kind, UINT32_MAX while the node joins no cable
+        uint32_t joined[2];              // Cables joined per kind
+        uint64_t stamp;                  // Last tree walk that reached the node
+    };
+
+    struct Link {
+        const void* ends[2];
+        Node* nodes[2];                  // Map entries are stable while the cable is live
+        uint32_t slot[2];                // Position in each end's links, for O(1) removal
+        uint32_t element[2];
+        bool tree[2];                    // Per kind, part of the spanning forest
+        bool alive = false;
+    };
+
+    // Breadth-first walk over one kind's tree cables, advanced a cable at a time
+    struct Walk {
+        vector<Node*> reached;
+        size_t next;                     // Node whose cables are being scanned
+        size_t edge;                     // Position in that node's cables
+        uint64_t stamp;
+    };
+
+    unordered_map<const void*, Node> nodes;
+    vector<Link> links;
+    vector<uint32_t> free_links;
+    size_t live_links;
+    long long rebuilds;
+    long long splits;
+    long long replacements;
+    long long search_steps;               // Cables looked at while handling tree cable removals
+    uint64_t stamp_clock;
+    Walk walks[2];
+    DisjointSets sets[2];
+
+    static bool joins(int kind, DomainRole role) {
+        return role == DOMAIN_REPEATER || (kind == BROADCAST && role == DOMAIN_BRIDGE);
     }
 
-    string getHubName() {
-        return hub_name;
+    Node& node(const void* device, DomainRole role) {
+        auto inserted = nodes.emplace(device, Node());
+        Node& entry = inserted.first->second;
+        if (inserted.second) {
+            entry.role = role;
+            entry.element[0] = entry.element[1] = UINT32_MAX;
+            entry.joined[0] = entry.joined[1] = 0;
+            entry.stamp = 0;
+        }
+        return entry;
     }
 
-    vector<EndDevice*> getConnectedDevices() {
-        return connected_devices;
+    void attach(int kind, Link& link) {
+        DisjointSets& set = sets[kind];
+        Node& a = *link.nodes[0];
+        Node& b = *link.nodes[1];
+        // A cable is a tree cable when it is the first to join its ends' domains
+        link.tree[kind] = joins(kind, a.role) && joins(kind, b.role) &&
+                          (a.element[kind] == UINT32_MAX || b.element[kind] == UINT32_MAX ||
+                           set.find(a.element[kind]) != set.find(b.element[kind]));
+        link.element[kind] = set.add(1);
+        join(kind, a, link.element[kind]);
+        join(kind, b, link.element[kind]);
     }
 
-    vector<Hub*> getConnectedHubs() {
-        return connected_hubs;
+    void join(int kind, Node& end, uint32_t element) {
+        if (!joins(kind, end.role)) {
+            return;
+        }
+        if (end.element[kind] == UINT32_MAX) {
+            end.element[kind] = sets[kind].add(0);
+        }
+        sets[kind].unite(end.element[kind], element);
+        end.joined[kind]++;
     }
 
-    void connectDevice(EndDevice* device) {
-        connected_devices.push_back(device);
-        device->connect();
+    void removeLink(uint32_t id) {
+        Link& link = links[id];
+        for (int side = 0; side < 2; side++) {
+            vector<uint32_t>& adjacent = link.nodes[side]->links;
+            uint32_t slot = link.slot[side];
+            uint32_t moved = adjacent.back();
+            adjacent[slot] = moved;
+            adjacent.pop_back();
+            if (moved != id) {
+                Link& other = links[moved];
+                other.slot[other.nodes[0] == link.nodes[side] && other.slot[0] == adjacent.size() ? 0 : 1] = slot;
+            }
+        }
+        for (int kind = 0; kind < 2; kind++) {
+            DisjointSets& set = sets[kind];
+            uint32_t root = set.find(link.element[kind]);
+            if (--set.cables[root] == 0) {
+                set.domains--;
+            }
+            int still_joined = 0;
+            for (Node* end : link.nodes) {
+                Node& n = *end;
+                if (!joins(kind, n.role)) {
+                    continue;
+                }
+                if (--n.joined[kind] == 0) {
+                    n.element[kind] = UINT32_MAX; // Starts afresh if it is cabled again
+                } else {
+                    still_joined++;
+                }
+            }
+            if (still_joined == 2 && link.tree[kind]) {
+                split(kind, *link.nodes[0], *link.nodes[1], root);
+            }
+        }
+        link.alive = false;
+        free_links.push_back(id);
+        live_links--;
     }
 
-    void disconnectDevice(EndDevice* device) {
-        connected_devices.erase(remove(connected_devices.begin(), connected_devices.end(), device), connected_devices.end());
-        device->disconnect();
+    // Scans one more cable of the walk; false once it has covered its whole tree
+    bool step(int kind, Walk& walk) {
+        while (walk.next < walk.reached.size()) {
+            Node* n = walk.reached[walk.next];
+            if (walk.edge == n->links.size()) {
+                walk.next++;
+                walk.edge = 0;
+                continue;
+            }
+            Link& link = links[n->links[walk.edge++]];
+            search_steps++;
+            Node* other = link.nodes[link.nodes[0] == n ? 1 : 0];
+            if (link.tree[kind] && other->stamp != walk.stamp) {
+                other->stamp = walk.stamp;
+                walk.reached.push_back(other);
+            }
+            return true;
+        }
+        return false;
     }
 
-    void connectHub(Hub* hub) {
-        connected_hubs.push_back(hub);
-        hub->connectDevice(this);
-        connect();
+    // A tree cable between a and b is gone and both still have other cables in the domain
+    void split(int kind, Node& a, Node& b, uint32_t root) {
+        Node* starts[2] = {&a, &b};
+        for (int side = 0; side < 2; side++) {
+            Walk& walk = walks[side];
+            walk.reached.assign(1, starts[side]);
+            walk.next = walk.edge = 0;
+            walk.stamp = ++stamp_clock;
+            starts[side]->stamp = walk.stamp;
+        }
+        int side = 0;
+        while (step(kind, walks[side])) {
+            side ^= 1;
+        }
+        const Walk& smaller = walks[side];
+        // Any cable from the smaller half to another device in the domain still bridges the halves
+        for (Node* n : smaller.reached) {
+            for (uint32_t id : n->links) {
+                Link& link = links[id];
+                Node* other = link.nodes[link.nodes[0] == n ? 1 : 0];
+                search_steps++;
+                if (joins(kind, other->role) && other->stamp != smaller.stamp) {
+                    link.tree[kind] = true;
+                    replacements++;
+                    return;
+                }
+            }
+        }
+        // None does: the smaller half moves to a fresh element, taking its cables along
+        DisjointSets& set = sets[kind];
+        uint32_t element = set.add(0);
+        uint32_t moved = 0;
+        for (Node* n : smaller.reached) {
+            n->element[kind] = element;
+            for (uint32_t id : n->links) {
+                Link& link = links[id];
+                link.element[kind] = element;
+                moved += link.nodes[0] == n || link.nodes[0]->stamp != smaller.stamp; // Count inner cables once
+            }
+        }
+        bool had_cables = set.cables[root] > 0;
+        set.cables[root] -= moved;
+        set.cables[element] = moved;
+        set.domains += (set.cables[root] > 0) + (moved > 0) - had_cables;
+        splits++;
     }
 
-    void disconnectHub(Hub* hub) {
-        auto it = find(connected_hubs.begin(), connected_hubs.end(), hub);
-        if (it != connected_hubs.end()) {
-            connected_hubs.erase(it);
-            hub->disconnectDevice(this);
-            disconnect();
+    // Tombstones pile up with churn; rebuilding once they outnumber live elements keeps
+    // connects amortised O(α(N))
+    void maybeCompact(int kind) {
+        if (sets[kind].parent.size() > 4 * (live_links + nodes.size()) + 1024) {
+            rebuild(kind);
         }
     }
 
-    void printConnectedHubs(){
-        cout << "Connected Hubs for " << getDeviceName() << ": " << endl;
-        for (const auto& hub : connected_hubs) {
-            cout << hub->getHubName() << endl;
+    void rebuild(int kind) {
+        DisjointSets& set = sets[kind];
+        set.clear();
+        rebuilds++;
+        for (Link& link : links) { // Every live node has a live cable
+            for (Node* end : link.nodes) {
+                if (link.alive) {
+                    end->element[kind] = UINT32_MAX;
+                    end->joined[kind] = 0;
+                }
+            }
+        }
+        for (Link& link : links) {
+            if (link.alive) {
+                attach(kind, link);
+            }
         }
     }
 };
 
-class Router : public EndDevice {
-private:
-    int router_id;
-    string router_name;
-    vector<EndDevice*> connected_devices;
-    vector<Hub*> connected_hubs;
-    RoutingTable routingTable; // Add an instance of the RoutingTable class
-    Network* network;
-    vector<Router*> connected_routers;
-    RoutingProtocol* routingProtocol;
-    
+DomainTracker domains; // Every cable plugged in anywhere in the simulation
 
-    public:
-    string subnetMask;
+// When a switch may start sending a frame: once all of it is in and its FCS checked, or as
+// soon as the header is in, which saves a frame time per hop but passes corrupt frames on
+enum ForwardingMode { FORWARD_STORE_AND_FORWARD, FORWARD_CUT_THROUGH };
 
-    Router(int id, string name, int device_id, string device_name, string ip_address, string mac_address, string subnetMask )
-        : EndDevice(connecting_device_id, connecting_device_name, device_id, device_name, network, mac_address, subnet_mask){
-        
-        router_id = id;
-        router_name = name; 
+// Anything that can receive frames from a cable
+class Layer2Device {
+public:
+    virtual void receiveFrame(const Frame& frame, Layer2Device* from) = 0;
+    virtual ~Layer2Device() {
+        domains.removeNode(this);
     }
 
-    int getRouterId() {
-        return router_id;
+    virtual DomainRole domainRole() const {
+        return DOMAIN_HOST;
     }
 
-    string getRouterName() {
-        return router_name;
+    // A shared-medium segment takes frames straight from an attached station's MAC and decides
+    // when they reach the wire. Point-to-point links decline and the station sends at once.
+    virtual bool acceptFromStation(Layer2Device*, const Frame&) {
+        return false;
     }
 
-    vector<EndDevice*> getConnectedDevices() {
-        return connected_devices;
+    // Puts a frame on the cable towards a neighbouring device
+    void transmitFrame(Layer2Device* to, const Frame& frame) {
+        transmitFrame(to, frame, LINK_DELAY);
     }
 
-    vector<Hub*> getConnectedHubs() {
-        return connected_hubs;
+    // Same, arriving after the given delay (serialisation plus propagation)
+    void transmitFrame(Layer2Device* to, const Frame& frame, SimTime delay) {
+        simulator.schedule(delay, [this, to, frame]() { to->receiveFrame(frame, this); });
     }
+};
 
-    void addStaticRoute(const string& destinationIP, const string& nextHopIP) {
-        routingTable.addStaticRoute(destinationIP, nextHopIP);
+// Fixed-capacity MAC forwarding database keyed by packed 48-bit MACs. Open addressing over
+// groups of 16 slots with one control byte per slot (Swiss-table layout): a full slot's
+// control byte holds 7 bits of the key's hash, so a whole group is matched with a single
+// SSE2 compare. When the table is full the least recently used unpinned entry is evicted.
+template <typename Value>
+class MacForwardingTable {
+private:
+    static constexpr int8_t EMPTY = -128;  // 0x80
+    static constexpr int8_t DELETED = -2;  // 0xFE; a full slot is 0..127, so "free" is the high bit
+    static constexpr uint32_t NIL = 0xFFFFFFFF;
+    static constexpr size_t GROUP_SIZE = 16;
+
+    vector<int8_t> ctrl;
+    vector<uint64_t> keys;
+    vector<Value> values;
+    vector<uint8_t> pinned;
+    vector<uint32_t> lru_prev; // Intrusive LRU list over unpinned slots, head = most recent
+    vector<uint32_t> lru_next;
+    uint32_t lru_head;
+    uint32_t lru_tail;
+    size_t group_mask;
+    size_t max_entries;
+    size_t count;
+    size_t tombstones;
+    long long eviction_count;
+
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
     }
 
-    void addDynamicRoute(const string& destinationIP, const string& nextHopIP) {
-        routingTable.addDynamicRoute(destinationIP, nextHopIP);
+    uint32_t matchTag(size_t group, int8_t tag) const {
+        const int8_t* bytes = &ctrl[group * GROUP_SIZE];
+#ifdef __SSE2__
+        __m128i block = _mm_loadu_si128((const __m128i*)bytes);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(tag)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++) {
+            mask |= (uint32_t)(bytes[i] == tag) << i;
+        }
+        return mask;
+#endif
     }
 
-    string getNextHop(const string& destinationIP) {
-        return routingTable.getNextHop(destinationIP);
+    uint32_t matchFree(size_t group) const {
+        const int8_t* bytes = &ctrl[group * GROUP_SIZE];
+#ifdef __SSE2__
+        return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)bytes));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; i++) {
+            mask |= (uint32_t)(bytes[i] < 0) << i;
+        }
+        return mask;
+#endif
     }
 
-    void connectDevice(EndDevice* device) {
-        connected_devices.push_back(device);
-        device->connect();
+    static int lowestBit(uint32_t mask) {
+        return __builtin_ctz(mask);
     }
 
-    void disconnectDevice(EndDevice* device) {
-        connected_devices.erase(remove(connected_devices.begin(), connected_devices.end(), device), connected_devices.end());
-        device->disconnect();
+    uint32_t findSlot(uint64_t key) const {
+        uint64_t h = hash(key);
+        int8_t tag = (int8_t)(h & 0x7F);
+        size_t group = (h >> 7) & group_mask;
+        for (size_t probe = 1; probe <= group_mask + 1; probe++) {
+            for (uint32_t mask = matchTag(group, tag); mask != 0; mask &= mask - 1) {
+                uint32_t slot = group * GROUP_SIZE + lowestBit(mask);
+                if (keys[slot] == key) {
+                    return slot;
+                }
+            }
+            if (matchTag(group, EMPTY) != 0) {
+                return NIL;
+            }
+            group = (group + probe) & group_mask; // Triangular probing visits every group
+        }
+        return NIL;
+    }
+
+    void lruUnlink(uint32_t slot) {
+        if (lru_prev[slot] != NIL) {
+            lru_next[lru_prev[slot]] = lru_next[slot];
+        } else {
+            lru_head = lru_next[slot];
+        }
+        if (lru_next[slot] != NIL) {
+            lru_prev[lru_next[slot]] = lru_prev[slot];
+        } else {
+            lru_tail = lru_prev[slot];
+        }
+    }
+
+    void lruPushFront(uint32_t slot) {
+        lru_prev[slot] = NIL;
+        lru_next[slot] = lru_head;
+        if (lru_head != NIL) {
+            lru_prev[lru_head] = slot;
+        }
+        lru_head = slot;
+        if (lru_tail == NIL) {
+            lru_tail = slot;
+        }
+    }
+
+    void eraseSlot(uint32_t slot) {
+        if (!pinned[slot]) {
+            lruUnlink(slot);
+        }
+        // A group that still has an empty slot never made a probe continue past it,
+        // so the slot can go straight back to EMPTY instead of leaving a tombstone
+        size_t group = slot / GROUP_SIZE;
+        if (matchTag(group, EMPTY) != 0) {
+            ctrl[slot] = EMPTY;
+        } else {
+            ctrl[slot] = DELETED;
+            tombstones++;
+        }
+        count--;
+    }
+
+    void placeNew(uint64_t key, const Value& value, bool pin) {
+        uint64_t h = hash(key);
+        size_t group = (h >> 7) & group_mask;
+        for (size_t probe = 1;; probe++) {
+            uint32_t mask = matchFree(group);
+            if (mask != 0) {
+                uint32_t slot = group * GROUP_SIZE + lowestBit(mask);
+                if (ctrl[slot] == DELETED) {
+                    tombstones--;
+                }
+                ctrl[slot] = (int8_t)(h & 0x7F);
+                keys[slot] = key;
+                values[slot] = value;
+                pinned[slot] = pin;
+                if (!pin) {
+                    lruPushFront(slot);
+                }
+                count++;
+                return;
+            }
+            group = (group + probe) & group_mask;
+        }
+    }
+
+    // Rebuilds the table in place to clear tombstones, keeping LRU order
+    void rehash() {
+        vector<uint32_t> order;
+        for (uint32_t slot = lru_tail; slot != NIL; slot = lru_prev[slot]) {
+            order.push_back(slot);
+        }
+        vector<tuple<uint64_t, Value, bool>> live;
+        for (uint32_t slot = 0; slot < ctrl.size(); slot++) {
+            if (ctrl[slot] >= 0 && pinned[slot]) {
+                live.emplace_back(keys[slot], values[slot], true);
+            }
+        }
+        for (uint32_t slot : order) {
+            live.emplace_back(keys[slot], values[slot], false);
+        }
+        fill(ctrl.begin(), ctrl.end(), EMPTY);
+        lru_head = lru_tail = NIL;
+        count = 0;
+        tombstones = 0;
+        for (const auto& entry : live) {
+            placeNew(get<0>(entry), get<1>(entry), get<2>(entry));
+        }
+    }
+
+public:
+    explicit MacForwardingTable(size_t capacity = 8192) {
+        max_entries = max(capacity, (size_t)1);
+        size_t groups = 1;
+        while (groups * GROUP_SIZE * 7 < max_entries * 8) { // Keep load at or below 7/8
+            groups *= 2;
+        }
+        group_mask = groups - 1;
+        size_t slots = groups * GROUP_SIZE;
+        ctrl.assign(slots, EMPTY);
+        keys.assign(slots, 0);
+        values.assign(slots, Value());
+        pinned.assign(slots, 0);
+        lru_prev.assign(slots, NIL);
+        lru_next.assign(slots, NIL);
+        lru_head = lru_tail = NIL;
+        count = 0;
+        tombstones = 0;
+        eviction_count = 0;
+    }
+
+    // Pointer to the entry's value (nullptr if absent); a hit refreshes its LRU position
+    Value* find(uint64_t key) {
+        uint32_t slot = findSlot(key);
+        if (slot == NIL) {
+            return nullptr;
+        }
+        if (!pinned[slot] && lru_head != slot) {
+            lruUnlink(slot);
+            lruPushFront(slot);
+        }
+        return &values[slot];
+    }
+
+    // Inserts or overwrites. Pinned entries are never evicted. Returns false only when
+    // the table is full of pinned entries.
+    bool insert(uint64_t key, const Value& value, bool pin = false) {
+        uint32_t slot = findSlot(key);
+        if (slot != NIL) {
+            values[slot] = value;
+            if (pinned[slot] != (uint8_t)pin) {
+                if (pin) {
+                    lruUnlink(slot);
+                } else {
+                    lruPushFront(slot);
+                }
+                pinned[slot] = pin;
+            } else if (!pin) {
+                lruUnlink(slot);
+                lruPushFront(slot);
+            }
+            return true;
+        }
+        if (count >= max_entries) {
+            if (lru_tail == NIL) {
+                return false;
+            }
+            eraseSlot(lru_tail);
+            eviction_count++;
+        }
+        if (tombstones > ctrl.size() / 8) {
+            rehash();
+        }
+        placeNew(key, value, pin);
+        return true;
+    }
+
+    bool erase(uint64_t key) {
+        uint32_t slot = findSlot(key);
+        if (slot == NIL) {
+            return false;
+        }
+        eraseSlot(slot);
+        return true;
+    }
+
+    // Removes every entry whose value matches the predicate (full walk; for rare events like a port going down)
+    template <typename Predicate>
+    void eraseIf(Predicate predicate) {
+        if (count == 0) {
+            return;
+        }
+        for (uint32_t slot = 0; slot < ctrl.size(); slot++) {
+            if (ctrl[slot] >= 0 && predicate(values[slot])) {
+                eraseSlot(slot);
+            }
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return max_entries;
+    }
+
+    long long evictions() const {
+        return eviction_count;
+    }
+};
+
+class Network {
+private:
+    string network_ip;
+    int next_subnet;
+
+public:
+    Network(string ip) {
+        network_ip = ip;
+        next_subnet = 0;
+    }
+
+    string assignIPAddress() {
+        string subnet = to_string(next_subnet++);
+        return network_ip + "." + subnet;
+    }
+};
+
+class RoutingTable {
+private:
+    unordered_map<string, string> staticRoutes; // Destination IP -> Next hop IP
+    unordered_map<string, string> dynamicRoutes; // Destination IP -> Next hop IP
+    unordered_map<string, string> backupRoutes; // Destination IP -> Loop-free alternate next hop IP
+
+public:
+    void addStaticRoute(const string& destinationIP, const string& nextHopIP) {
+        staticRoutes[destinationIP] = nextHopIP;
+    }
+
+    void addDynamicRoute(const string& destinationIP, const string& nextHopIP) {
+        dynamicRoutes[destinationIP] = nextHopIP;
+    }
+
+    void removeDynamicRoute(const string& destinationIP) {
+        dynamicRoutes.erase(destinationIP);
+        backupRoutes.erase(destinationIP);
+    }
+
+    void addBackupRoute(const string& destinationIP, const string& nextHopIP) {
+        backupRoutes[destinationIP] = nextHopIP;
+    }
+
+    void removeBackupRoute(const string& destinationIP) {
+        backupRoutes.erase(destinationIP);
+    }
+
+    string getBackupHop(const string& destinationIP) {
+        auto it = backupRoutes.find(destinationIP);
+        if (it != backupRoutes.end()) {
+            return it->second;
+        }
+        return "";
+    }
+
+    const unordered_map<string, string>& getDynamicRoutes() const {
+        return dynamicRoutes;
+    }
+
+    // Approximate heap footprint; IPv4 strings fit in the small-string buffer so only
+    // hash nodes and bucket arrays are counted
+    size_t memoryUsage() const {
+        const size_t nodeBytes = sizeof(pair<const string, string>) + 2 * sizeof(void*);
+        size_t bytes = sizeof(*this);
+        for (const auto* routes : {&staticRoutes, &dynamicRoutes, &backupRoutes}) {
+            bytes += routes->bucket_count() * sizeof(void*) + routes->size() * nodeBytes;
+        }
+        return bytes;
+    }
+
+    string getNextHop(const string& destinationIP) {
+        if (staticRoutes.count(destinationIP) > 0) {
+            return staticRoutes[destinationIP];
+        }
+        if (dynamicRoutes.count(destinationIP) > 0) {
+            return dynamicRoutes[destinationIP];
+        }
+        return "";
+    }
+
+    void printRoutingTable() {
+        cout << "Routing Table: " << endl;
+        cout << "Destination IP\tNext Hop IP" << endl;
+        for (const auto& route : staticRoutes) {
+            cout << route.first << "\t\t" << route.second << " (Static)" << endl;
+        }
+        for (const auto& route : dynamicRoutes) {
+            cout << route.first << "\t\t" << route.second << " (Dynamic)" << endl;
+        }
+        for (const auto& route : backupRoutes) {
+            cout << route.first << "\t\t" << route.second << " (Backup)" << endl;
+        }
+    }
+};
+
+// Link-state database shared by OSPF instances: router IP -> neighbour IP -> link cost
+class LinkStateDatabase {
+private:
+    vector<string> router_ips;
+    unordered_map<string, int> router_index;
+    vector<unordered_map<int, int>> adjacency; // Router index -> neighbour index -> cost
+
+public:
+    int addRouter(const string& routerIP) {
+        auto it = router_index.find(routerIP);
+        if (it != router_index.end()) {
+            return it->second;
+        }
+        int index = router_ips.size();
+        router_index[routerIP] = index;
+        router_ips.push_back(routerIP);
+        adjacency.emplace_back();
+        return index;
+    }
+
+    int getRouterIndex(const string& routerIP) const {
+        auto it = router_index.find(routerIP);
+        return it != router_index.end() ? it->second : -1;
+    }
+
+    const string& getRouterIP(int index) const {
+        return router_ips[index];
+    }
+
+    int size() const {
+        return router_ips.size();
+    }
+
+    void setLink(const string& a, const string& b, int cost) {
+        int i = addRouter(a);
+        int j = addRouter(b);
+        adjacency[i][j] = cost;
+        adjacency[j][i] = cost;
+    }
+
+    void removeLink(const string& a, const string& b) {
+        int i = getRouterIndex(a);
+        int j = getRouterIndex(b);
+        if (i >= 0 && j >= 0) {
+            adjacency[i].erase(j);
+            adjacency[j].erase(i);
+        }
+    }
+
+    // Installs a router LSA: the originator's links become exactly the advertised set
+    void setRouterLinks(const string& routerIP, const unordered_map<string, int>& links) {
+        int i = addRouter(routerIP);
+        vector<int> stale;
+        for (const auto& link : adjacency[i]) {
+            if (links.count(router_ips[link.first]) == 0) {
+                stale.push_back(link.first);
+            }
+        }
+        for (int j : stale) {
+            adjacency[i].erase(j);
+            adjacency[j].erase(i);
+        }
+        for (const auto& link : links) {
+            int j = addRouter(link.first);
+            adjacency[i][j] = link.second;
+            adjacency[j][i] = link.second;
+        }
+    }
+
+    const unordered_map<int, int>& getNeighbours(int index) const {
+        return adjacency[index];
+    }
+
+    // Dijkstra from root. firstHop[d] is the neighbour of root on the shortest path to d (-1 if none)
+    void shortestPaths(int root, vector<int>& dist, vector<int>* firstHop = nullptr) const {
+        const int INF = numeric_limits<int>::max();
+        dist.assign(router_ips.size(), INF);
+        if (firstHop != nullptr) {
+            firstHop->assign(router_ips.size(), -1);
+        }
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> frontier;
+        dist[root] = 0;
+        frontier.push({0, root});
+        while (!frontier.empty()) {
+            auto [d, u] = frontier.top();
+            frontier.pop();
+            if (d > dist[u]) {
+                continue;
+            }
+            for (const auto& link : adjacency[u]) {
+                int v = link.first;
+                int candidate = d + link.second;
+                if (candidate < dist[v]) {
+                    dist[v] = candidate;
+                    if (firstHop != nullptr) {
+                        (*firstHop)[v] = (u == root) ? v : (*firstHop)[u];
+                    }
+                    frontier.push({candidate, v});
+                }
+            }
+        }
+    }
+};
+
+class RoutingProtocol {
+public:
+    virtual void updateRoutingTable(const unordered_map<string, string>& routingTable) = 0;
+    virtual ~RoutingProtocol() {}
+};
+
+class RIP : public RoutingProtocol {
+private:
+    RoutingTable* routingTable; // Pointer to the routing table
+    string router_ip;
+    unordered_map<string, int> metrics; // Destination IP -> hop count
+
+public:
+    static const int INFINITY_METRIC = 16;
+
+    RIP(RoutingTable* rt) {
+        routingTable = rt;
+    }
+
+    void attachRouter(const string& routerIP) {
+        router_ip = routerIP;
+        metrics[routerIP] = 0;
+    }
+
+    const unordered_map<string, int>& getMetrics() const {
+        return metrics;
+    }
+
+    // Bellman-Ford step for a distance vector received from a neighbour. Routes through
+    // that neighbour always follow its latest metric; others switch only if strictly better.
+    // Returns the destinations whose metric changed, ready to be re-advertised.
+    unordered_map<string, int> processAdvertisement(const string& neighbourIP, int linkCost, const unordered_map<string, int>& advertised) {
+        unordered_map<string, int> changed;
+        unordered_map<string, string> batch;
+        for (const auto& entry : advertised) {
+            const string& destinationIP = entry.first;
+            if (destinationIP == router_ip) {
+                continue;
+            }
+            int candidate = min(entry.second + linkCost, (int)INFINITY_METRIC);
+            auto known = metrics.find(destinationIP);
+            int current = known != metrics.end() ? known->second : INFINITY_METRIC;
+            bool viaNeighbour = known != metrics.end() && routingTable->getNextHop(destinationIP) == neighbourIP;
+            if ((viaNeighbour && candidate != current) || candidate < current) {
+                changed[destinationIP] = candidate;
+                if (candidate < INFINITY_METRIC) {
+                    metrics[destinationIP] = candidate;
+                    batch[destinationIP] = neighbourIP;
+                } else {
+                    metrics.erase(destinationIP);
+                    batch[destinationIP] = "";
+                }
+            }
+        }
+        if (!batch.empty()) {
+            updateRoutingTable(batch);
+        }
+        return changed;
+    }
+
+    // Poisons every route learned through a neighbour whose link went down
+    unordered_map<string, int> neighbourDown(const string& neighbourIP) {
+        unordered_map<string, int> changed;
+        unordered_map<string, string> batch;
+        for (const auto& entry : metrics) {
+            if (entry.first != router_ip && routingTable->getNextHop(entry.first) == neighbourIP) {
+                changed[entry.first] = INFINITY_METRIC;
+                batch[entry.first] = "";
+            }
+        }
+        for (const auto& entry : changed) {
+            metrics.erase(entry.first);
+        }
+        if (!batch.empty()) {
+            updateRoutingTable(batch);
+        }
+        return changed;
+    }
+
+    // Split horizon with poisoned reverse: routes learned from the neighbour go back as unreachable
+    unordered_map<string, int> advertisementFor(const string& neighbourIP, const unordered_map<string, int>& routes) {
+        unordered_map<string, int> advertised;
+        for (const auto& entry : routes) {
+            bool learnedFromNeighbour = entry.first != router_ip && routingTable->getNextHop(entry.first) == neighbourIP;
+            advertised[entry.first] = learnedFromNeighbour ? (int)INFINITY_METRIC : entry.second;
+        }
+        return advertised;
+    }
+
+    // An empty next hop withdraws the route
+    void updateRoutingTable(const unordered_map<string, string>& routingTable) override {
+        for (const auto& route : routingTable) {
+            if (route.second.empty()) {
+                this->routingTable->removeDynamicRoute(route.first);
+            } else {
+                this->routingTable->addDynamicRoute(route.first, route.second);
+            }
+        }
+    }
+};
+
+class OSPF : public RoutingProtocol {
+private:
+    RoutingTable* routingTable; // Pointer to the routing table
+    LinkStateDatabase* lsdb;
+    string router_ip;
+    bool compute_lfa; // Precompute loop-free alternates during SPF (IP fast reroute)
+
+public:
+    OSPF(RoutingTable* rt) {
+        routingTable = rt;
+        lsdb = nullptr;
+        compute_lfa = false;
+    }
+
+    void attachLinkStateDatabase(LinkStateDatabase* db, const string& routerIP) {
+        lsdb = db;
+        router_ip = routerIP;
+    }
+
+    void setLoopFreeAlternates(bool enabled) {
+        compute_lfa = enabled;
+    }
+
+    // Applies a whole batch of routes; an empty next hop withdraws the route
+    void updateRoutingTable(const unordered_map<string, string>& routingTable) override {
+        for (const auto& route : routingTable) {
+            if (route.second.empty()) {
+                this->routingTable->removeDynamicRoute(route.first);
+            } else {
+                this->routingTable->addDynamicRoute(route.first, route.second);
+            }
+        }
+    }
+
+    // Recomputes primary next hops from the link-state database and, when enabled,
+    // a loop-free alternate per destination (RFC 5286 inequality:
+    // dist(N, D) < dist(N, S) + dist(S, D) for neighbour N of source S).
+    // Changed primaries are committed as one batch; returns how many routes changed.
+    int runSPF() {
+        if (lsdb == nullptr) {
+            return 0;
+        }
+        int source = lsdb->getRouterIndex(router_ip);
+        if (source < 0) {
+            return 0;
+        }
+        const int INF = numeric_limits<int>::max();
+        vector<int> dist;
+        vector<int> firstHop;
+        lsdb->shortestPaths(source, dist, &firstHop);
+
+        // One SPF rooted at each neighbour gives everything the LFA inequality needs
+        vector<pair<int, vector<int>>> neighbourDist;
+        if (compute_lfa) {
+            for (const auto& link : lsdb->getNeighbours(source)) {
+                neighbourDist.emplace_back(link.first, vector<int>());
+                lsdb->shortestPaths(link.first, neighbourDist.back().second);
+            }
+        }
+
+        const unordered_map<string, string>& current = routingTable->getDynamicRoutes();
+        unordered_map<string, string> changes;
+        for (int dest = 0; dest < lsdb->size(); dest++) {
+            if (dest == source) {
+                continue;
+            }
+            const string& destIP = lsdb->getRouterIP(dest);
+            auto installed = current.find(destIP);
+            if (dist[dest] == INF) {
+                if (installed != current.end()) {
+                    changes[destIP] = "";
+                }
+                continue;
+            }
+            int primary = firstHop[dest];
+            if (installed == current.end() || installed->second != lsdb->getRouterIP(primary)) {
+                changes[destIP] = lsdb->getRouterIP(primary);
+            }
+
+            int best = -1;
+            long long bestCost = numeric_limits<long long>::max();
+            for (const auto& entry : neighbourDist) {
+                int neighbour = entry.first;
+                const vector<int>& nd = entry.second;
+                if (neighbour == primary || nd[dest] == INF) {
+                    continue;
+                }
+                if ((long long)nd[dest] < (long long)nd[source] + dist[dest]) {
+                    long long cost = (long long)lsdb->getNeighbours(source).at(neighbour) + nd[dest];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        best = neighbour;
+                    }
+                }
+            }
+            if (best >= 0) {
+                routingTable->addBackupRoute(destIP, lsdb->getRouterIP(best));
+            } else {
+                routingTable->removeBackupRoute(destIP);
+            }
+        }
+        if (!changes.empty()) {
+            updateRoutingTable(changes);
+        }
+        return changes.size();
+    }
+};
+
+// Per-prefix route flap damping (RFC 2439). Every change of next hop adds a penalty that
+// decays exponentially with the configured half-life. A prefix whose penalty crosses the
+// suppress limit is held back until the penalty decays below the reuse limit.
+class RouteFlapDamper {
+private:
+    struct PrefixState {
+        double penalty = 0;
+        SimTime last_update = 0;
+        bool suppressed = false;
+        bool reuse_timer = false; // A reuse check is already scheduled
+        string next_hop;          // Latest advertised next hop, applied on reuse
+    };
+
+    unordered_map<string, PrefixState> prefixes;
+    double flap_penalty;
+    double suppress_limit;
+    double reuse_limit;
+    SimTime half_life;
+
+    double decayedPenalty(const PrefixState& state, SimTime now) const {
+        return state.penalty * exp2(-(double)(now - state.last_update) / half_life);
+    }
+
+public:
+    RouteFlapDamper(SimTime halfLife = 15 * SECOND, double penalty = 1000, double suppress = 2000, double reuse = 750) {
+        half_life = halfLife;
+        flap_penalty = penalty;
+        suppress_limit = suppress;
+        reuse_limit = reuse;
+    }
+
+    // Records an advertisement and returns whether it may be installed now
+    bool recordUpdate(const string& prefix, const string& nextHop, SimTime now) {
+        auto it = prefixes.find(prefix);
+        if (it == prefixes.end()) {
+            PrefixState state;
+            state.last_update = now;
+            state.next_hop = nextHop;
+            prefixes[prefix] = state;
+            return true;
+        }
+        PrefixState& state = it->second;
+        state.penalty = decayedPenalty(state, now);
+        state.last_update = now;
+        if (state.next_hop != nextHop) {
+            state.penalty += flap_penalty;
+            state.next_hop = nextHop;
+        }
+        if (state.suppressed && state.penalty < reuse_limit) {
+            state.suppressed = false;
+        } else if (!state.suppressed && state.penalty >= suppress_limit) {
+            state.suppressed = true;
+        }
+        return !state.suppressed;
+    }
+
+    bool isSuppressed(const string& prefix) const {
+        auto it = prefixes.find(prefix);
+        return it != prefixes.end() && it->second.suppressed;
+    }
+
+    // Returns true (once) when the caller should schedule a reuse check for a suppressed prefix
+    bool claimReuseTimer(const string& prefix) {
+        PrefixState& state = prefixes[prefix];
+        if (!state.suppressed || state.reuse_timer) {
+            return false;
+        }
+        state.reuse_timer = true;
+        return true;
+    }
+
+    // Virtual time until the prefix's penalty decays below the reuse limit
+    SimTime reuseDelay(const string& prefix, SimTime now) {
+        const PrefixState& state = prefixes[prefix];
+        double penalty = decayedPenalty(state, now);
+        if (penalty < reuse_limit) {
+            return 0;
+        }
+        return (SimTime)ceil(half_life * log2(penalty / reuse_limit)) + 1;
+    }
+
+    // Lifts suppression once the penalty has decayed; nextHop receives the route to install
+    bool releaseIfReusable(const string& prefix, SimTime now, string& nextHop) {
+        PrefixState& state = prefixes[prefix];
+        state.reuse_timer = false;
+        if (state.suppressed && decayedPenalty(state, now) < reuse_limit) {
+            state.suppressed = false;
+            nextHop = state.next_hop;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Per-interface ARP cache. Entries are packed into 16 bytes (IPv4 as 32 bits, MAC and
+// state sharing 64 bits) in a slab, and aging is driven by a hashed timing wheel that is
+// advanced lazily on every access, so expiry never scans the whole table.
+class ArpCache {
+public:
+    enum State { INCOMPLETE = 0, REACHABLE = 1, STALE = 2 };
+
+private:
+    struct Entry {
+        uint32_t ip;
+        uint32_t expires;   // Tick at which the entry changes state
+        uint64_t mac_state; // Low 48 bits MAC, high byte state (0 = free slot)
+    };
+
+    vector<Entry> entries;
+    vector<uint32_t> free_slots;
+    unordered_map<uint32_t, uint32_t> index; // IP -> slot
+    vector<vector<uint32_t>> wheel;          // Tick % wheel size -> slots due then; allocated on first insert
+    size_t wheel_size;
+    size_t capacity;
+    SimTime tick_length;
+    uint32_t reachable_ticks;
+    uint32_t stale_ticks;
+    uint32_t current_tick;
+
+    static int stateOf(const Entry& entry) {
+        return (int)(entry.mac_state >> 56);
+    }
+
+    static uint64_t pack(uint64_t mac, int state) {
+        return (mac & 0xFFFFFFFFFFFFULL) | ((uint64_t)state << 56);
+    }
+
+    void schedule(uint32_t slot) {
+        wheel[entries[slot].expires % wheel_size].push_back(slot);
+    }
+
+    void release(uint32_t slot) {
+        index.erase(entries[slot].ip);
+        entries[slot].mac_state = 0;
+        free_slots.push_back(slot);
+    }
+
+    // REACHABLE entries fall back to STALE; STALE entries are removed
+    void expire(uint32_t slot) {
+        Entry& entry = entries[slot];
+        while (stateOf(entry) != 0 && entry.expires <= current_tick) {
+            if (stateOf(entry) == REACHABLE) {
+                entry.mac_state = pack(entry.mac_state, STALE);
+                entry.expires += stale_ticks;
+            } else {
+                release(slot);
+                return;
+            }
+        }
+        schedule(slot);
+    }
+
+    void advance(SimTime now) {
+        uint32_t target = (uint32_t)(now / tick_length);
+        if (wheel.empty()) {
+            current_tick = target;
+            return;
+        }
+        // Past one full revolution every bucket is due, so visit each once
+        if (target - current_tick > wheel_size) {
+            current_tick = target - wheel_size;
+        }
+        while (current_tick < target) {
+            current_tick++;
+            vector<uint32_t> due;
+            due.swap(wheel[current_tick % wheel_size]);
+            for (uint32_t slot : due) {
+                const Entry& entry = entries[slot];
+                if (stateOf(entry) == 0 || entry.expires % wheel_size != current_tick % wheel_size) {
+                    continue; // Freed or rescheduled since; drop the stale reference
+                }
+                if (entry.expires > current_tick) {
+                    wheel[current_tick % wheel_size].push_back(slot); // Due on a later revolution
+                } else {
+                    expire(slot);
+                }
+            }
+        }
+    }
+
+    // Frees the live entry closest to expiry to keep the table within capacity
+    void evictOne() {
+        for (size_t offset = 0; offset <= wheel_size; offset++) {
+            size_t position = (current_tick + offset) % wheel_size;
+            for (uint32_t slot : wheel[position]) {
+                const Entry& entry = entries[slot];
+                if (stateOf(entry) != 0 && entry.expires % wheel_size == position) { // Skip slots refreshed since
+                    release(slot);
+                    return;
+                }
+            }
+        }
+    }
+
+public:
+    ArpCache(size_t maxEntries = 4096, SimTime reachableTime = 30 * SECOND, SimTime staleTime = 60 * SECOND, SimTime tick = SECOND, size_t wheelSize = 256) {
+        capacity = maxEntries;
+        tick_length = tick;
+        reachable_ticks = (uint32_t)(reachableTime / tick);
+        stale_ticks = (uint32_t)(staleTime / tick);
+        current_tick = 0;
+        wheel_size = wheelSize;
+    }
+
+    static uint32_t packIP(const string& ip) {
+        unsigned a = 0, b = 0, c = 0, d = 0;
+        sscanf(ip.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d);
+        return (a << 24) | (b << 16) | (c << 8) | d;
+    }
+
+    static uint64_t packMAC(const string& mac) {
+        unsigned bytes[6] = {0, 0, 0, 0, 0, 0};
+        sscanf(mac.c_str(), "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]);
+        uint64_t packed = 0;
+        for (unsigned byte : bytes) {
+            packed = (packed << 8) | (byte & 0xFF);
+        }
+        return packed;
+    }
+
+    static string unpackMAC(uint64_t mac) {
+        char text[18];
+        snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+                 (unsigned)(mac >> 40) & 0xFF, (unsigned)(mac >> 32) & 0xFF, (unsigned)(mac >> 24) & 0xFF,
+                 (unsigned)(mac >> 16) & 0xFF, (unsigned)(mac >> 8) & 0xFF, (unsigned)mac & 0xFF);
+        return text;
+    }
+
+    // Adds or confirms a mapping; the entry becomes REACHABLE again
+    void insert(const string& ipAddress, const string& macAddress, SimTime now) {
+        if (wheel.empty()) {
+            wheel.resize(wheel_size);
+        }
+        advance(now);
+        uint32_t ip = packIP(ipAddress);
+        auto it = index.find(ip);
+        uint32_t slot;
+        if (it != index.end()) {
+            slot = it->second;
+        } else {
+            if (index.size() >= capacity) {
+                evictOne();
+            }
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                slot = entries.size();
+                entries.push_back(Entry());
+            }
+            index[ip] = slot;
+        }
+        entries[slot].ip = ip;
+        entries[slot].expires = current_tick + max(reachable_ticks, 1u);
+        entries[slot].mac_state = pack(packMAC(macAddress), REACHABLE);
+        schedule(slot);
+    }
+
+    // Returns the MAC ("" on a miss); state receives REACHABLE or STALE
+    string lookup(const string& ipAddress, SimTime now, State* state = nullptr) {
+        advance(now);
+        auto it = index.find(packIP(ipAddress));
+        if (it == index.end()) {
+            return "";
+        }
+        const Entry& entry = entries[it->second];
+        if (state != nullptr) {
+            *state = (State)stateOf(entry);
+        }
+        return unpackMAC(entry.mac_state);
+    }
+
+    size_t size() const {
+        return index.size();
+    }
+};
+
+const SimTime ARP_RETRY_INTERVAL = 1 * SECOND;
+const int ARP_MAX_REQUESTS = 3;          // Broadcasts per resolution before giving up
+const size_t ARP_PENDING_QUEUE_LIMIT = 64; // Packets held per unresolved destination
+
+// CRC-32 over the frame as it would appear on the wire: MAC header, optional 802.1Q tag,
+// EtherType, the ARP or IPv4 packet and padding up to the 64-byte minimum
+uint32_t frameChecksum(const Frame& frame) {
+    uint8_t header[18 + 28];
+    size_t length = 0;
+    auto put = [&](uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; i--) {
+            header[length++] = (uint8_t)(value >> (8 * i));
+        }
+    };
+    put(frame.dst_key != 0 ? frame.dst_key : macKey(frame.dst_mac), 6);
+    put(frame.src_key != 0 ? frame.src_key : macKey(frame.src_mac), 6);
+    if (frame.vlan_id != 0) {
+        put(0x8100, 2);
+        put(frame.vlan_id, 2);
+    }
+    put(frame.ether_type, 2);
+    size_t packet;
+    if (frame.ether_type == ETHERTYPE_ARP) {
+        put(0x00010800, 4); // Ethernet / IPv4
+        put(0x0604, 2);
+        put(frame.arp_op, 2);
+        put(frame.src_key != 0 ? frame.src_key : macKey(frame.src_mac), 6);
+        put(ArpCache::packIP(frame.sender_ip), 4);
+        put(frame.arp_op == ARP_REPLY ? frame.dst_key : 0, 6);
+        put(ArpCache::packIP(frame.target_ip), 4);
+        packet = 28;
+    } else {
+        packet = 20 + frame.payload.size();
+        put(0x4500, 2);
+        put(packet, 2);
+        put(0, 4);
+        put(((uint32_t)frame.ttl << 24) | ((uint32_t)frame.ip_protocol << 16), 4); // TTL, protocol, checksum left zero
+        put(ArpCache::packIP(frame.sender_ip), 4);
+        put(ArpCache::packIP(frame.target_ip), 4);
+        put(((uint32_t)frame.src_port << 16) | frame.dst_port, 4); // Start of the transport header
+    }
+    uint32_t crc = crc32Update(0xFFFFFFFFu, header, length);
+    if (frame.ether_type != ETHERTYPE_ARP) {
+        crc = crc32Update(crc, (const uint8_t*)frame.payload.data(), frame.payload.size());
+    }
+    static const uint8_t padding[46] = {};
+    if (packet < 46) {
+        crc = crc32Update(crc, padding, 46 - packet);
+    }
+    return ~crc;
+}
+
+// Header fields an access list can match on, pulled out of a frame once per classification
+struct PacketHeader {
+    uint32_t src_ip = 0;
+    uint32_t dst_ip = 0;
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    uint8_t protocol = 0;
+    uint16_t vlan = 0;
+    uint64_t src_mac = 0;
+    uint64_t dst_mac = 0;
+};
+
+PacketHeader packetHeader(const Frame& frame, uint16_t vlan) {
+    PacketHeader header;
+    header.src_ip = ArpCache::packIP(frame.sender_ip);
+    header.dst_ip = ArpCache::packIP(frame.target_ip);
+    header.src_port = frame.src_port;
+    header.dst_port = frame.dst_port;
+    header.protocol = frame.ip_protocol;
+    header.vlan = vlan;
+    header.src_mac = frame.src_key != 0 ? frame.src_key : macKey(frame.src_mac);
+    header.dst_mac = frame.dst_key != 0 ? frame.dst_key : macKey(frame.dst_mac);
+    return header;
+}
+
+enum AclAction { ACL_PERMIT, ACL_DENY };
+
+// One access-list entry. Addresses match on a prefix and ports on an inclusive range; a zero
+// protocol, VLAN or MAC matches anything.
+struct AclRule {
+    AclAction action = ACL_PERMIT;
+    uint32_t src_ip = 0;
+    int src_len = 0;
+    uint32_t dst_ip = 0;
+    int dst_len = 0;
+    uint16_t src_port_low = 0;
+    uint16_t src_port_high = 65535;
+    uint16_t dst_port_low = 0;
+    uint16_t dst_port_high = 65535;
+    uint8_t protocol = 0;
+    uint16_t vlan = 0;
+    uint64_t src_mac = 0;
+    uint64_t dst_mac = 0;
+
+    bool matches(const PacketHeader& header) const {
+        return prefixMatch(header.src_ip, src_ip, src_len) && prefixMatch(header.dst_ip, dst_ip, dst_len) &&
+               header.src_port >= src_port_low && header.src_port <= src_port_high &&
+               header.dst_port >= dst_port_low && header.dst_port <= dst_port_high &&
+               (protocol == 0 || header.protocol == protocol) && (vlan == 0 || header.vlan == vlan) &&
+               (src_mac == 0 || header.src_mac == src_mac) && (dst_mac == 0 || header.dst_mac == dst_mac);
+    }
+
+    static uint32_t prefixMask(int length) {
+        return length > 0 ? ~0u << (32 - length) : 0;
+    }
+
+    static bool prefixMatch(uint32_t ip, uint32_t prefix, int length) {
+        return ((ip ^ prefix) & prefixMask(length)) == 0;
+    }
+};
+
+// Ordered access list compiled for tuple space search. Each rule becomes exact-match entries
+// in the table for its tuple, the combination of prefix lengths and wildcards it uses; port
+// ranges are first split into aligned prefixes. Probing a tuple costs one hash lookup however
+// many rules share it, and two address indexes prune the tuples that cannot hold a match for
+// the packet's source or destination before any are probed. Survivors are visited in order of
+// the first rule they hold, so the search stops once none left can beat the best match so far.
+// The first matching rule wins; a packet matching none gets the default action. Short lists
+// are scanned in order instead, which beats probing the tuples below about 150 rules.
+class PacketClassifier {
+private:
+    static constexpr size_t LINEAR_SCAN_RULES = 128;
+    struct Key {
+        uint64_t words[4];
+
+        bool operator==(const Key& other) const {
+            return words[0] == other.words[0] && words[1] == other.words[1] && words[2] == other.words[2] &&
+                   words[3] == other.words[3];
+        }
+    };
+    struct Slot {
+        Key key;
+        int rule; // -1 if empty
+    };
+    struct Tuple {
+        Key mask;
+        int src_len = 0;
+        int dst_len = 0;
+        int first_rule = 0; // Lowest rule index in the table
+        uint64_t slot_mask = 0;
+        vector<Slot> slots;
+        size_t entries = 0;
+    };
+    // Address prefix -> tuples holding a rule with that prefix, one map per prefix length in use.
+    // Tuple sets are bitmaps in tuple order, stored back to back in one pool.
+    struct PrefixIndex {
+        vector<int> lengths;
+        vector<unordered_map<uint32_t, size_t>> prefixes; // Per length: prefix -> offset in pool
+        vector<uint64_t> pool;
+        vector<uint64_t> wildcard;                         // Tuples that ignore the address
+    };
+    vector<AclRule> rules;
+    AclAction default_action;
+    vector<Tuple> tuples;
+    size_t words; // Bitmap words per tuple set
+    PrefixIndex src_index;
+    PrefixIndex dst_index;
+    vector<uint64_t> by_destination; // Lookup scratch
+    vector<uint64_t> by_source;
+    size_t entries;
+    bool dirty;
+    long long lookups;
+    long long probes;
+
+    static Key headerKey(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, uint8_t protocol,
+                         uint16_t vlan, uint64_t src_mac, uint64_t dst_mac) {
+        Key key;
+        key.words[0] = ((uint64_t)src_ip << 32) | dst_ip;
+        key.words[1] = ((uint64_t)src_port << 48) | ((uint64_t)dst_port << 32) | ((uint64_t)protocol << 16) | vlan;
+        key.words[2] = src_mac;
+        key.words[3] = dst_mac;
+        return key;
+    }
+
+    static Key masked(const Key& key, const Key& mask) {
+        Key out;
+        for (int i = 0; i < 4; i++) {
+            out.words[i] = key.words[i] & mask.words[i];
+        }
+        return out;
+    }
+
+    static uint64_t hashKey(const Key& key) {
+        uint64_t hash = (key.words[0] ^ (key.words[1] * 0x9E3779B97F4A7C15ULL)) * 0xC2B2AE3D27D4EB4FULL;
+        hash ^= (key.words[2] ^ (key.words[3] << 17)) * 0x165667B19E3779F9ULL;
+        return hash ^ (hash >> 31);
+    }
+
+    // Splits [low, high] into the fewest aligned blocks, each a value and a prefix length
+    static void rangePrefixes(uint32_t low, uint32_t high, int bits, vector<pair<uint16_t, int>>& out) {
+        out.clear();
+        while (low <= high) {
+            uint32_t size = 1;
+            int length = bits;
+            while (length > 0 && (low & (2 * size - 1)) == 0 && low + 2 * size - 1 <= high) {
+                size *= 2;
+                length--;
+            }
+            out.push_back({(uint16_t)low, length});
+            low += size;
+        }
+    }
+
+    static uint16_t portMask(int length) {
+        return length > 0 ? (uint16_t)(0xFFFF << (16 - length)) : 0;
+    }
+
+    static void insert(Tuple& tuple, const Key& key, int rule) {
+        uint64_t slot = hashKey(key) & tuple.slot_mask;
+        while (tuple.slots[slot].rule >= 0) {
+            if (tuple.slots[slot].key == key) {
+                tuple.slots[slot].rule = min(tuple.slots[slot].rule, rule); // First match wins
+                return;
+            }
+            slot = (slot + 1) & tuple.slot_mask;
+        }
+        tuple.slots[slot].key = key;
+        tuple.slots[slot].rule = rule;
+        tuple.entries++;
+    }
+
+    static int find(const Tuple& tuple, const Key& key) {
+        uint64_t slot = hashKey(key) & tuple.slot_mask;
+        while (tuple.slots[slot].rule >= 0) {
+            if (tuple.slots[slot].key == key) {
+                return tuple.slots[slot].rule;
+            }
+            slot = (slot + 1) & tuple.slot_mask;
+        }
+        return -1;
+    }
+
+    void indexPrefix(PrefixIndex& index, int length, uint32_t prefix, size_t tuple) {
+        if (length == 0) {
+            index.wildcard[tuple / 64] |= 1ULL << (tuple % 64);
+            return;
+        }
+        size_t which = find_if(index.lengths.begin(), index.lengths.end(), [length](int l) { return l == length; }) -
+                       index.lengths.begin();
+        if (which == index.lengths.size()) {
+            index.lengths.push_back(length);
+            index.prefixes.emplace_back();
+        }
+        auto it = index.prefixes[which].find(prefix);
+        if (it == index.prefixes[which].end()) {
+            it = index.prefixes[which].emplace(prefix, index.pool.size()).first;
+            index.pool.resize(index.pool.size() + words, 0);
+        }
+        index.pool[it->second + tuple / 64] |= 1ULL << (tuple % 64);
+    }
+
+    // Tuples with a rule whose prefix on this address covers ip
+    void pruneBy(const PrefixIndex& index, uint32_t ip, vector<uint64_t>& out) const {
+        out = index.wildcard;
+        for (size_t i = 0; i < index.lengths.size(); i++) {
+            auto it = index.prefixes[i].find(ip & AclRule::prefixMask(index.lengths[i]));
+            if (it != index.prefixes[i].end()) {
+                for (size_t w = 0; w < words; w++) {
+                    out[w] |= index.pool[it->second + w];
+                }
+            }
+        }
+    }
+
+    void compile() {
+        // Expand every rule into (tuple, key) entries, then size each tuple's table
+        struct Entry {
+            size_t tuple;
+            Key key;
+            int rule;
+        };
+        vector<Entry> expanded;
+        unordered_map<uint64_t, size_t> tuple_ids; // Packed prefix lengths -> tuple
+        tuples.clear();
+        vector<pair<uint16_t, int>> src_ports, dst_ports;
+        for (size_t r = 0; r < rules.size(); r++) {
+            const AclRule& rule = rules[r];
+            int src_len = min(max(rule.src_len, 0), 32);
+            int dst_len = min(max(rule.dst_len, 0), 32);
+            rangePrefixes(rule.src_port_low, rule.src_port_high, 16, src_ports);
+            rangePrefixes(rule.dst_port_low, rule.dst_port_high, 16, dst_ports);
+            for (const auto& src_port : src_ports) {
+                for (const auto& dst_port : dst_ports) {
+                    uint64_t signature = ((uint64_t)src_len << 32) | ((uint64_t)dst_len << 24) |
+                                         ((uint64_t)src_port.second << 16) | ((uint64_t)dst_port.second << 8) |
+                                         (rule.protocol != 0 ? 8 : 0) | (rule.vlan != 0 ? 4 : 0) |
+                                         (rule.src_mac != 0 ? 2 : 0) | (rule.dst_mac != 0 ? 1 : 0);
+                    auto it = tuple_ids.find(signature);
+                    if (it == tuple_ids.end()) {
+                        Tuple tuple;
+                        tuple.mask = headerKey(AclRule::prefixMask(src_len), AclRule::prefixMask(dst_len),
+                                               portMask(src_port.second), portMask(dst_port.second),
+                                               rule.protocol != 0 ? 0xFF : 0, rule.vlan != 0 ? 0xFFF : 0,
+                                               rule.src_mac != 0 ? 0xFFFFFFFFFFFFULL : 0,
+                                               rule.dst_mac != 0 ? 0xFFFFFFFFFFFFULL : 0);
+                        tuple.src_len = src_len;
+                        tuple.dst_len = dst_len;
+                        tuple.first_rule = (int)r; // Rules are visited in order
+                        it = tuple_ids.emplace(signature, tuples.size()).first;
+                        tuples.push_back(move(tuple));
+                    }
+                    Key key = headerKey(rule.src_ip, rule.dst_ip, src_port.first, dst_port.first, rule.protocol,
+                                        rule.vlan, rule.src_mac, rule.dst_mac);
+                    expanded.push_back({it->second, masked(key, tuples[it->second].mask), (int)r});
+                }
+            }
+        }
+        // New tuples only ever appear at a later rule, so creation order is first_rule order
+        vector<size_t> sizes(tuples.size(), 0);
+        for (const Entry& entry : expanded) {
+            sizes[entry.tuple]++;
+        }
+        for (size_t t = 0; t < tuples.size(); t++) {
+            size_t capacity = 4;
+            while (capacity < 2 * sizes[t]) {
+                capacity *= 2;
+            }
+            tuples[t].slot_mask = capacity - 1;
+            tuples[t].slots.assign(capacity, Slot{Key(), -1});
+        }
+        words = (tuples.size() + 63) / 64;
+        src_index = PrefixIndex();
+        dst_index = PrefixIndex();
+        src_index.wildcard.assign(words, 0);
+        dst_index.wildcard.assign(words, 0);
+        entries = 0;
+        for (const Entry& entry : expanded) {
+            insert(tuples[entry.tuple], entry.key, entry.rule);
+            indexPrefix(src_index, tuples[entry.tuple].src_len, (uint32_t)(entry.key.words[0] >> 32), entry.tuple);
+            indexPrefix(dst_index, tuples[entry.tuple].dst_len, (uint32_t)entry.key.words[0], entry.tuple);
+        }
+        for (const Tuple& tuple : tuples) {
+            entries += tuple.entries;
+        }
+        dirty = false;
+    }
+
+public:
+    PacketClassifier(AclAction default_action = ACL_DENY) {
+        this->default_action = default_action;
+        words = 0;
+        entries = 0;
+        dirty = false;
+        lookups = 0;
+        probes = 0;
+    }
+
+    // Appends a rule; the tables are rebuilt on the next lookup
+    void addRule(const AclRule& rule) {
+        rules.push_back(rule);
+        dirty = true;
+    }
+
+    void clear() {
+        rules.clear();
+        dirty = true;
+    }
+
+    // Index of the first rule matching the header, or -1
+    int match(const PacketHeader& header) {
+        return rules.size() <= LINEAR_SCAN_RULES ? matchLinear(header) : matchTuples(header);
+    }
+
+    // Tuple space search over the compiled tables, whatever the list's length
+    int matchTuples(const PacketHeader& header) {
+        if (dirty) {
+            compile();
+        }
+        lookups++;
+        pruneBy(dst_index, header.dst_ip, by_destination);
+        pruneBy(src_index, header.src_ip, by_source);
+        Key key = headerKey(header.src_ip, header.dst_ip, header.src_port, header.dst_port, header.protocol,
+                            header.vlan, header.src_mac, header.dst_mac);
+        int best = -1;
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = by_destination[w] & by_source[w];
+            while (bits != 0) {
+                const Tuple& tuple = tuples[w * 64 + __builtin_ctzll(bits)];
+                bits &= bits - 1;
+                if (best >= 0 && tuple.first_rule > best) {
+                    return best; // Every remaining tuple only holds later rules
+                }
+                probes++;
+                int rule = find(tuple, masked(key, tuple.mask));
+                if (rule >= 0 && (best < 0 || rule < best)) {
+                    best = rule;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Reference first-match scan over the rule list
+    int matchLinear(const PacketHeader& header) const {
+        for (size_t r = 0; r < rules.size(); r++) {
+            if (rules[r].matches(header)) {
+                return (int)r;
+            }
+        }
+        return -1;
+    }
+
+    AclAction classify(const PacketHeader& header) {
+        int rule = match(header);
+        return rule >= 0 ? rules[rule].action : default_action;
+    }
+
+    size_t size() const {
+        return rules.size();
+    }
+
+    size_t getTupleCount() {
+        if (dirty) {
+            compile();
+        }
+        return tuples.size();
+    }
+
+    // Table entries after port ranges were split into prefixes
+    size_t getEntryCount() {
+        if (dirty) {
+            compile();
+        }
+        return entries;
+    }
+
+    // Tuples probed per lookup, after pruning
+    double getMeanProbes() const {
+        return lookups > 0 ? (double)probes / lookups : 0;
+    }
+
+    void resetStats() {
+        lookups = 0;
+        probes = 0;
+    }
+};
+
+class EndDevice : public Layer2Device {
+    
+private:
+    int device_id;
+    string device_name;
+    string ip_address;
+    string mac_address;
+    uint64_t mac_key; // Packed form of mac_address stamped on outgoing frames
+protected:
+    string subnet_mask;
+    Network* network;
+    int connecting_device_id;
+    string connecting_device_name;
+    Layer2Device* uplink; // Hub or Switch port this device is cabled to
+    ArpCache arp_cache;
+    unordered_map<string, vector<Frame>> pending_packets; // Packets waiting for ARP, per destination IP
+    unordered_map<string, int> arp_attempts;              // Outstanding resolutions -> broadcasts sent
+    long long arp_requests_sent;
+    long long arp_requests_coalesced;
+    long long arp_frames_received;
+    long long packets_delivered;
+    long long packets_dropped;
+    SimTime total_latency;
+    SimTime max_latency;
+    long long nic_speed;          // bits/s of the cable to the uplink
+    SimTime nic_free_at;          // End of the frame currently being clocked out
+    double transmit_error_rate;   // Fraction of sent frames corrupted on the wire
+    minstd_rand error_rng;
+    long long fcs_errors;         // Received frames discarded by the FCS check
+    function<void(const Frame&)> delivered_callback;
+    
+
+public:
+    EndDevice(int con_id, string con_name,  int id, string name, Network* net, string mac, string mask) {
+        
+        uplink = nullptr;
+        arp_requests_sent = 0;
+        arp_requests_coalesced = 0;
+        arp_frames_received = 0;
+        packets_delivered = 0;
+        packets_dropped = 0;
+        total_latency = 0;
+        max_latency = 0;
+        nic_speed = DEFAULT_PORT_SPEED;
+        nic_free_at = 0;
+        transmit_error_rate = 0;
+        error_rng.seed(id + 1);
+        fcs_errors = 0;
+        connecting_device_id = con_id;
+        connecting_device_name = con_name;
+        device_id = id;
+        device_name = name;
+        network = net;
+        ip_address = network != nullptr ? network->assignIPAddress() : "";
+        mac_address = mac;
+        mac_key = macKey(mac);
+        subnet_mask = mask;
+    }
+
+    int getconnectingDeviceID(){
+        return connecting_device_id;
+    }
+
+    string getconnectingDeviceName(){
+        return connecting_device_name;
+    }
+
+    int getDeviceId() {
+        return device_id;
+    }
+
+    string getDeviceName() {
+        return device_name;
+    }
+
+    string getIpAddress() {
+        return ip_address;
+    }
+
+    string getMacAddress() {
+        return mac_address;
+    }
+
+    string getSubnetMask(){
+        return subnet_mask;
+    }
+
+    void setIpAddress(const string& ip) {
+        ip_address = ip;
+    }
+
+    void connect() {
+        if (verbose) {
+            cout << device_name << " connected" << endl;
+        }
+    }
+
+    void disconnect() {
+        if (verbose) {
+            cout << device_name << " disconnected" << endl;
+        }
+    }
+
+    void attachTo(Layer2Device* device) {
+        uplink = device;
+    }
+
+    Layer2Device* getUplink() {
+        return uplink;
+    }
+
+    void setNicSpeed(long long bits_per_second) {
+        nic_speed = bits_per_second > 0 ? bits_per_second : DEFAULT_PORT_SPEED;
+    }
+
+    void setTransmitErrorRate(double rate) {
+        transmit_error_rate = rate;
+    }
+
+    // Sends an IPv4 packet on the local segment. Unresolved destinations are queued while a
+    // single ARP request is outstanding; further packets for the same IP join that queue.
+    void sendPacket(const string& destinationIP, const string& data, uint8_t protocol = 0, uint16_t srcPort = 0,
+                    uint16_t dstPort = 0) {
+        Frame frame;
+        frame.src_mac = mac_address;
+        frame.src_key = mac_key;
+        frame.ether_type = ETHERTYPE_IPV4;
+        frame.sender_ip = ip_address;
+        frame.target_ip = destinationIP;
+        frame.ip_protocol = protocol;
+        frame.src_port = srcPort;
+        frame.dst_port = dstPort;
+        frame.payload = data;
+        frame.created_at = simulator.now();
+        sendToNeighbour(destinationIP, frame);
+    }
+
+protected:
+    // Hands a frame to a neighbour on the local segment, addressed to the MAC that neighbourIP
+    // resolves to. Unresolved neighbours get one outstanding ARP request and a pending queue.
+    void sendToNeighbour(const string& neighbourIP, Frame frame) {
+        string neighbourMac = arp_cache.lookup(neighbourIP, simulator.now());
+        if (!neighbourMac.empty()) {
+            frame.dst_mac = neighbourMac;
+            frame.dst_key = macKey(neighbourMac);
+            sendFrame(frame);
+            return;
+        }
+        vector<Frame>& queue = pending_packets[neighbourIP];
+        if (queue.size() >= ARP_PENDING_QUEUE_LIMIT) {
+            packets_dropped++;
+            return;
+        }
+        queue.push_back(frame);
+        if (arp_attempts.count(neighbourIP) > 0) {
+            arp_requests_coalesced++;
+            return;
+        }
+        arp_attempts[neighbourIP] = 0;
+        sendArpRequest(neighbourIP);
+    }
+
+public:
+
+    // Frames leave one after another at the NIC's line rate and are delivered when their last bit arrives
+    void sendFrame(const Frame& frame) {
+        if (uplink == nullptr) {
+            return;
+        }
+        Frame out = frame;
+        out.fcs = frameChecksum(out);
+        if (transmit_error_rate > 0 && uniform_real_distribution<double>(0, 1)(error_rng) < transmit_error_rate) {
+            // One bit flipped somewhere in the payload or the FCS itself
+            size_t bit = error_rng() % ((out.payload.size() + 4) * 8);
+            if (bit < out.payload.size() * 8) {
+                out.payload[bit / 8] ^= (char)(1 << (bit % 8));
+            } else {
+                out.fcs ^= 1u << (bit % 32);
+            }
+        }
+        if (uplink->acceptFromStation(this, out)) {
+            return; // The segment's medium access protocol clocks it out
+        }
+        SimTime start = max(simulator.now(), nic_free_at);
+        nic_free_at = start + serializationTime(frameBytes(frame), nic_speed);
+        SimTime delay = nic_free_at - simulator.now() + LINK_DELAY;
+        transmitFrame(uplink, out, delay);
+    }
+
+    void receiveFrame(const Frame& frame, Layer2Device*) override {
+        if (frame.dst_mac != mac_address && frame.dst_mac != BROADCAST_MAC) {
+            return; // Not for us (flooded unicast)
+        }
+        if (frameChecksum(frame) != frame.fcs) {
+            fcs_errors++;
+            return;
+        }
+        if (frame.ether_type == ETHERTYPE_ARP) {
+            arp_frames_received++;
+            if (frame.arp_op == ARP_REQUEST && frame.target_ip == ip_address) {
+                arp_cache.insert(frame.sender_ip, frame.src_mac, simulator.now());
+                Frame reply;
+                reply.src_mac = mac_address;
+                reply.src_key = mac_key;
+                reply.dst_mac = frame.src_mac;
+                reply.dst_key = frame.src_key != 0 ? frame.src_key : macKey(frame.src_mac);
+                reply.ether_type = ETHERTYPE_ARP;
+                reply.arp_op = ARP_REPLY;
+                reply.sender_ip = ip_address;
+                reply.target_ip = frame.sender_ip;
+                reply.created_at = simulator.now();
+                sendFrame(reply);
+            } else if (frame.arp_op == ARP_REPLY && frame.dst_mac == mac_address) {
+                arp_cache.insert(frame.sender_ip, frame.src_mac, simulator.now());
+                releasePending(frame.sender_ip, frame.src_mac);
+            }
+            return;
+        }
+        if (frame.dst_mac == mac_address && frame.target_ip == ip_address) {
+            packets_delivered++;
+            SimTime latency = simulator.now() - frame.created_at;
+            total_latency += latency;
+            max_latency = max(max_latency, latency);
+            if (delivered_callback) {
+                delivered_callback(frame);
+            }
+        }
+    }
+
+    // Called with every IP packet addressed to this host, as it is counted as delivered
+    void onDelivered(function<void(const Frame&)> callback) {
+        delivered_callback = callback;
+    }
+
+    long long getArpRequestsSent() {
+        return arp_requests_sent;
+    }
+
+    long long getArpRequestsCoalesced() {
+        return arp_requests_coalesced;
+    }
+
+    long long getArpFramesReceived() {
+        return arp_frames_received;
+    }
+
+    long long getPacketsDelivered() {
+        return packets_delivered;
+    }
+
+    long long getPacketsDropped() {
+        return packets_dropped;
+    }
+
+    SimTime getTotalLatency() {
+        return total_latency;
+    }
+
+    SimTime getMaxLatency() {
+        return max_latency;
+    }
+
+    long long getFcsErrors() {
+        return fcs_errors;
+    }
+
+private:
+    void sendArpRequest(const string& targetIP) {
+        Frame request;
+        request.src_mac = mac_address;
+        request.src_key = mac_key;
+        request.dst_mac = BROADCAST_MAC;
+        request.dst_key = BROADCAST_KEY;
+        request.ether_type = ETHERTYPE_ARP;
+        request.arp_op = ARP_REQUEST;
+        request.sender_ip = ip_address;
+        request.target_ip = targetIP;
+        request.created_at = simulator.now();
+        arp_attempts[targetIP]++;
+        arp_requests_sent++;
+        sendFrame(request);
+
+        simulator.schedule(ARP_RETRY_INTERVAL, [this, targetIP]() {
+            auto attempt = arp_attempts.find(targetIP);
+            if (attempt == arp_attempts.end()) {
+                return; // Resolved in the meantime
+            }
+            if (attempt->second < ARP_MAX_REQUESTS) {
+                sendArpRequest(targetIP);
+                return;
+            }
+            packets_dropped += pending_packets[targetIP].size();
+            pending_packets.erase(targetIP);
+            arp_attempts.erase(attempt);
+        });
+    }
+
+    void releasePending(const string& resolvedIP, const string& resolvedMac) {
+        arp_attempts.erase(resolvedIP);
+        auto queued = pending_packets.find(resolvedIP);
+        if (queued == pending_packets.end()) {
+            return;
+        }
+        uint64_t resolvedKey = macKey(resolvedMac);
+        for (Frame& frame : queued->second) {
+            frame.dst_mac = resolvedMac;
+            frame.dst_key = resolvedKey;
+            sendFrame(frame);
+        }
+        pending_packets.erase(queued);
+    }
+};
+
+class AccessControlProtocol {
+public:
+    virtual bool canSendPacket() = 0;
+};
+
+// IEEE 802.3 CSMA/CD on one shared segment, in virtual time. A station with a frame listens
+// first and defers while it hears a carrier, then sends one inter-frame gap after the medium
+// goes quiet (1-persistent). Signals take `propagation` to reach the other stations, so two
+// stations that start within that window both transmit, detect the collision when the other
+// signal arrives, jam, and back off a random number of slot times drawn from [0, 2^k - 1]
+// with k = min(attempts, 10). A frame is discarded after 16 attempts.
+class CsmaCd : public AccessControlProtocol {
+public:
+    static constexpr int SLOT_BITS = 512;
+    static constexpr int JAM_BITS = 32;
+    static constexpr int GAP_BITS = 96;
+    static constexpr int ATTEMPT_LIMIT = 16;
+    static constexpr int BACKOFF_LIMIT = 10;
+
+    struct Stats {
+        long long frames_sent = 0;
+        long long bits_sent = 0;         // Preamble through FCS of successful frames
+        long long collisions = 0;        // Transmissions cut short by a collision
+        long long excess_collisions = 0; // Frames discarded after ATTEMPT_LIMIT tries
+        long long deferrals = 0;         // Attempts that found the medium busy
+        SimTime total_delay = 0;         // Queued to last bit out, successful frames
+        SimTime max_delay = 0;
+    };
+
+private:
+    struct Pending {
+        Frame frame;
+        SimTime queued;
+    };
+    struct Station {
+        deque<Pending> queue;
+        int attempts = 0;
+        bool active = false;   // Head frame is deferring, backing off or on the wire
+        bool deferring = false;
+    };
+    struct Transmission {
+        int station;
+        SimTime start;
+        SimTime end;           // Last bit, or end of the jam after a collision
+        bool collided = false;
+        bool finished = false;
+        long long generation = 0; // Matches only the latest end event scheduled for it
+    };
+    long long bit_rate;
+    SimTime propagation;
+    vector<Station> stations;
+    deque<Transmission> transmissions; // Still audible somewhere on the segment
+    vector<int> deferring;             // Waiting for the transmission they hear to end
+    long long next_generation;
+    minstd_rand rng;
+    function<void(int, const Frame&)> deliver;
+    Stats stats;
+
+    SimTime bits(long long count) const {
+        return count * SECOND / bit_rate;
+    }
+
+    Transmission* findTransmission(int station) {
+        for (Transmission& transmission : transmissions) {
+            if (transmission.station == station && !transmission.finished) {
+                return &transmission;
+            }
+        }
+        return nullptr;
+    }
+
+    // Whether the station hears another signal now. The segment is a star, so every signal
+    // reaches every station after the same propagation delay.
+    bool carrier(int station, SimTime& quiet_at, bool& settled) {
+        SimTime now = simulator.now();
+        while (!transmissions.empty() && transmissions.front().finished &&
+               transmissions.front().end + propagation <= now) {
+            transmissions.pop_front();
+        }
+        bool heard = false;
+        quiet_at = now;
+        settled = true;
+        for (const Transmission& transmission : transmissions) {
+            if (transmission.station != station && transmission.start + propagation <= now &&
+                now < transmission.end + propagation) {
+                heard = true;
+                quiet_at = max(quiet_at, transmission.end + propagation);
+                settled = settled && transmission.finished;
+            }
+        }
+        return heard;
+    }
+
+    void attempt(int station) {
+        SimTime quiet_at;
+        bool settled;
+        if (carrier(station, quiet_at, settled)) {
+            stats.deferrals++;
+            if (settled) {
+                simulator.scheduleAt(quiet_at + bits(GAP_BITS), [this, station]() { attempt(station); });
+            } else if (!stations[station].deferring) {
+                stations[station].deferring = true;
+                deferring.push_back(station);
+            }
+            return;
+        }
+        transmit(station);
+    }
+
+    void transmit(int station) {
+        SimTime now = simulator.now();
+        Transmission sending;
+        sending.station = station;
+        sending.start = now;
+        sending.end = now + bits((frameBytes(stations[station].queue.front().frame) + ETHERNET_PREAMBLE) * 8LL);
+        // Anything that started too recently to be heard collides with us, and hears us in turn
+        SimTime detected = -1;
+        for (Transmission& other : transmissions) {
+            if (other.start + propagation > now) {
+                SimTime heard = other.start + propagation;
+                detected = detected < 0 ? heard : min(detected, heard);
+                if (!other.finished) {
+                    abortAt(other, now + propagation);
+                }
+            }
+        }
+        transmissions.push_back(sending);
+        if (detected >= 0) {
+            abortAt(transmissions.back(), detected);
+        } else {
+            scheduleEnd(transmissions.back());
+        }
+    }
+
+    // Cuts a transmission short: the station notices the collision, sends the jam and stops
+    void abortAt(Transmission& transmission, SimTime detected) {
+        SimTime end = min(transmission.end, detected + bits(JAM_BITS));
+        if (transmission.collided && end == transmission.end) {
+            return; // Already stopping by then
+        }
+        transmission.end = end;
+        transmission.collided = true;
+        scheduleEnd(transmission);
+    }
+
+    void scheduleEnd(Transmission& transmission) {
+        int station = transmission.station;
+        long long generation = transmission.generation = ++next_generation;
+        simulator.scheduleAt(transmission.end, [this, station, generation]() {
+            Transmission* transmission = findTransmission(station);
+            if (transmission != nullptr && transmission->generation == generation) {
+                finish(*transmission);
+            }
+        });
+    }
+
+    void finish(Transmission& transmission) {
+        transmission.finished = true;
+        int id = transmission.station;
+        Station& station = stations[id];
+        SimTime now = simulator.now();
+        if (!transmission.collided) {
+            Pending sent = move(station.queue.front());
+            station.queue.pop_front();
+            station.attempts = 0;
+            stats.frames_sent++;
+            stats.bits_sent += (frameBytes(sent.frame) + ETHERNET_PREAMBLE) * 8LL;
+            SimTime delay = now - sent.queued;
+            stats.total_delay += delay;
+            stats.max_delay = max(stats.max_delay, delay);
+            if (deliver) {
+                deliver(id, sent.frame);
+            }
+            next(id, now + bits(GAP_BITS));
+        } else {
+            stats.collisions++;
+            station.attempts++;
+            if (station.attempts >= ATTEMPT_LIMIT) {
+                stats.excess_collisions++;
+                station.queue.pop_front();
+                station.attempts = 0;
+                next(id, now + bits(GAP_BITS));
+            } else {
+                int k = min(station.attempts, BACKOFF_LIMIT);
+                SimTime backoff = (SimTime)(rng() % (1u << k)) * bits(SLOT_BITS);
+                simulator.scheduleAt(now + backoff, [this, id]() { attempt(id); });
+            }
+        }
+        // Stations deferring to this signal try again one gap after it dies away
+        vector<int> waiting;
+        waiting.swap(deferring);
+        for (int other : waiting) {
+            stations[other].deferring = false;
+            simulator.scheduleAt(now + propagation + bits(GAP_BITS), [this, other]() { attempt(other); });
+        }
+    }
+
+    void next(int id, SimTime at) {
+        if (stations[id].queue.empty()) {
+            stations[id].active = false;
+            return;
+        }
+        simulator.scheduleAt(at, [this, id]() { attempt(id); });
+    }
+
+public:
+    CsmaCd(long long bit_rate = 10000000LL, SimTime propagation = 2 * LINK_DELAY, unsigned seed = 1) {
+        this->bit_rate = bit_rate;
+        this->propagation = propagation;
+        next_generation = 0;
+        rng.seed(seed);
+    }
+
+    int addStation() {
+        stations.emplace_back();
+        return (int)stations.size() - 1;
+    }
+
+    size_t stationCount() const {
+        return stations.size();
+    }
+
+    // Called with every frame that got through, as its last bit leaves the sender
+    void onDelivered(function<void(int, const Frame&)> callback) {
+        deliver = callback;
+    }
+
+    // Hands a frame to the station's MAC; frames leave each station in order
+    void enqueue(int station, const Frame& frame) {
+        Station& state = stations[station];
+        state.queue.push_back({frame, simulator.now()});
+        if (!state.active) {
+            state.active = true;
+            attempt(station);
+        }
+    }
+
+    // Carrier sense at the repeater: is anyone transmitting right now?
+    bool canSendPacket() override {
+        SimTime now = simulator.now();
+        for (const Transmission& transmission : transmissions) {
+            if (transmission.start <= now && now < transmission.end) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    long long getBitRate() const {
+        return bit_rate;
+    }
+
+    SimTime getSlotTime() const {
+        return bits(SLOT_BITS);
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+};
+
+// IEEE 802.11 DCF (CSMA/CA) on one shared channel: stations send to an access point. A
+// station with a frame waits for the medium to be idle for DIFS, then counts down a backoff
+// drawn from [0, CW]. The counter freezes whenever the station hears a transmission or its NAV
+// is set, and resumes DIFS after the medium clears. A running countdown is just its expiry
+// time in a heap, so freezing and resuming cost a heap update rather than an event per slot.
+// Stations whose counters reach zero in the same slot collide at the access point; a frame
+// that gets through is acknowledged after SIFS, a lost one doubles CW up to CW_MAX.
+//
+// Who hears whom comes from a reachability matrix, so stations hidden from each other can
+// collide at the access point mid-frame. With RTS/CTS a short RTS reserves the medium and
+// the access point's CTS sets the NAV of every station in its range, hidden ones included.
+// Only frames a station decodes set its NAV: one it heard overlapping another is garbled.
+class CsmaCa : public AccessControlProtocol {
+public:
+    static constexpr SimTime SLOT = 9 * MICROSECOND;
+    static constexpr SimTime SIFS = 16 * MICROSECOND;
+    static constexpr SimTime DIFS = SIFS + 2 * SLOT;
+    static constexpr SimTime PREAMBLE = 20 * MICROSECOND; // PHY preamble and header, ahead of every frame
+    static constexpr int CW_MIN = 15;
+    static constexpr int CW_MAX = 1023;
+    static constexpr int RETRY_LIMIT = 7;
+    static constexpr int RTS_BYTES = 20;
+    static constexpr int CTS_BYTES = 14;
+    static constexpr int ACK_BYTES = 14;
+    static constexpr int MAC_OVERHEAD = 34; // Data frame header and FCS
+
+    struct Stats {
+        long long frames_sent = 0;   // Acknowledged data frames
+        long long attempts = 0;      // Backoff expiries, each starting an RTS or data frame
+        long long collisions = 0;    // RTS or data frames lost at the access point
+        long long drops = 0;         // Frames given up after the retry limit
+        SimTime total_delay = 0;     // Head of queue to acknowledgement
+    };
+
+private:
+    enum FrameKind { FRAME_RTS, FRAME_CTS, FRAME_DATA, FRAME_ACK };
+    struct Station {
+        deque<SimTime> queue;        // Arrival time of each waiting frame
+        int cw = CW_MIN;
+        int retries = 0;
+        int backoff = 0;             // Slots left to count down
+        bool contending = false;     // Has a head frame and is not in the middle of an exchange
+        SimTime countdown_from = -1; // When the running countdown started, -1 while frozen
+        int audible = 0;             // Transmissions this station hears right now
+        SimTime idle_since = 0;      // When the medium last went quiet around it, its own frames included
+        SimTime last_overlap = -1;   // Last time it heard two at once; frames it heard then are garbled
+        SimTime nav_until = 0;       // Virtual carrier sense, from RTS and CTS frames it decoded
+        int heap_index = -1;         // Position in the expiry heap while counting down
+        SimTime head_since = 0;      // When the head frame reached the front
+        long long delivered = 0;
+    };
+    struct Transmission {
+        int sender;
+        int station;                 // The station whose exchange this frame belongs to
+        FrameKind kind;
+        SimTime start;
+        SimTime end;
+        SimTime nav = 0;             // RTS and CTS: end of the exchange they announce
+        bool corrupted = false;      // Overlapped another frame at the access point
+    };
+    int station_count;
+    int access_point;                // Index after the stations in the matrix
+    size_t row_words;
+    vector<uint64_t> reach;          // reach[a * row_words + b / 64] bit b: a and b hear each other
+    vector<Station> stations;
+    long long bit_rate;
+    int data_bytes;
+    bool rts_cts;
+    bool saturated;
+    int retry_limit;
+    vector<Transmission> transmissions;
+    vector<int> free_transmissions;
+    vector<int> at_access_point;     // Transmissions the access point is hearing
+    bool ap_transmitting;
+    // Running countdowns ordered by expiry. One scheduler event stands for the earliest, so a
+    // freeze or resume is a heap update rather than an event.
+    vector<pair<SimTime, int>> expiries; // Binary min-heap of (expiry, station)
+    SimTime armed_at;                    // Time of the pending wake-up event, -1 if none
+    long long arm_generation;
+    minstd_rand rng;
+    Stats stats;
+
+    SimTime airtime(int bytes) const {
+        return PREAMBLE + bytes * 8LL * SECOND / bit_rate;
+    }
+
+    bool hears(int a, int b) const {
+        return (reach[a * row_words + b / 64] >> (b % 64)) & 1;
+    }
+
+    // Stops the countdown and banks the slots that went by. A counter reaching zero this very
+    // instant can no longer be stopped: the station could not have sensed the other frame yet.
+    void freeze(Station& station) {
+        if (station.countdown_from < 0) {
+            return;
+        }
+        SimTime now = simulator.now();
+        if (station.countdown_from + station.backoff * SLOT == now) {
+            return;
+        }
+        if (now > station.countdown_from) {
+            station.backoff -= (int)min<SimTime>(station.backoff, (now - station.countdown_from) / SLOT);
+        }
+        station.countdown_from = -1;
+        removeExpiry(station.heap_index);
+    }
+
+    void resume(int id) {
+        Station& station = stations[id];
+        if (!station.contending || station.audible > 0 || station.countdown_from >= 0) {
+            return;
+        }
+        // Slots count from DIFS after the medium cleared, on the grid every station that saw it
+        // clear shares, even if this one only drew its backoff later (after an ACK timeout)
+        SimTime now = simulator.now();
+        SimTime start = max(station.idle_since, station.nav_until) + DIFS;
+        if (start < now) {
+            start += (now - start + SLOT - 1) / SLOT * SLOT;
+        }
+        station.countdown_from = start;
+        expiries.push_back({station.countdown_from + station.backoff * SLOT, id});
+        station.heap_index = (int)expiries.size() - 1;
+        siftUp(station.heap_index);
+        arm();
+    }
+
+    void placeExpiry(int index, const pair<SimTime, int>& entry) {
+        expiries[index] = entry;
+        stations[entry.second].heap_index = index;
+    }
+
+    void siftUp(int index) {
+        pair<SimTime, int> entry = expiries[index];
+        while (index > 0 && entry < expiries[(index - 1) / 2]) {
+            placeExpiry(index, expiries[(index - 1) / 2]);
+            index = (index - 1) / 2;
+        }
+        placeExpiry(index, entry);
+    }
+
+    void siftDown(int index) {
+        pair<SimTime, int> entry = expiries[index];
+        int size = (int)expiries.size();
+        while (2 * index + 1 < size) {
+            int child = 2 * index + 1;
+            if (child + 1 < size && expiries[child + 1] < expiries[child]) {
+                child++;
+            }
+            if (!(expiries[child] < entry)) {
+                break;
+            }
+            placeExpiry(index, expiries[child]);
+            index = child;
+        }
+        placeExpiry(index, entry);
+    }
+
+    void removeExpiry(int index) {
+        if (index < 0) {
+            return;
+        }
+        stations[expiries[index].second].heap_index = -1;
+        pair<SimTime, int> last = expiries.back();
+        expiries.pop_back();
+        if (index < (int)expiries.size()) {
+            placeExpiry(index, last);
+            siftUp(index);
+            siftDown(stations[last.second].heap_index);
+        }
+    }
+
+    // Keeps one wake-up event pending for the earliest countdown
+    void arm() {
+        if (expiries.empty()) {
+            return;
+        }
+        SimTime next = expiries[0].first;
+        if (armed_at >= 0 && armed_at <= next) {
+            return; // The pending event comes first and re-arms when it fires
+        }
+        armed_at = next;
+        long long generation = ++arm_generation;
+        simulator.scheduleAt(next, [this, generation]() {
+            if (generation != arm_generation) {
+                return;
+            }
+            armed_at = -1;
+            // Every counter reaching zero now transmits, even if an earlier one just started
+            while (!expiries.empty() && expiries[0].first <= simulator.now()) {
+                int id = expiries[0].second;
+                removeExpiry(0);
+                expire(id);
+            }
+            arm();
+        });
+    }
+
+    void expire(int id) {
+        Station& station = stations[id];
+        station.backoff = 0;
+        station.countdown_from = -1;
+        station.contending = false;
+        stats.attempts++;
+        startFrame(id, id, rts_cts ? FRAME_RTS : FRAME_DATA);
+    }
+
+    void startFrame(int sender, int id, FrameKind kind) {
+        SimTime now = simulator.now();
+        int bytes = kind == FRAME_RTS ? RTS_BYTES : kind == FRAME_CTS ? CTS_BYTES : kind == FRAME_ACK ? ACK_BYTES
+                                                                                   : data_bytes + MAC_OVERHEAD;
+        Transmission transmission;
+        transmission.sender = sender;
+        transmission.station = id;
+        transmission.kind = kind;
+        transmission.start = now;
+        transmission.end = now + airtime(bytes);
+        // RTS and CTS announce how long the rest of the exchange keeps the medium
+        if (kind == FRAME_RTS) {
+            transmission.nav = transmission.end + 3 * SIFS + airtime(CTS_BYTES) + airtime(data_bytes + MAC_OVERHEAD) +
+                               airtime(ACK_BYTES);
+        } else if (kind == FRAME_CTS) {
+            transmission.nav = transmission.end + 2 * SIFS + airtime(data_bytes + MAC_OVERHEAD) + airtime(ACK_BYTES);
+        }
+        int tx;
+        if (!free_transmissions.empty()) {
+            tx = free_transmissions.back();
+            free_transmissions.pop_back();
+            transmissions[tx] = transmission;
+        } else {
+            tx = (int)transmissions.size();
+            transmissions.push_back(transmission);
+        }
+        if (sender == access_point) {
+            ap_transmitting = true;
+            for (int other : at_access_point) {
+                transmissions[other].corrupted = true; // Half duplex: it cannot listen while sending
+            }
+        } else if (hears(access_point, sender)) {
+            if (ap_transmitting || !at_access_point.empty()) {
+                transmissions[tx].corrupted = true;
+                for (int other : at_access_point) {
+                    transmissions[other].corrupted = true;
+                }
+            }
+            at_access_point.push_back(tx);
+        }
+        const uint64_t* row = &reach[sender * row_words];
+        for (size_t w = 0; w < row_words; w++) {
+            for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1) {
+                int other = (int)(w * 64 + __builtin_ctzll(bits));
+                if (other == sender || other == access_point) {
+                    continue;
+                }
+                Station& station = stations[other];
+                if (station.audible++ == 0) {
+                    freeze(station);
+                } else {
+                    station.last_overlap = now;
+                }
+            }
+        }
+        simulator.scheduleAt(transmission.end, [this, tx]() { endFrame(tx); });
+    }
+
+    void endFrame(int tx) {
+        Transmission transmission = transmissions[tx];
+        free_transmissions.push_back(tx);
+        if (transmission.sender == access_point) {
+            ap_transmitting = false;
+        } else {
+            auto it = find(at_access_point.begin(), at_access_point.end(), tx);
+            if (it != at_access_point.end()) {
+                *it = at_access_point.back();
+                at_access_point.pop_back();
+            }
+        }
+        int sender = transmission.sender;
+        SimTime now = simulator.now();
+        const uint64_t* row = &reach[sender * row_words];
+        for (size_t w = 0; w < row_words; w++) {
+            for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1) {
+                int other = (int)(w * 64 + __builtin_ctzll(bits));
+                if (other == sender || other == access_point) {
+                    continue;
+                }
+                Station& station = stations[other];
+                if (station.last_overlap < transmission.start) {
+                    station.nav_until = max(station.nav_until, transmission.nav); // Decoded cleanly
+                }
+                if (station.audible-- > 1) {
+                    station.last_overlap = now;
+                } else {
+                    station.idle_since = now;
+                    resume(other);
+                }
+            }
+        }
+        if (sender != access_point && stations[sender].audible == 0) {
+            stations[sender].idle_since = now;
+        }
+        int id = transmission.station;
+        bool reached = transmission.sender == access_point || (hears(access_point, sender) && !transmission.corrupted);
+        switch (transmission.kind) {
+        case FRAME_RTS:
+        case FRAME_DATA:
+            if (reached) {
+                FrameKind reply = transmission.kind == FRAME_RTS ? FRAME_CTS : FRAME_ACK;
+                simulator.scheduleAt(now + SIFS, [this, id, reply]() { startFrame(access_point, id, reply); });
+            } else {
+                stats.collisions++;
+                SimTime timeout = SIFS + airtime(transmission.kind == FRAME_RTS ? CTS_BYTES : ACK_BYTES) + SLOT;
+                simulator.scheduleAt(now + timeout, [this, id]() { failed(id); });
+            }
+            break;
+        case FRAME_CTS:
+            simulator.scheduleAt(now + SIFS, [this, id]() { startFrame(id, id, FRAME_DATA); });
+            break;
+        case FRAME_ACK:
+            succeeded(id);
+            break;
+        }
+    }
+
+    void succeeded(int id) {
+        Station& station = stations[id];
+        stats.frames_sent++;
+        stats.total_delay += simulator.now() - station.head_since;
+        station.delivered++;
+        station.queue.pop_front();
+        station.cw = CW_MIN;
+        station.retries = 0;
+        nextFrame(id);
+    }
+
+    void failed(int id) {
+        Station& station = stations[id];
+        if (++station.retries > retry_limit) {
+            stats.drops++;
+            station.queue.pop_front();
+            station.cw = CW_MIN;
+            station.retries = 0;
+            nextFrame(id);
+            return;
+        }
+        station.cw = min(2 * station.cw + 1, CW_MAX);
+        contend(id);
+    }
+
+    void nextFrame(int id) {
+        Station& station = stations[id];
+        if (saturated && station.queue.empty()) {
+            station.queue.push_back(simulator.now());
+        }
+        if (!station.queue.empty()) {
+            station.head_since = max(station.queue.front(), simulator.now());
+            contend(id);
+        }
+    }
+
+    void contend(int id) {
+        Station& station = stations[id];
+        station.backoff = rng() % (station.cw + 1);
+        station.contending = true;
+        station.countdown_from = -1;
+        resume(id);
+    }
+
+public:
+    CsmaCa(int stations, long long bit_rate = 54000000LL, int data_bytes = 1500, bool rts_cts = false, unsigned seed = 1) {
+        station_count = stations;
+        access_point = stations;
+        row_words = (stations + 1 + 63) / 64;
+        reach.assign((size_t)(stations + 1) * row_words, ~0ULL); // Everyone in range of everyone
+        if ((stations + 1) % 64 != 0) {
+            for (int row = 0; row <= stations; row++) {
+                reach[(row + 1) * row_words - 1] = (1ULL << ((stations + 1) % 64)) - 1;
+            }
+        }
+        this->stations.resize(stations);
+        this->bit_rate = bit_rate;
+        this->data_bytes = data_bytes;
+        this->rts_cts = rts_cts;
+        saturated = false;
+        retry_limit = RETRY_LIMIT;
+        ap_transmitting = false;
+        armed_at = -1;
+        arm_generation = 0;
+        rng.seed(seed);
+    }
+
+    // Stations out of each other's range cannot sense each other's frames. Every station is
+    // expected to stay in range of the access point.
+    void setReachable(int a, int b, bool reachable) {
+        for (int pass = 0; pass < 2; pass++) {
+            uint64_t& word = reach[a * row_words + b / 64];
+            word = reachable ? word | (1ULL << (b % 64)) : word & ~(1ULL << (b % 64));
+            swap(a, b);
+        }
+    }
+
+    bool isReachable(int a, int b) const {
+        return hears(a, b);
+    }
+
+    int getAccessPoint() const {
+        return access_point;
+    }
+
+    // Retransmissions before a frame is dropped; analytic models usually assume no limit
+    void setRetryLimit(int limit) {
+        retry_limit = limit;
+    }
+
+    // Every station always has another frame waiting
+    void setSaturated(bool enabled) {
+        saturated = enabled;
+        if (enabled) {
+            for (int id = 0; id < station_count; id++) {
+                if (stations[id].queue.empty()) {
+                    enqueue(id);
+                }
+            }
+        }
+    }
+
+    void enqueue(int id) {
+        Station& station = stations[id];
+        station.queue.push_back(simulator.now());
+        if (station.queue.size() == 1) {
+            station.head_since = simulator.now();
+            station.cw = CW_MIN;
+            station.retries = 0;
+            contend(id);
+        }
+    }
+
+    // Carrier sense at the access point
+    bool canSendPacket() override {
+        return !ap_transmitting && at_access_point.empty();
+    }
+
+    // Share of the channel's time spent on payload that was acknowledged
+    double throughput(SimTime elapsed) const {
+        return elapsed > 0 ? (double)stats.frames_sent * data_bytes * 8 * SECOND / bit_rate / elapsed : 0;
+    }
+
+    // Jain's index over per-station deliveries: 1 when all stations got the same share
+    double fairness() const {
+        double sum = 0, squares = 0;
+        for (const Station& station : stations) {
+            sum += station.delivered;
+            squares += (double)station.delivered * station.delivered;
+        }
+        return squares > 0 ? sum * sum / (station_count * squares) : 1;
+    }
+
+    SimTime dataAirtime() const {
+        return airtime(data_bytes + MAC_OVERHEAD);
+    }
+
+    SimTime controlAirtime(int bytes) const {
+        return airtime(bytes);
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+};
+
+class Hub : public EndDevice {
+private:
+    int hub_id;
+    string hub_name;
+    vector<EndDevice*> connected_devices;
+    vector<Hub*> connected_hubs;
+    unique_ptr<CsmaCd> medium;                 // Contention among the attached stations, nullptr for an ideal repeater
+    unordered_map<Layer2Device*, int> station_ids;
+    vector<Layer2Device*> station_devices;     // Medium station index -> device
+
+public:
+    Hub(int id, string name, int device_id, string device_name, string ip_address, string mac_address, Network* net)
+        : EndDevice(0, "", device_id, device_name, net, mac_address, "") {
+        hub_id = id;
+        hub_name = name;
+        network = net;
+    }
+
+    int getHubId() {
+        return hub_id;
+    }
+
+    string getHubName() {
+        return hub_name;
+    }
+
+    vector<EndDevice*> getConnectedDevices() {
+        return connected_devices;
+    }
+
+    vector<Hub*> getConnectedHubs() {
+        return connected_hubs;
+    }
+
+    DomainRole domainRole() const override {
+        return DOMAIN_REPEATER;
+    }
+
+    void connectDevice(EndDevice* device) {
+        connected_devices.push_back(device);
+        domains.connect(this, DOMAIN_REPEATER, device, device->domainRole());
+        device->attachTo(this);
+        device->connect();
+    }
+
+    void disconnectDevice(EndDevice* device) {
+        connected_devices.erase(remove(connected_devices.begin(), connected_devices.end(), device), connected_devices.end());
+        domains.disconnect(this, device);
+        if (device->getUplink() == this) {
+            device->attachTo(nullptr);
+        }
+        device->disconnect();
+    }
+
+    // A hub is a repeater: every frame goes out of every other port
+    void receiveFrame(const Frame& frame, Layer2Device* from) override {
+        repeat(frame, from);
+    }
+
+    void repeat(const Frame& frame, Layer2Device* from) {
+        for (EndDevice* device : connected_devices) {
+            if (device != from) {
+                transmitFrame(device, frame);
+            }
+        }
+        for (Hub* hub : connected_hubs) {
+            if (hub != from) {
+                transmitFrame(hub, frame);
+            }
+        }
+        Layer2Device* up = getUplink();
+        bool uplinkListed = find(connected_devices.begin(), connected_devices.end(), up) != connected_devices.end() ||
+                            find(connected_hubs.begin(), connected_hubs.end(), up) != connected_hubs.end();
+        if (up != nullptr && up != from && !uplinkListed) {
+            transmitFrame(up, frame);
+        }
+    }
+
+    // Makes the segment a shared half-duplex medium: stations' frames contend under CSMA/CD
+    // and only those that get through are repeated
+    void enableCsmaCd(long long bit_rate = 10000000LL, SimTime propagation = 2 * LINK_DELAY) {
+        medium.reset(new CsmaCd(bit_rate, propagation, getDeviceId() + 1));
+        station_ids.clear();
+        station_devices.clear();
+        medium->onDelivered([this](int station, const Frame& frame) { repeat(frame, station_devices[station]); });
+    }
+
+    CsmaCd* getCsmaCd() {
+        return medium.get();
+    }
+
+    bool acceptFromStation(Layer2Device* station, const Frame& frame) override {
+        if (medium == nullptr) {
+            return false;
+        }
+        auto it = station_ids.find(station);
+        if (it == station_ids.end()) {
+            it = station_ids.emplace(station, medium->addStation()).first;
+            station_devices.push_back(station);
+        }
+        medium->enqueue(it->second, frame);
+        return true;
+    }
+
+    void connectHub(Hub* hub) {
+        connected_hubs.push_back(hub);
+        hub->connectDevice(this);
+        connect();
+    }
+
+    void disconnectHub(Hub* hub) {
+        auto it = find(connected_hubs.begin(), connected_hubs.end(), hub);
+        if (it != connected_hubs.end()) {
+            connected_hubs.erase(it);
+            hub->disconnectDevice(this);
+            disconnect();
+        }
+    }
+
+    void printConnectedHubs(){
+        cout << "Connected Hubs for " << getDeviceName() << ": " << endl;
+        for (const auto& hub : connected_hubs) {
+            cout << hub->getHubName() << endl;
+        }
+    }
+};
+
+class Router : public EndDevice {
+private:
+    int router_id;
+    string router_name;
+    vector<EndDevice*> connected_devices;
+    vector<Hub*> connected_hubs;
+    RoutingTable routingTable; // Add an instance of the RoutingTable class
+    Network* network;
+    vector<Router*> connected_routers;
+    RoutingProtocol* routingProtocol;
+    unordered_map<string, bool> link_up; // Neighbour router IP -> link state as detected by this router
+    bool fast_reroute;
+    unordered_map<string, string> pending_updates; // Updates coalesced until the next FIB commit
+    bool flush_scheduled;
+    SimTime update_holddown; // How long update bursts are coalesced before one batched commit
+    RouteFlapDamper* damper;
+    set<string> damped_out; // Suppressed prefixes already pulled from the FIB
+    long long updates_received;
+    long long fib_commits;
+    long long routes_committed;
+    long long updates_suppressed;
+    PacketClassifier* ingress_acl; // Checked on every packet routed, nullptr to permit all
+    long long acl_drops;
+    long long ttl_drops;
+    long long packets_routed;
+    
+
+    public:
+    string subnetMask;
+
+    Router(int id, string name, int device_id, string device_name, string ip_address, string mac_address, string subnetMask )
+        : EndDevice(0, "", device_id, device_name, nullptr, mac_address, subnetMask){
+        
+        router_id = id;
+        router_name = name; 
+        network = nullptr;
+        routingProtocol = nullptr;
+        fast_reroute = false;
+        flush_scheduled = false;
+        update_holddown = 0;
+        damper = nullptr;
+        updates_received = 0;
+        fib_commits = 0;
+        routes_committed = 0;
+        updates_suppressed = 0;
+        ingress_acl = nullptr;
+        acl_drops = 0;
+        ttl_drops = 0;
+        packets_routed = 0;
+        this->subnetMask = subnetMask;
+        setIpAddress(ip_address);
+    }
+
+    int getRouterId() {
+        return router_id;
+    }
+
+    string getRouterName() {
+        return router_name;
+    }
+
+    vector<EndDevice*> getConnectedDevices() {
+        return connected_devices;
+    }
+
+    vector<Hub*> getConnectedHubs() {
+        return connected_hubs;
+    }
+
+    void addStaticRoute(const string& destinationIP, const string& nextHopIP) {
+        routingTable.addStaticRoute(destinationIP, nextHopIP);
+    }
+
+    void addDynamicRoute(const string& destinationIP, const string& nextHopIP) {
+        routingTable.addDynamicRoute(destinationIP, nextHopIP);
+    }
+
+    string getNextHop(const string& destinationIP) {
+        return routingTable.getNextHop(destinationIP);
+    }
+
+    DomainRole domainRole() const override {
+        return DOMAIN_ROUTER;
+    }
+
+    void connectDevice(EndDevice* device) {
+        connected_devices.push_back(device);
+        domains.connect(this, DOMAIN_ROUTER, device, device->domainRole());
+        device->connect();
+    }
+
+    void disconnectDevice(EndDevice* device) {
+        connected_devices.erase(remove(connected_devices.begin(), connected_devices.end(), device), connected_devices.end());
+        domains.disconnect(this, device);
+        device->disconnect();
+    }
+
+    void printConnectedDevices() {
+        cout << "Connected Devices to " << router_name << ": " << endl;
+        for (const auto& device : connected_devices) {
+            cout << "ID: " << device->getDeviceId() << ", Name: " << device->getDeviceName() << ", IP: " << device->getIpAddress() << endl;
+        }
+    }
+
+
+    void connectHub(Hub* hub) {
+        connected_hubs.push_back(hub);
+        domains.connect(this, DOMAIN_ROUTER, hub, DOMAIN_REPEATER);
+    }
+
+    void disconnectHub(Hub* hub) {
+        auto it = find(connected_hubs.begin(), connected_hubs.end(), hub);
+    if (it != connected_hubs.end()) {
+        connected_hubs.erase(it);
+        hub->disconnectDevice(this); // Also takes the cable out of the domain count
+        disconnect();
+    }
+    }
+
+     RoutingTable& getRoutingTable() { // Add this method to retrieve the routing table
+        return routingTable;
+    }
+
+     void setRoutingProtocol(RoutingProtocol* protocol) {
+        routingProtocol = protocol;
+    }
+
+    // Point-to-point link to another router, advertised into the link-state database
+    void connectRouter(Router* router, int cost, LinkStateDatabase* lsdb) {
+        connected_routers.push_back(router);
+        router->connected_routers.push_back(this);
+        domains.connect(this, DOMAIN_ROUTER, router, DOMAIN_ROUTER);
+        link_up[router->getIpAddress()] = true;
+        router->link_up[getIpAddress()] = true;
+        lsdb->setLink(getIpAddress(), router->getIpAddress(), cost);
+    }
+
+    vector<Router*> getConnectedRouters() {
+        return connected_routers;
+    }
+
+    // Called when the failure detector reports a link change; O(1) so the data plane can react immediately
+    void setLinkState(const string& neighbourIP, bool up) {
+        auto it = link_up.find(neighbourIP);
+        if (it != link_up.end()) {
+            it->second = up;
+        }
+    }
+
+    bool isLinkUp(const string& neighbourIP) {
+        auto it = link_up.find(neighbourIP);
+        return it == link_up.end() || it->second;
+    }
+
+    void setFastReroute(bool enabled) {
+        fast_reroute = enabled;
+    }
+
+    // Data-plane lookup: primary next hop, or the precomputed loop-free alternate when
+    // fast reroute is on and the primary link is down. Returns "" when the packet is dropped.
+    string forwardPacket(const string& destinationIP) {
+        string nextHopIP = routingTable.getNextHop(destinationIP);
+        if (nextHopIP.empty() || isLinkUp(nextHopIP)) {
+            return nextHopIP;
+        }
+        if (fast_reroute) {
+            string backupIP = routingTable.getBackupHop(destinationIP);
+            if (!backupIP.empty() && isLinkUp(backupIP)) {
+                return backupIP;
+            }
+        }
+        return "";
+    }
+
+    void setIngressAcl(PacketClassifier* acl) {
+        ingress_acl = acl;
+    }
+
+    long long getAclDrops() {
+        return acl_drops;
+    }
+
+    long long getTtlDrops() {
+        return ttl_drops;
+    }
+
+    long long getPacketsRouted() {
+        return packets_routed;
+    }
+
+    // Routes a received IPv4 frame: the ingress access list first, then the TTL and the next-hop
+    // lookup, then out towards the next hop with this router as the new source MAC.
+    // Returns the next hop, or "" when the packet is dropped.
+    string forwardFrame(const Frame& frame) {
+        if (ingress_acl != nullptr && ingress_acl->classify(packetHeader(frame, frame.vlan_id)) == ACL_DENY) {
+            acl_drops++;
+            return "";
+        }
+        if (frame.ttl <= 1) {
+            ttl_drops++; // Would leave with a TTL of 0, so a routing loop can't keep it alive
+            return "";
+        }
+        string nextHopIP = forwardPacket(frame.target_ip);
+        if (nextHopIP.empty()) {
+            packets_dropped++;
+            return "";
+        }
+        Frame out = frame;
+        out.src_mac = getMacAddress();
+        out.src_key = macKey(out.src_mac);
+        out.ttl = frame.ttl - 1;
+        packets_routed++;
+        sendToNeighbour(nextHopIP, out);
+        return nextHopIP;
+    }
+
+    // IPv4 frames sent to this router's MAC for some other address are routed; everything
+    // else (ARP, packets for the router itself) is handled as on any host
+    void receiveFrame(const Frame& frame, Layer2Device* from) override {
+        if (frame.ether_type != ETHERTYPE_IPV4 || frame.dst_mac != getMacAddress() || frame.target_ip == getIpAddress()) {
+            EndDevice::receiveFrame(frame, from);
+            return;
+        }
+        if (frameChecksum(frame) != frame.fcs) {
+            fcs_errors++;
+            return;
+        }
+        forwardFrame(frame);
+    }
+
+    bool sendPacket(const string& destinationIP, const string& packet) {
+        string nextHopIP = forwardPacket(destinationIP);
+        if (nextHopIP != "") {
+            cout << "Sending packet '" << packet << "' from " << router_name << " to " << nextHopIP << endl;
+            return true;
+        }
+        cout << "No route found for destination IP " << destinationIP << " in " << router_name << endl;
+        return false;
+    }
+
+    void updateRoutingTable() {
+        // Simulating dynamic routing updates
+        unordered_map<string, string> dynamicRoutes;
+
+        // Generate random dynamic routes for testing
+        dynamicRoutes["192.168.0.0"] = "192.168.1.1";
+        dynamicRoutes["10.0.0.0"] = "10.0.0.1";
+
+        updateRoutingTable(dynamicRoutes);
+    }
+
+    void setUpdateHolddown(SimTime holddown) {
+        update_holddown = holddown;
+    }
+
+    void setFlapDamping(RouteFlapDamper* flapDamper) {
+        damper = flapDamper;
+    }
+
+    // Queues routing updates; a burst arriving within the hold-down is committed as one batch.
+    // An empty next hop withdraws the route.
+    void updateRoutingTable(const unordered_map<string, string>& routes) {
+        for (const auto& route : routes) {
+            pending_updates[route.first] = route.second;
+        }
+        updates_received += routes.size();
+        if (!flush_scheduled) {
+            flush_scheduled = true;
+            simulator.schedule(update_holddown, [this]() { flushRoutingUpdates(); });
+        }
+    }
+
+    void flushRoutingUpdates() {
+        flush_scheduled = false;
+        unordered_map<string, string> batch;
+        for (const auto& update : pending_updates) {
+            if (damper != nullptr && !damper->recordUpdate(update.first, update.second, simulator.now())) {
+                if (damper->claimReuseTimer(update.first)) {
+                    scheduleReuseCheck(update.first);
+                }
+                if (!update.second.empty()) {
+                    updates_suppressed++;
+                }
+                // Damping holds back advertisements only: a suppressed prefix leaves the FIB rather
+                // than keep a next hop that may be gone, and withdrawals always take effect
+                if (damped_out.insert(update.first).second) {
+                    batch[update.first] = "";
+                }
+                continue;
+            }
+            damped_out.erase(update.first);
+            batch.insert(update);
+        }
+        pending_updates.clear();
+        if (!batch.empty() && routingProtocol != nullptr) {
+            routingProtocol->updateRoutingTable(batch);
+            fib_commits++;
+            routes_committed += batch.size();
+        }
+    }
+
+    long long getUpdatesReceived() {
+        return updates_received;
+    }
+
+    long long getFibCommits() {
+        return fib_commits;
+    }
+
+    long long getRoutesCommitted() {
+        return routes_committed;
+    }
+
+    long long getUpdatesSuppressed() {
+        return updates_suppressed;
+    }
+
+    void printRoutingTable() {
+        routingTable.printRoutingTable();
+    }
+
+private:
+    void scheduleReuseCheck(const string& prefix) {
+        simulator.schedule(damper->reuseDelay(prefix, simulator.now()), [this, prefix]() {
+            string nextHop;
+            if (damper->releaseIfReusable(prefix, simulator.now(), nextHop)) {
+                updateRoutingTable({{prefix, nextHop}});
+            } else if (damper->claimReuseTimer(prefix)) {
+                scheduleReuseCheck(prefix);
+            }
+        });
+    }
+
+public:
+
+
+    void performStaticRouting(const string& destinationIP) {
+        string nextHopIP = routingTable.getNextHop(destinationIP);
+        if (!nextHopIP.empty()) {
+            cout << "Performing static routing for destination IP: " << destinationIP << endl;
+            cout << "Next hop IP: " << nextHopIP << endl;
+        } else {
+            cout << "No static route found for destination IP: " << destinationIP << endl;
+        }
+    }
+};
+
+
+class FlowControlProtocol {
+public:
+    virtual bool canSendPacket(const std::string& destination_mac, int seqNum) = 0;
+    virtual void receiveAck(int ackNum) = 0;
+};
+
+// A data segment for the sliding-window protocols; bytes is its size on the wire
+struct ArqSegment {
+    int seq;
+    int bytes;
+    string payload;
+};
+
+// One direction of a point-to-point link for the ARQ studies, in virtual time. Frames queue
+// behind each other for serialisation, then take the propagation delay, and each one is
+// dropped independently with the given probability.
+class LossyLink {
+private:
+    SimTime delay;
+    double bits_per_ns;
+    double loss;
+    SimTime busy_until;
+    mt19937_64 gen;
+    long long frames_sent;
+    long long frames_dropped;
+
+public:
+    LossyLink(SimTime delay, double bits_per_second, double loss, uint64_t seed = 1) : gen(seed) {
+        this->delay = delay;
+        this->bits_per_ns = bits_per_second / SECOND;
+        this->loss = loss;
+        busy_until = 0;
+        frames_sent = 0;
+        frames_dropped = 0;
+    }
+
+    void transmit(int bytes, function<void()> deliver) {
+        busy_until = max(busy_until, simulator.now()) + (SimTime)(bytes * 8 / bits_per_ns);
+        frames_sent++;
+        if (loss > 0 && uniform_real_distribution<double>(0, 1)(gen) < loss) {
+            frames_dropped++;
+            return;
+        }
+        simulator.scheduleAt(busy_until + delay, deliver);
+    }
+
+    // Serialisation time of one frame
+    SimTime frameTime(int bytes) const {
+        return (SimTime)(bytes * 8 / bits_per_ns);
+    }
+
+    SimTime getDelay() const {
+        return delay;
+    }
+
+    long long getFramesSent() const {
+        return frames_sent;
+    }
+
+    long long getFramesDropped() const {
+        return frames_dropped;
+    }
+};
+
+// Go-Back-N sender. Segments in flight sit in a ring buffer of windowSize slots (slot
+// seq % windowSize), so at most windowSize are unacknowledged. ACKs are cumulative: an ACK
+// for n covers everything up to n and slides the window past it. A single timer runs for the
+// oldest outstanding segment; when it expires, every outstanding segment is sent again.
+// canSendPacket/receiveAck keep the window bookkeeping for callers that number their own
+// packets; connect() and send() add the data path, with the timer in virtual time.
+class GoBackN : public FlowControlProtocol {
+public:
+    struct Stats {
+        long long segments_sent = 0;
+        long long retransmissions = 0;
+        long long timeouts = 0;
+        long long acked = 0;
+    };
+
+private:
+    int windowSize_;
+    int Sf;                       // Oldest unacknowledged sequence number
+    int Sn;                       // Next sequence number to send
+    vector<ArqSegment> window;    // Ring buffer of the segments in [Sf, Sn)
+    deque<ArqSegment> backlog;    // Accepted from the application, waiting for window space
+    function<void(const ArqSegment&)> transmit_;
+    SimTime timeout;
+    uint64_t timer_generation;    // Bumped to cancel the pending timeout
+    bool timer_running;
+    Stats stats;
+
+    void startTimer() {
+        uint64_t generation = ++timer_generation;
+        timer_running = true;
+        simulator.schedule(timeout, [this, generation]() {
+            if (generation == timer_generation) {
+                onTimeout();
+            }
+        });
+    }
+
+    void stopTimer() {
+        timer_generation++;
+        timer_running = false;
+    }
+
+    void onTimeout() {
+        timer_running = false;
+        if (Sf == Sn) {
+            return;
+        }
+        stats.timeouts++;
+        for (int seq = Sf; seq < Sn; seq++) {
+            stats.retransmissions++;
+            stats.segments_sent++;
+            transmit_(window[seq % windowSize_]);
+        }
+        startTimer();
+    }
+
+    void fillWindow() {
+        while (!backlog.empty() && Sn < Sf + windowSize_) {
+            ArqSegment& segment = window[Sn % windowSize_];
+            segment = move(backlog.front());
+            backlog.pop_front();
+            segment.seq = Sn++;
+            stats.segments_sent++;
+            transmit_(segment);
+            if (!timer_running) {
+                startTimer();
+            }
+        }
+    }
+
+public:
+    GoBackN(int windowSize) : windowSize_(max(windowSize, 1)), Sf(1), Sn(1), timeout(0), timer_generation(0), timer_running(false) {
+        window.resize(windowSize_);
+    }
+
+    bool canSendPacket(const std::string& destination_mac, int seqNum) override {
+        if (seqNum >= Sf && seqNum < Sf + windowSize_) {
+            if (verbose) {
+                std::cout << "Sending packet with sequence number " << seqNum << std::endl;
+            }
+            Sn = max(Sn, seqNum + 1);
+            return true;
+        }
+        if (verbose) {
+            std::cout << "Window is full. Waiting for acknowledgements..." << std::endl;
+        }
+        return false;
+    }
+
+    // Cumulative: acknowledges every segment up to ackNum. Duplicates and stale ACKs are ignored.
+    void receiveAck(int ackNum) override {
+        if (ackNum < Sf || ackNum >= Sn) {
+            return;
+        }
+        if (verbose) {
+            std::cout << "Received acknowledgement for packet with sequence number " << ackNum << std::endl;
+        }
+        stats.acked += ackNum + 1 - Sf;
+        Sf = ackNum + 1;
+        if (!transmit_) {
+            return;
+        }
+        if (Sf == Sn) {
+            stopTimer();
+        } else {
+            startTimer(); // Restart for the new oldest outstanding segment
+        }
+        fillWindow();
+    }
+
+    // Where segments go, and how long to wait for an ACK before going back
+    void connect(function<void(const ArqSegment&)> transmit, SimTime timeout) {
+        transmit_ = transmit;
+        this->timeout = timeout;
+    }
+
+    // Queues a segment; bytes defaults to the payload plus a 20-byte header
+    void send(const string& payload, int bytes = 0) {
+        backlog.push_back({0, bytes > 0 ? bytes : (int)payload.size() + 20, payload});
+        if (transmit_) {
+            fillWindow();
+        }
+    }
+
+    // Nothing queued or in flight
+    bool idle() const {
+        return backlog.empty() && Sf == Sn;
+    }
+
+    int getWindowSize() const {
+        return windowSize_;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+};
+
+// Go-Back-N receiver: accepts only the next segment in order and discards everything else,
+// answering every arrival with a cumulative ACK for the last segment it accepted
+class GoBackNReceiver {
+private:
+    int expected;
+    function<void(int)> send_ack;
+    function<void(const ArqSegment&)> deliver;
+    long long delivered;
+    long long discarded;
+
+public:
+    GoBackNReceiver(function<void(int)> send_ack, function<void(const ArqSegment&)> deliver = nullptr, int first = 1) {
+        expected = first;
+        this->send_ack = send_ack;
+        this->deliver = deliver;
+        delivered = 0;
+        discarded = 0;
+    }
+
+    void receive(const ArqSegment& segment) {
+        if (segment.seq == expected) {
+            expected++;
+            delivered++;
+            if (deliver) {
+                deliver(segment);
+            }
+        } else {
+            discarded++;
+        }
+        send_ack(expected - 1);
+    }
+
+    long long getDelivered() const {
+        return delivered;
+    }
+
+    long long getDiscarded() const {
+        return discarded;
+    }
+};
+
+class StopNWait : public FlowControlProtocol {
+private:
+    int expected_seq_num;
+
+int timer; // Timer variable to track the timeout
+
+public:
+    StopNWait() {
+        expected_seq_num = 0;
+        timer = 0;
+    }
+
+    bool canSendPacket(const std::string& destination_mac, int seqNum) {
+        if (seqNum == expected_seq_num) {
+            std::cout << "Sending packet with sequence number " << seqNum << std::endl;
+            // Start the timer
+            timer = 10; // Setting the timer value to 10 (example value)
+            return true;
+        }
+        return false;
+    }
+
+    void receiveAck(int ackNum) {
+        if (ackNum == expected_seq_num) {
+            expected_seq_num++;
+            std::cout << "Received acknowledgement for packet with sequence number " << ackNum << std::endl;
+            // Reset the timer when an acknowledgment is received
+            timer = 0;
+        }
+    }
+    
+};
+
+// Bitmap over a ring of power-of-two size, indexed by sequence number
+class RingBitmap {
+private:
+    vector<uint64_t> words;
+    uint64_t mask;
+
+public:
+    RingBitmap(size_t capacity) {
+        words.assign(capacity / 64, 0);
+        mask = capacity - 1;
+    }
+
+    bool test(int seq) const {
+        uint64_t bit = (uint64_t)seq & mask;
+        return (words[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    void set(int seq) {
+        uint64_t bit = (uint64_t)seq & mask;
+        words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+
+    void clear(int seq) {
+        uint64_t bit = (uint64_t)seq & mask;
+        words[bit >> 6] &= ~(1ULL << (bit & 63));
+    }
+
+    // The 64 bits for seq .. seq + 63
+    uint64_t extract(int seq) const {
+        uint64_t bit = (uint64_t)seq & mask;
+        size_t word = bit >> 6;
+        int offset = bit & 63;
+        uint64_t low = words[word] >> offset;
+        return offset == 0 ? low : low | words[(word + 1) % words.size()] << (64 - offset);
+    }
+
+    // ORs bits in for seq .. seq + 63; returns how many were newly set
+    int merge(int seq, uint64_t bits) {
+        uint64_t bit = (uint64_t)seq & mask;
+        size_t word = bit >> 6;
+        int offset = bit & 63;
+        uint64_t low = bits << offset;
+        int added = __builtin_popcountll(low & ~words[word]);
+        words[word] |= low;
+        if (offset != 0) {
+            size_t next = (word + 1) % words.size();
+            uint64_t high = bits >> (64 - offset);
+            added += __builtin_popcountll(high & ~words[next]);
+            words[next] |= high;
+        }
+        return added;
+    }
+};
+
+// Selective Repeat acknowledgement: the cumulative point, the segment that triggered it, and
+// a SACK bitmap whose bit i says segment cumulative + 1 + i is held at the receiver
+struct SackAck {
+    int cumulative;
+    int seq;
+    uint64_t sack;
+};
+
+inline size_t ringCapacity(int window) {
+    size_t capacity = 64;
+    while (capacity < (size_t)window) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+// Selective Repeat sender. Unacknowledged segments sit in a fixed ring buffer with an acked
+// bitmap beside it, so an ACK only marks bits and slides Sf past the acknowledged prefix:
+// O(1) amortised, however large the window. A hole the receiver has seen three later
+// segments overtake is resent straight away; a recovery pointer that only moves forward
+// keeps that O(1) amortised too. Otherwise each segment has its own timer, and a timeout
+// resends that segment alone. All timers share one duration, so they expire in the order
+// they were started; they are kept in a FIFO with a single simulator event for the head,
+// and a timer is cancelled by bumping its slot's generation.
+// canSendPacket/receiveAck keep the window bookkeeping for callers that number their own
+// packets; connect() and send() add the data path.
+class SelectiveRepeat : public FlowControlProtocol {
+public:
+    struct Stats {
+        long long segments_sent = 0;
+        long long retransmissions = 0;
+        long long timeouts = 0;
+        long long fast_retransmits = 0; // Holes resent on SACK evidence rather than a timeout
+        long long acked = 0;
+    };
+
+private:
+    static constexpr int REORDER_THRESHOLD = 3; // Later segments SACKed before a hole counts as lost
+
+    struct Timer {
+        SimTime expiry;
+        int seq;
+        uint32_t generation;
+    };
+
+    int window_size;
+    size_t capacity;              // Ring size, a power of two no smaller than the window
+    int Sf;                       // Oldest unacknowledged sequence number
+    int Sn;                       // Next sequence number to send
+    vector<ArqSegment> segments;  // Ring buffer, slot seq & (capacity - 1)
+    vector<uint32_t> generation;  // Per slot, bumped on every (re)transmission
+    RingBitmap acked;
+    deque<ArqSegment> backlog;    // Accepted from the application, waiting for window space
+    deque<Timer> timers;
+    bool timer_armed;
+    int highest_sacked;           // Highest sequence number the receiver is known to hold
+    int recovery_point;           // Holes below this have already been resent
+    function<void(const ArqSegment&)> transmit_;
+    SimTime timeout;
+    Stats stats;
+
+    size_t slot(int seq) const {
+        return (size_t)seq & (capacity - 1);
+    }
+
+    void transmit(int seq) {
+        size_t index = slot(seq);
+        generation[index]++;
+        stats.segments_sent++;
+        timers.push_back({simulator.now() + timeout, seq, generation[index]});
+        transmit_(segments[index]);
+        if (!timer_armed) {
+            armTimer();
+        }
+    }
+
+    bool timerLive(const Timer& timer) const {
+        return timer.seq >= Sf && timer.seq < Sn && !acked.test(timer.seq) && generation[slot(timer.seq)] == timer.generation;
+    }
+
+    void armTimer() {
+        while (!timers.empty() && !timerLive(timers.front())) {
+            timers.pop_front();
+        }
+        timer_armed = !timers.empty();
+        if (timer_armed) {
+            simulator.scheduleAt(timers.front().expiry, [this]() { onTimer(); });
+        }
+    }
+
+    void onTimer() {
+        while (!timers.empty() && timers.front().expiry <= simulator.now()) {
+            Timer timer = timers.front();
+            timers.pop_front();
+            if (timerLive(timer)) {
+                stats.timeouts++;
+                stats.retransmissions++;
+                timer_armed = true; // transmit() must not arm a second event
+                transmit(timer.seq);
+            }
+        }
+        armTimer();
+    }
+
+    void fillWindow() {
+        while (!backlog.empty() && Sn < Sf + window_size) {
+            ArqSegment& segment = segments[slot(Sn)];
+            segment = move(backlog.front());
+            backlog.pop_front();
+            segment.seq = Sn;
+            acked.clear(Sn);
+            transmit(Sn++);
+        }
+    }
+
+    void slide() {
+        while (Sf < Sn && acked.test(Sf)) {
+            acked.clear(Sf);
+            Sf++;
+        }
+    }
+
+    // Each sequence number passes the recovery point once, so this is O(1) amortised per ACK.
+    // A resent hole that is lost again falls back to its timer.
+    void resendHoles() {
+        recovery_point = max(recovery_point, Sf);
+        for (; recovery_point + REORDER_THRESHOLD <= highest_sacked; recovery_point++) {
+            if (!acked.test(recovery_point)) {
+                stats.fast_retransmits++;
+                stats.retransmissions++;
+                transmit(recovery_point);
+            }
+        }
+    }
+
+public:
+    SelectiveRepeat(int window_size) : acked(ringCapacity(max(window_size, 1))) {
+        this->window_size = max(window_size, 1);
+        capacity = ringCapacity(this->window_size);
+        Sf = 0;
+        Sn = 0;
+        segments.resize(capacity);
+        generation.assign(capacity, 0);
+        timer_armed = false;
+        highest_sacked = -1;
+        recovery_point = 0;
+        timeout = 0;
+    }
+
+    bool canSendPacket(const std::string& destination_mac, int seqNum) {
+        if (seqNum >= Sf && seqNum < Sf + window_size && (seqNum >= Sn || !acked.test(seqNum))) {
+            if (verbose) {
+                std::cout << "Sending packet with sequence number " << seqNum << std::endl;
+            }
+            for (; Sn <= seqNum; Sn++) {
+                acked.clear(Sn);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Acknowledges the one segment
+    void receiveAck(int ack_num) {
+        onAck({Sf - 1, ack_num, 0});
+    }
+
+    void onAck(const SackAck& ack) {
+        if (ack.seq >= Sf && ack.seq < Sn && verbose) {
+            std::cout << "Received acknowledgement for packet with sequence number " << ack.seq << std::endl;
+        }
+        // Everything up to the cumulative point is in, whether or not its own ACK arrived
+        int cumulative = min(ack.cumulative, Sn - 1);
+        for (; Sf <= cumulative; Sf++) {
+            if (!acked.test(Sf)) {
+                stats.acked++;
+            }
+            acked.clear(Sf);
+        }
+        if (ack.seq >= Sf && ack.seq < Sn && !acked.test(ack.seq)) {
+            acked.set(ack.seq);
+            stats.acked++;
+            highest_sacked = max(highest_sacked, ack.seq);
+        }
+        // SACK bits, trimmed to the part of the window still open
+        int base = ack.cumulative + 1;
+        uint64_t bits = ack.sack;
+        if (base < Sf) {
+            bits = Sf - base >= 64 ? 0 : bits >> (Sf - base);
+            base = Sf;
+        }
+        if (Sn - base < 64) {
+            bits &= Sn - base <= 0 ? 0 : (1ULL << (Sn - base)) - 1;
+        }
+        if (bits != 0) {
+            stats.acked += acked.merge(base, bits);
+            highest_sacked = max(highest_sacked, base + 63 - __builtin_clzll(bits));
+        }
+        slide();
+        if (transmit_) {
+            resendHoles();
+            fillWindow();
+        }
+    }
+
+    // Where segments go, and how long each waits for its ACK
+    void connect(function<void(const ArqSegment&)> transmit, SimTime timeout) {
+        transmit_ = transmit;
+        this->timeout = timeout;
+    }
+
+    // Queues a segment; bytes defaults to the payload plus a 20-byte header
+    void send(const string& payload, int bytes = 0) {
+        backlog.push_back({0, bytes > 0 ? bytes : (int)payload.size() + 20, payload});
+        if (transmit_) {
+            fillWindow();
+        }
+    }
+
+    bool idle() const {
+        return backlog.empty() && Sf == Sn;
+    }
+
+    int getWindowSize() const {
+        return window_size;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+};
+
+// Selective Repeat receiver. Segments inside the window are held in a fixed ring buffer
+// until the gap before them fills, then handed up in order. Every arrival is answered with
+// the cumulative point and the SACK bitmap of what is held beyond it, so one lost ACK costs
+// nothing once a later one gets through.
+class SelectiveRepeatReceiver {
+private:
+    int window_size;
+    size_t capacity;
+    int Rn;                        // Next sequence number to hand up
+    vector<ArqSegment> buffer;     // Out-of-order segments, slot seq & (capacity - 1)
+    RingBitmap present;
+    function<void(const SackAck&)> send_ack;
+    function<void(const ArqSegment&)> deliver;
+    long long delivered;
+    long long duplicates;
+    long long buffered;            // Held out of order right now
+
+public:
+    SelectiveRepeatReceiver(int window_size, function<void(const SackAck&)> send_ack, function<void(const ArqSegment&)> deliver = nullptr, int first = 0)
+        : present(ringCapacity(max(window_size, 1))) {
+        this->window_size = max(window_size, 1);
+        capacity = ringCapacity(this->window_size);
+        Rn = first;
+        buffer.resize(capacity);
+        this->send_ack = send_ack;
+        this->deliver = deliver;
+        delivered = 0;
+        duplicates = 0;
+        buffered = 0;
+    }
+
+    void receive(const ArqSegment& segment) {
+        int seq = segment.seq;
+        if (seq < Rn || seq >= Rn + window_size || present.test(seq)) {
+            duplicates++; // Already held or handed up: its ACK was lost, so answer again
+        } else if (seq == Rn) {
+            delivered++;
+            if (deliver) {
+                deliver(segment);
+            }
+            Rn++;
+            while (present.test(Rn)) {
+                present.clear(Rn);
+                buffered--;
+                delivered++;
+                if (deliver) {
+                    deliver(buffer[(size_t)Rn & (capacity - 1)]);
+                }
+                Rn++;
+            }
+        } else {
+            buffer[(size_t)seq & (capacity - 1)] = segment;
+            present.set(seq);
+            buffered++;
+        }
+        send_ack({Rn - 1, seq, present.extract(Rn)});
+    }
+
+    long long getDelivered() const {
+        return delivered;
+    }
+
+    long long getDuplicates() const {
+        return duplicates;
+    }
+
+    long long getBuffered() const {
+        return buffered;
+    }
+};
+
+// Pure ALOHA on one shared channel, in virtual time. Stations never listen before sending, so
+// canSendPacket() always lets a frame go; what matters is whether it survives. A frame is
+// lost if any other frame is on the air at some point while it is, which for equal frame
+// times T means any start within T either side of its own: the 2T vulnerable period.
+// Frames on the air are kept ordered by start time. Starts arrive in time order, so a new
+// frame overlaps exactly the ones that have not ended yet, and both are marked collided.
+class PureAloha : public AccessControlProtocol {
+public:
+    struct Stats {
+        long long frames_sent = 0;
+        long long delivered = 0;
+        long long collided = 0;
+        SimTime busy_time = 0;    // Time carrying frames that got through
+    };
+
+private:
+    struct Interval {
+        int station;
+        SimTime start;
+        SimTime end;
+        bool collided = false;
+        bool resolved = false;    // Its end has passed and the outcome was reported
+    };
+    SimTime frame_time;
+    deque<Interval> on_air;       // Ordered by start; the front is pruned once resolved
+    long long first_id;           // Id of on_air.front(); ids count up by one per frame
+    function<void(int, bool)> done;
+    Stats stats;
+
+    void resolve(long long id) {
+        Interval& frame = on_air[id - first_id];
+        frame.resolved = true;
+        if (frame.collided) {
+            stats.collided++;
+        } else {
+            stats.delivered++;
+            stats.busy_time += frame.end - frame.start;
+        }
+        if (done) {
+            done(frame.station, !frame.collided);
+        }
+        while (!on_air.empty() && on_air.front().resolved) {
+            on_air.pop_front();
+            first_id++;
+        }
+    }
+
+public:
+    PureAloha(SimTime frame_time = 1 * MILLISECOND) {
+        this->frame_time = frame_time;
+        first_id = 0;
+    }
+
+    bool canSendPacket() override {
+        return true;
+    }
+
+    // Reports each frame's fate as its last bit leaves: true if nothing overlapped it
+    void onFrameDone(function<void(int, bool)> callback) {
+        done = callback;
+    }
+
+    // Puts a frame from the station on the channel now
+    void transmit(int station, SimTime duration = 0) {
+        SimTime now = simulator.now();
+        Interval frame;
+        frame.station = station;
+        frame.start = now;
+        frame.end = now + (duration > 0 ? duration : frame_time);
+        for (Interval& other : on_air) {
+            if (other.end > now) {
+                other.collided = true;
+                frame.collided = true;
+            }
+        }
+        long long id = first_id + (long long)on_air.size();
+        on_air.push_back(frame);
+        stats.frames_sent++;
+        simulator.scheduleAt(frame.end, [this, id]() { resolve(id); });
+    }
+
+    SimTime getFrameTime() const {
+        return frame_time;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+};
+
+// Slotted ALOHA on a virtual slot clock: slot n spans [n T, (n + 1) T) of simulated time, so
+// results no longer depend on the host's wall clock. A station with a frame waits for the next
+// slot boundary; frames therefore either coincide exactly or not at all, and the vulnerable
+// period shrinks to one slot. At the end of each slot a resolver counts its transmitters: none
+// leaves it idle, one gets through, two or more collide.
+class SlottedAloha : public AccessControlProtocol {
+public:
+    enum SlotOutcome { SLOT_IDLE, SLOT_SUCCESS, SLOT_COLLISION };
+    struct Stats {
+        long long slots = 0;
+        long long successes = 0;
+        long long collisions = 0;
+        long long frames_sent = 0;
+
+        long long idle() const {
+            return slots - successes - collisions;
+        }
+    };
+
+private:
+    SimTime slot_time;
+    long long last_slot;         // Last slot canSendPacket handed out
+    long long pending_slot;      // Slot the queued transmitters go out in, -1 if none
+    vector<int> pending;         // Their stations
+    long long accounted_slots;   // Slots before this one are in the stats
+    function<void(int, bool)> done;
+    Stats stats;
+
+    void closeSlot() {
+        accountIdle(pending_slot);
+        bool delivered = resolveSlot((int)pending.size()) == SLOT_SUCCESS;
+        accounted_slots = pending_slot + 1;
+        pending_slot = -1;
+        vector<int> stations;
+        stations.swap(pending);
+        if (done) {
+            for (int station : stations) {
+                done(station, delivered);
+            }
+        }
+    }
+
+    void accountIdle(long long slot) {
+        if (slot > accounted_slots) {
+            stats.slots += slot - accounted_slots;
+            accounted_slots = slot;
+        }
+    }
+
+public:
+    SlottedAloha(SimTime slot_time = 1 * MILLISECOND) {
+        this->slot_time = slot_time;
+        last_slot = -1;
+        pending_slot = -1;
+        accounted_slots = 0;
+    }
+
+    long long currentSlot() const {
+        return simulator.now() / slot_time;
+    }
+
+    // A station may start one frame per slot
+    bool canSendPacket() override {
+        long long slot = currentSlot();
+        if (slot == last_slot) {
+            return false;
+        }
+        last_slot = slot;
+        return true;
+    }
+
+    // Reports each frame's fate at the end of its slot: true if it was alone in it
+    void onFrameDone(function<void(int, bool)> callback) {
+        done = callback;
+    }
+
+    // Queues a frame from the station for the next slot boundary (now, if on one)
+    void transmit(int station) {
+        long long slot = (simulator.now() + slot_time - 1) / slot_time;
+        stats.frames_sent++;
+        if (pending_slot >= 0 && pending_slot != slot) {
+            closeSlot(); // Its end event is due no later than now
+        }
+        if (pending_slot < 0) {
+            pending_slot = slot;
+            simulator.scheduleAt((slot + 1) * slot_time, [this, slot]() {
+                if (pending_slot == slot) {
+                    closeSlot();
+                }
+            });
+        }
+        pending.push_back(station);
+    }
+
+    // The per-slot resolver, also driven directly by batch studies
+    SlotOutcome resolveSlot(int transmitters) {
+        stats.slots++;
+        if (transmitters == 0) {
+            return SLOT_IDLE;
+        }
+        if (transmitters == 1) {
+            stats.successes++;
+            return SLOT_SUCCESS;
+        }
+        stats.collisions++;
+        return SLOT_COLLISION;
+    }
+
+    // Brings the idle slot count up to the current slot
+    void syncClock() {
+        accountIdle(currentSlot());
+    }
+
+    SimTime getSlotTime() const {
+        return slot_time;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    void resetStats() {
+        stats = Stats();
+        accounted_slots = max(accounted_slots, currentSlot());
+    }
+};
+
+// Eight xoshiro128+ generators run in lockstep, one per 32-bit lane, so two SSE2 registers
+// yield eight draws per step. Draws are only ever compared against a threshold, which reads
+// the upper bits, where xoshiro128+ is strongest.
+class XoshiroLanes {
+public:
+    static const int LANES = 8;
+
+private:
+    alignas(16) uint32_t s[4][LANES];
+
+#ifdef __SSE2__
+    static void advance(__m128i& s0, __m128i& s1, __m128i& s2, __m128i& s3) {
+        __m128i t = _mm_slli_epi32(s1, 9);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+    }
+#endif
+
+public:
+    XoshiroLanes(uint64_t seed) {
+        for (int word = 0; word < 4; word++) {
+            for (int lane = 0; lane < LANES; lane++) {
+                seed += 0x9E3779B97F4A7C15ULL; // splitmix64, so nearby seeds give unrelated lanes
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                s[word][lane] = (uint32_t)((z ^ (z >> 31)) >> 32) | (word == 0); // Never all zero
+            }
+        }
+    }
+
+    // 64 independent Bernoulli(p) bits
+    uint64_t bernoulliMask(double p) {
+        if (p <= 0) {
+            return 0;
+        }
+        if (p >= 1) {
+            return ~0ULL;
+        }
+        uint32_t threshold = (uint32_t)(p * 4294967296.0);
+        uint64_t mask = 0;
+#ifdef __SSE2__
+        __m128i a0 = _mm_load_si128((const __m128i*)&s[0][0]), b0 = _mm_load_si128((const __m128i*)&s[0][4]);
+        __m128i a1 = _mm_load_si128((const __m128i*)&s[1][0]), b1 = _mm_load_si128((const __m128i*)&s[1][4]);
+        __m128i a2 = _mm_load_si128((const __m128i*)&s[2][0]), b2 = _mm_load_si128((const __m128i*)&s[2][4]);
+        __m128i a3 = _mm_load_si128((const __m128i*)&s[3][0]), b3 = _mm_load_si128((const __m128i*)&s[3][4]);
+        const __m128i bias = _mm_set1_epi32((int)0x80000000u); // SSE2 only compares signed
+        const __m128i limit = _mm_set1_epi32((int)(threshold ^ 0x80000000u));
+        for (int step = 0; step < 64 / LANES; step++) {
+            __m128i low = _mm_xor_si128(_mm_add_epi32(a0, a3), bias);
+            __m128i high = _mm_xor_si128(_mm_add_epi32(b0, b3), bias);
+            uint64_t bits = (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(low, limit))) |
+                            (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(high, limit))) << 4;
+            mask |= bits << (step * LANES);
+            advance(a0, a1, a2, a3);
+            advance(b0, b1, b2, b3);
+        }
+        _mm_store_si128((__m128i*)&s[0][0], a0), _mm_store_si128((__m128i*)&s[0][4], b0);
+        _mm_store_si128((__m128i*)&s[1][0], a1), _mm_store_si128((__m128i*)&s[1][4], b1);
+        _mm_store_si128((__m128i*)&s[2][0], a2), _mm_store_si128((__m128i*)&s[2][4], b2);
+        _mm_store_si128((__m128i*)&s[3][0], a3), _mm_store_si128((__m128i*)&s[3][4], b3);
+#else
+        for (int step = 0; step < 64 / LANES; step++) {
+            for (int lane = 0; lane < LANES; lane++) {
+                uint32_t draw = s[0][lane] + s[3][lane];
+                mask |= (uint64_t)(draw < threshold) << (step * LANES + lane);
+                uint32_t t = s[1][lane] << 9;
+                s[2][lane] ^= s[0][lane];
+                s[3][lane] ^= s[1][lane];
+                s[1][lane] ^= s[2][lane];
+                s[0][lane] ^= s[3][lane];
+                s[2][lane] ^= t;
+                s[3][lane] = (s[3][lane] << 11) | (s[3][lane] >> 21);
+            }
+        }
+#endif
+        return mask;
+    }
+};
+
+// Batch Monte Carlo for ALOHA-family random access. Time advances in mini-slots and a frame
+// lasts frame_slots of them: with 1 every frame fits a slot (Slotted ALOHA), larger values let
+// frames start anywhere and overlap partially, approaching Pure ALOHA. Stations live in 64-bit
+// masks, so one random draw per 64 stations decides who starts and the transmitter count of a
+// mini-slot is a popcount. Independent replications run on worker threads and give the
+// confidence intervals.
+struct RandomAccessConfig {
+    int stations = 128;
+    int frame_slots = 1;
+    double arrival = 1;         // Chance per mini-slot that a station queues a frame; 1 saturates
+    double persistence = 0.01;  // Chance per mini-slot that a backlogged station starts sending
+    long long slots = 1000000;  // Mini-slots measured per replication
+    long long warmup = 50000;   // Mini-slots run first to get past the empty start
+    int replications = 16;
+    uint64_t seed = 1;
+};
+
+struct RandomAccessEstimate {
+    double mean = 0;
+    double half_width = 0; // Of the 95% confidence interval
+};
+
+struct RandomAccessResult {
+    RandomAccessEstimate offered_load; // G: frames started per frame time
+    RandomAccessEstimate throughput;   // S: frames delivered per frame time
+    RandomAccessEstimate delay;        // Frame times from arrival to the end of the delivered copy
+    long long slots = 0;
+    double seconds = 0;
+};
+
+class RandomAccessMonteCarlo {
+    struct Replication {
+        long long starts = 0;
+        long long successes = 0;
+        double delay_sum = 0;
+    };
+
+    RandomAccessConfig config;
+
+    Replication runReplication(uint64_t seed) const {
+        int stations = config.stations;
+        int frameSlots = config.frame_slots;
+        int words = (stations + 63) / 64;
+        uint64_t lastWord = stations % 64 ? (1ULL << (stations % 64)) - 1 : ~0ULL;
+        vector<uint64_t> backlog(words, 0), onAir(words, 0);
+        vector<vector<uint64_t>> started(frameSlots, vector<uint64_t>(words, 0)); // Ring of the last frame's starts
+        vector<deque<long long>> arrived(stations); // Each station's queue, by arrival mini-slot
+        int window = 2 * frameSlots - 1; // Frame starts this close together overlap
+        vector<uint8_t> counts(window, 0);
+        vector<int> lone(window, -1);
+        int windowSum = 0;
+        XoshiroLanes rng(seed);
+        Replication result;
+
+        long long end = config.warmup + config.slots;
+        for (long long t = 0; t < end; t++) {
+            bool measured = t >= config.warmup;
+            vector<uint64_t>& starts = started[t % frameSlots];
+            int count = 0;
+            int sender = -1;
+            for (int w = 0; w < words; w++) {
+                uint64_t present = w == words - 1 ? lastWord : ~0ULL;
+                onAir[w] &= ~starts[w]; // Frames started frame_slots ago have ended
+                // Saturated stations get their next frame as soon as the last one is through
+                uint64_t fresh = config.arrival < 1 ? rng.bernoulliMask(config.arrival) & present : ~backlog[w] & present;
+                for (uint64_t bits = fresh; bits != 0; bits &= bits - 1) {
+                    arrived[w * 64 + __builtin_ctzll(bits)].push_back(t);
+                }
+                backlog[w] |= fresh;
+                uint64_t go = rng.bernoulliMask(config.persistence) & backlog[w] & ~onAir[w];
+                starts[w] = go;
+                onAir[w] |= go;
+                if (go != 0) {
+                    count += __builtin_popcountll(go);
+                    sender = w * 64 + __builtin_ctzll(go);
+                }
+            }
+            if (measured) {
+                result.starts += count;
+            }
+
+            // Capped at 2, the window sums to 1 only when a frame had it to itself
+            int slot = t % window;
+            windowSum += min(count, 2) - counts[slot];
+            counts[slot] = min(count, 2);
+            lone[slot] = sender;
+
+            long long start = t - frameSlots + 1; // Its frame's window is complete now
+            if (start < 0) {
+                continue;
+            }
+            int startSlot = start % window;
+            if (counts[startSlot] == 1 && windowSum == 1) {
+                int station = lone[startSlot];
+                if (measured) {
+                    result.successes++;
+                    result.delay_sum += (double)(t + 1 - arrived[station].front()) / frameSlots;
+                }
+                arrived[station].pop_front();
+                if (arrived[station].empty()) {
+                    backlog[station / 64] &= ~(1ULL << (station % 64));
+                }
+            }
+        }
+        return result;
+    }
+
+    // Two-sided 95% Student t quantile
+    static double tQuantile(int dof) {
+        static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+        return dof <= 30 ? table[max(dof, 1) - 1] : 1.960;
+    }
+
+    static RandomAccessEstimate estimate(const vector<double>& samples) {
+        RandomAccessEstimate result;
+        int n = (int)samples.size();
+        for (double sample : samples) {
+            result.mean += sample / n;
+        }
+        if (n > 1) {
+            double squares = 0;
+            for (double sample : samples) {
+                squares += (sample - result.mean) * (sample - result.mean);
+            }
+            result.half_width = tQuantile(n - 1) * sqrt(squares / (n - 1) / n);
+        }
+        return result;
+    }
+
+public:
+    RandomAccessMonteCarlo(const RandomAccessConfig& config) {
+        this->config = config;
+        this->config.stations = max(config.stations, 1);
+        this->config.frame_slots = max(config.frame_slots, 1);
+        this->config.replications = max(config.replications, 1);
+    }
+
+    // threads = 0 uses every hardware thread
+    RandomAccessResult run(int threads = 0) const {
+        int replications = config.replications;
+        if (threads <= 0) {
+            threads = max((int)thread::hardware_concurrency(), 1);
+        }
+        threads = min(threads, replications);
+        vector<Replication> runs(replications);
+        atomic<int> next(0);
+        auto start = chrono::steady_clock::now();
+        auto work = [&]() {
+            for (int r = next++; r < replications; r = next++) {
+                runs[r] = runReplication(config.seed * 0x100000001B3ULL + r);
+            }
+        };
+        vector<thread> workers;
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+
+        RandomAccessResult result;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        result.slots = (config.warmup + config.slots) * replications;
+        vector<double> load, throughput, delay;
+        double frames = (double)config.slots / config.frame_slots;
+        for (const Replication& run : runs) {
+            load.push_back(run.starts / frames);
+            throughput.push_back(run.successes / frames);
+            if (run.successes > 0) {
+                delay.push_back(run.delay_sum / run.successes);
+            }
+        }
+        result.offered_load = estimate(load);
+        result.throughput = estimate(throughput);
+        result.delay = estimate(delay);
+        return result;
+    }
+};
+
+class ApplicationLayer {
+public:
+    virtual void use() = 0;
+};
+
+class HTTP : public ApplicationLayer {
+private:
+    int id;
+    int port;
+
+public:
+    HTTP(int id) : id(id), port(80) {}
+
+    void use() override {
+        std::cout << "Using HTTP Application" << std::endl;
+    }
+};
+
+class SSH : public ApplicationLayer {
+private:
+    int id;
+    int port;
+
+public:
+    SSH(int id) : id(id), port(22) {}
+
+    void use() override {
+        std::cout << "Using SSH Application" << std::endl;
+    }
+};
+
+class Bridge : public FlowControlProtocol, public AccessControlProtocol {
+private:
+vector<Hub*> connected_hubs;
+FlowControlProtocol* flow_control_protocol;
+AccessControlProtocol* access_control_protocol;
+
+public:
+Bridge(FlowControlProtocol* flow_control) {
+flow_control_protocol = flow_control;
+}
+
+~Bridge() {
+    domains.removeNode(this);
+}
+
+void connectHub(Hub* hub) {
+    connected_hubs.push_back(hub);
+    domains.connect(this, DOMAIN_BRIDGE, hub, DOMAIN_REPEATER);
+}
+
+void disconnectHub(Hub* hub) {
+    connected_hubs.erase(remove(connected_hubs.begin(), connected_hubs.end(), hub), connected_hubs.end());
+    domains.disconnect(this, hub);
+}
+
+bool canSendPacket(const std::string& destination_mac, int seqNum) override {
+    return flow_control_protocol->canSendPacket(destination_mac, seqNum);
+}
+
+bool canSendPacket() override {
+    
+    if (access_control_protocol->canSendPacket()) {
+        return true;
+    } else {
+        return false;
+    }
+}
+};
+
+uint64_t next_bridge_address = 0x0A0000000001ULL; // MAC handed to the next Switch, for its bridge ID
+
+// Packet memory shared by every port of a switch. Frames live in descriptors drawn from a
+// fixed pool and chained into per-queue lists, so moving a frame between queues never copies
+// it. Admission follows Choudhury and Hahne's dynamic thresholds: a queue may take another
+// frame while its length is under alpha * (free bytes), which lets one busy queue borrow most
+// of an idle buffer but tightens every limit as the buffer fills. BUFFER_STATIC instead gives
+// each egress port a fixed 1/N share.
+class SharedPacketBuffer {
+public:
+    enum Policy { BUFFER_STATIC, BUFFER_DYNAMIC };
+    enum DropCause { DROP_BUFFER_FULL, DROP_NO_DESCRIPTOR, DROP_QUEUE_THRESHOLD, DROP_PORT_THRESHOLD, DROP_CAUSES };
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    struct Descriptor {
+        Frame frame;
+        uint16_t vlan;
+        uint32_t bytes;
+        SimTime arrived;
+        uint32_t next;
+    };
+
+    // A FIFO threaded through the descriptors
+    struct Queue {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+        uint32_t frames = 0;
+        uint64_t bytes = 0;
+        bool empty() const { return head == NIL; }
+    };
+
+    SharedPacketBuffer(size_t bytes = 4 << 20, size_t descriptors = 16384) {
+        configure(bytes, descriptors, 1.0, 2.0, BUFFER_DYNAMIC);
+    }
+
+    // Only while nothing is buffered; the descriptor pool is allocated lazily up to its limit
+    void configure(size_t bytes, size_t descriptors, double queue_alpha, double port_alpha, Policy policy) {
+        capacity = bytes;
+        descriptor_limit = descriptors;
+        this->queue_alpha = queue_alpha;
+        this->port_alpha = port_alpha;
+        this->policy = policy;
+        pool.clear();
+        free_head = NIL;
+        used = 0;
+        peak = 0;
+        admitted = 0;
+        fill(drops, drops + DROP_CAUSES, 0LL);
+    }
+
+    // DROP_CAUSES if a frame of the given size may join the queue, else why not. port_bytes is
+    // everything bound for the queue's egress port, ports the number of ports sharing the buffer.
+    DropCause admit(const Queue& queue, uint64_t port_bytes, uint32_t bytes, size_t ports) const {
+        if (used + bytes > capacity) {
+            return DROP_BUFFER_FULL;
+        }
+        if (free_head == NIL && pool.size() >= descriptor_limit) {
+            return DROP_NO_DESCRIPTOR;
+        }
+        if (policy == BUFFER_STATIC) {
+            return port_bytes + bytes > capacity / max(ports, (size_t)1) ? DROP_PORT_THRESHOLD : DROP_CAUSES;
+        }
+        double spare = (double)(capacity - used);
+        if (queue.bytes >= queue_alpha * spare) {
+            return DROP_QUEUE_THRESHOLD;
+        }
+        if (port_bytes >= port_alpha * spare) {
+            return DROP_PORT_THRESHOLD;
+        }
+        return DROP_CAUSES;
+    }
+
+    void countDrop(DropCause cause) {
+        drops[cause]++;
+    }
+
+    // Caller checks admit() first
+    void push(Queue& queue, const Frame& frame, uint16_t vlan, uint32_t bytes, SimTime arrived) {
+        uint32_t index;
+        if (free_head != NIL) {
+            index = free_head;
+            free_head = pool[index].next;
+            pool[index].frame = frame;
+        } else {
+            index = pool.size();
+            pool.push_back({frame, 0, 0, 0, NIL});
+        }
+        Descriptor& descriptor = pool[index];
+        descriptor.vlan = vlan;
+        descriptor.bytes = bytes;
+        descriptor.arrived = arrived;
+        used += bytes;
+        peak = max(peak, used);
+        admitted++;
+        append(queue, index);
+    }
+
+    // Unlinks the head; the descriptor stays allocated until release()
+    uint32_t pop(Queue& queue) {
+        uint32_t index = queue.head;
+        queue.head = pool[index].next;
+        if (queue.head == NIL) {
+            queue.tail = NIL;
+        }
+        queue.frames--;
+        queue.bytes -= pool[index].bytes;
+        return index;
+    }
+
+    // Unlinks the descriptor after prev, or the head when prev is NIL, for queues served out of order
+    uint32_t unlinkAfter(Queue& queue, uint32_t prev) {
+        if (prev == NIL) {
+            return pop(queue);
+        }
+        uint32_t index = pool[prev].next;
+        pool[prev].next = pool[index].next;
+        if (queue.tail == index) {
+            queue.tail = prev;
+        }
+        queue.frames--;
+        queue.bytes -= pool[index].bytes;
+        return index;
+    }
+
+    void append(Queue& queue, uint32_t index) {
+        pool[index].next = NIL;
+        if (queue.tail == NIL) {
+            queue.head = index;
+        } else {
+            pool[queue.tail].next = index;
+        }
+        queue.tail = index;
+        queue.frames++;
+        queue.bytes += pool[index].bytes;
+    }
+
+    void release(uint32_t index) {
+        used -= pool[index].bytes;
+        pool[index].frame.payload.clear();
+        pool[index].next = free_head;
+        free_head = index;
+    }
+
+    Descriptor& operator[](uint32_t index) {
+        return pool[index];
+    }
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    long long getAdmitted() const { return admitted; }
+    long long getDrops(DropCause cause) const { return drops[cause]; }
+    Policy getPolicy() const { return policy; }
+
+    static const char* causeName(DropCause cause) {
+        static const char* names[] = {"buffer_full", "no_descriptor", "queue_threshold", "port_threshold"};
+        return names[cause];
+    }
+
+private:
+    vector<Descriptor> pool;
+    uint32_t free_head;
+    size_t descriptor_limit;
+    size_t capacity;
+    size_t used;
+    size_t peak;
+    double queue_alpha; // Per-VOQ threshold multiplier
+    double port_alpha;  // Per-egress-port threshold multiplier
+    Policy policy;
+    long long admitted;
+    long long drops[DROP_CAUSES];
+};
+
+class Switch : public FlowControlProtocol, public AccessControlProtocol, public Layer2Device{
+private:
+     RoutingTable routingTable; // Add an instance of the RoutingTable class
+    unordered_map<string, EndDevice*> connected_devices;
+    struct IpIndexEntry {
+        EndDevice* device;
+        string mac_address;
+        uint64_t mac_key;
+    };
+    unordered_map<uint32_t, IpIndexEntry> ip_index; // Packed IPv4 -> attached device, kept in step with connected_devices
+    unordered_map<EndDevice*, uint32_t> indexed_ips; // Address each device was indexed under; its IP may change later
+    struct MacTableEntry {
+        uint32_t port;      // Port index
+        SimTime last_seen;
+        bool is_static;     // Configured through connectDevice; never ages out
+    };
+    MacForwardingTable<MacTableEntry> mac_address_table;  // MAC address table
+    SimTime aging_time; // Learned entries unused for longer than this are forgotten
+    vector<string> port_names;                        // Port index -> name
+    vector<Layer2Device*> port_links;                 // Port index -> whatever is cabled to it, nullptr if nothing
+    struct PortVlanConfig {
+        uint16_t pvid;                  // VLAN assigned to untagged frames arriving on the port
+        bitset<VLAN_ID_COUNT> members;  // VLANs the port carries
+        bitset<VLAN_ID_COUNT> tagged;   // Members that leave the port with an 802.1Q tag
+    };
+    vector<PortVlanConfig> port_vlans;                // Port index -> VLAN membership
+    unordered_map<uint16_t, vector<uint32_t>> vlan_ports; // VLAN -> member ports, the flood list
+    vector<vector<uint64_t>> port_static_macs;        // Port index -> MACs configured through connectDevice
+    unordered_map<string, uint32_t> port_ids;         // Port name -> index
+    unordered_map<Layer2Device*, uint32_t> link_ports; // Neighbour -> port index, to find the ingress port
+    long long frames_forwarded;
+    long long frames_filtered; // Dropped by VLAN ingress filtering
+    // Without the crossbar each port clocks frames out one at a time at its own rate. A port
+    // faster than the ingress would run dry mid-frame, so such hops store and forward even in
+    // cut-through mode. The crossbar datapath always stores frames in its VOQs.
+    ForwardingMode forwarding_mode;
+    vector<SimTime> line_free_at;   // Port index -> when its current transmission ends
+    long long frames_cut_through;
+    long long fcs_drops;            // Corrupt frames discarded by the FCS check
+    long long fcs_forwarded;        // Corrupt frames cut through before their FCS arrived
+    vector<PacketClassifier*> port_acls; // Port index -> ingress access list for IPv4 frames, nullptr if none
+    long long acl_drops;
+public:
+    struct LagMember {
+        bool up = true;             // Carrier on the member cable
+        bool active = true;         // Distributing; trails carrier loss until LACP notices
+        SimTime line_free_at = 0;
+        bool line_busy = false;     // Crossbar datapath
+        long long frames = 0;
+        long long bytes = 0;
+        long long drops = 0;        // Hashed onto the member after its carrier went
+        SimTime busy_time = 0;      // Time spent serialising, for utilisation
+    };
+private:
+    // Link aggregation (802.1AX). A LAG is one logical port to learning, VLANs and the spanning
+    // tree, backed by several member cables of the port's speed. Frames reach a member through
+    // a table of hash buckets indexed by their addresses, so each flow stays in order on one
+    // member, and a failed member only gives up its own buckets.
+    static constexpr int LAG_BUCKETS = 256;
+    struct LinkAggregate {
+        vector<LagMember> members;
+        uint8_t buckets[LAG_BUCKETS]; // Bucket -> member
+        Switch* peer;
+        uint32_t peer_port;
+        long long generation; // Tells callbacks scheduled for an aggregate since torn down to stand aside
+    };
+    vector<unique_ptr<LinkAggregate>> port_lags; // Port index -> aggregate, nullptr for a single cable
+    long long lag_generation;
+    // Spanning tree state, one StpPort per port index
+    struct StpPort {
+        StpPortRole role = STP_ROLE_DESIGNATED;
+        bool forwarding = true;
+        bool learning = true;
+        bool edge = false;              // Host-facing; never blocked and never sent BPDUs
+        bool has_info = false;          // port_priority holds a message from the link's designated bridge
+        PriorityVector port_priority;
+        SimTime info_expires = 0;
+        uint32_t path_cost = STP_DEFAULT_PATH_COST;
+        bool proposing = false;         // Designated port waiting for the agreement that lets it forward
+        bool proposed = false;          // The designated bridge across the link is proposing to us
+        long long timer_generation = 0; // Invalidates a pending forward-delay fallback
+    };
+    enum SpanningTreeMode { STP_OFF, STP_RAPID, STP_STATIC };
+    SpanningTreeMode stp_mode;
+    uint64_t bridge_address;
+    uint64_t bridge_id;             // Priority in the top 16 bits, bridge MAC below
+    vector<StpPort> stp_ports;
+    PriorityVector root_priority;   // Root bridge and our cost to it
+    int root_port;
+    long long hello_generation;
+    SimTime tc_until;               // Topology change flag is set on BPDUs until then
+    long long bpdus_sent;
+    long long topology_changes;
+    SimTime last_stp_change;
+    long long stp_changes;          // Port role and forwarding state changes
+public:
+    struct PortQueueStats {
+        long long frames = 0;        // Frames admitted at (ingress) or sent from (egress) the port
+        long long bytes = 0;
+        long long drops = 0;
+        long long occupancy = 0;     // Frames queued for the port right now
+        long long max_occupancy = 0;
+        double occupancy_area = 0;   // Occupancy integrated over time, for the mean
+        SimTime last_update = 0;
+        SimTime total_latency = 0;   // Egress only: arrival at the switch to last bit out
+        SimTime max_latency = 0;
+    };
+private:
+    // Crossbar datapath (enableFabric). Frames wait at their ingress port in a virtual output
+    // queue per egress port, so a congested output never blocks traffic behind it. An iSLIP
+    // matching moves one frame per matched input/output pair across the crossbar; the egress
+    // port then clocks it out at the port's line rate. All queues draw on one shared buffer.
+    typedef SharedPacketBuffer::Queue PacketQueue;
+    bool fabric_enabled;
+    int islip_iterations;
+    double fabric_speedup;         // Crossbar rate relative to the egress port's line rate
+    vector<long long> port_speeds; // Port index -> bits/s
+    SharedPacketBuffer packet_buffer;
+    vector<vector<PacketQueue>> voqs;    // [ingress][egress]
+    vector<vector<uint32_t>> voq_egress; // Ingress -> egress ports with a non-empty VOQ
+    vector<PacketQueue> egress_queues;
+    vector<uint64_t> port_bytes;         // Buffered bytes bound for each egress port, in any queue
+    vector<SimTime> input_busy_until;        // Crossbar transfers in progress
+    vector<SimTime> output_busy_until;
+    vector<bool> line_busy;
+    vector<uint32_t> grant_pointer;          // iSLIP round-robin pointers
+    vector<uint32_t> accept_pointer;
+    SimTime scheduler_next;                  // Pending scheduler run, -1 if none
+    vector<PortQueueStats> ingress_stats;
+    vector<PortQueueStats> egress_stats;
+    FlowControlProtocol* flow_control_protocol;
+     AccessControlProtocol* access_control_protocol;
+
+    uint32_t portId(const string& port) {
+        auto it = port_ids.find(port);
+        if (it != port_ids.end()) {
+            return it->second;
+        }
+        uint32_t id = port_names.size();
+        port_ids[port] = id;
+        port_names.push_back(port);
+        port_links.push_back(nullptr);
+        PortVlanConfig config;
+        config.pvid = DEFAULT_VLAN;
+        config.members.set(DEFAULT_VLAN);
+        port_vlans.push_back(config);
+        vlan_ports[DEFAULT_VLAN].push_back(id);
+        port_static_macs.emplace_back();
+        stp_ports.emplace_back();
+        port_speeds.push_back(DEFAULT_PORT_SPEED);
+        line_free_at.push_back(0);
+        port_lags.emplace_back();
+        port_acls.push_back(nullptr);
+        if (fabric_enabled) {
+            growFabric();
+        }
+        return id;
+    }
+
+    // Per-VLAN MAC tables share one FDB: the VID sits above the 48-bit MAC in the key
+    static uint64_t vlanKey(uint16_t vlan, uint64_t mac_key) {
+        return ((uint64_t)vlan << 48) | mac_key;
+    }
+
+    static bool validVlan(uint16_t vlan) {
+        if (vlan == 0 || vlan >= VLAN_ID_COUNT - 1) {
+            cout << "Invalid VLAN ID: " << vlan << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void rebuildVlanPorts(uint16_t vlan) {
+        vector<uint32_t>& ports = vlan_ports[vlan];
+        ports.clear();
+        for (uint32_t port = 0; port < port_vlans.size(); port++) {
+            if (port_vlans[port].members.test(vlan)) {
+                ports.push_back(port);
+            }
+        }
+        if (ports.empty()) {
+            vlan_ports.erase(vlan);
+        }
+    }
+
+    // Applies a new membership to a port. Everything learned on it is forgotten and its
+    // static entries move to the new PVID.
+    void setPortVlans(uint32_t port, const PortVlanConfig& config) {
+        PortVlanConfig old = port_vlans[port];
+        mac_address_table.eraseIf([port](const MacTableEntry& entry) { return entry.port == port; });
+        port_vlans[port] = config;
+        for (uint64_t mac : port_static_macs[port]) {
+            mac_address_table.insert(vlanKey(config.pvid, mac), {port, simulator.now(), true}, true);
+        }
+        for (int vlan = 1; vlan < VLAN_ID_COUNT - 1; vlan++) {
+            if (old.members.test(vlan) != config.members.test(vlan)) {
+                rebuildVlanPorts(vlan);
+            }
+        }
+    }
+
+    bool portForwarding(uint32_t port) const {
+        return stp_mode == STP_OFF || stp_ports[port].forwarding;
+    }
+
+    bool takesPartInTree(uint32_t port) const {
+        return port_links[port] != nullptr && !stp_ports[port].edge;
+    }
+
+    uint16_t stpPortId(uint32_t port) const {
+        return 0x8000 | (uint16_t)((port + 1) & 0x0FFF); // Default port priority 128, 12-bit port number
+    }
+
+    // The message this bridge sends on a port: our root, our cost to it, us, and the port
+    PriorityVector designatedPriority(uint32_t port) const {
+        PriorityVector priority = root_priority;
+        priority.bridge_id = bridge_id;
+        priority.port_id = stpPortId(port);
+        return priority;
+    }
+
+    void transmitBpdu(uint32_t port, int flags) {
+        const StpPort& stp = stp_ports[port];
+        Frame frame;
+        frame.src_key = bridge_address;
+        frame.dst_mac = STP_MULTICAST_MAC;
+        frame.dst_key = STP_MULTICAST_KEY;
+        frame.bpdu.priority = designatedPriority(port);
+        if (stp.role == STP_ROLE_DESIGNATED) {
+            flags |= BPDU_ROLE_DESIGNATED;
+            if (stp.proposing) {
+                flags |= BPDU_PROPOSAL;
+            }
+        }
+        if (simulator.now() < tc_until) {
+            flags |= BPDU_TOPOLOGY_CHANGE;
+        }
+        frame.bpdu.flags = flags;
+        transmitFrame(port_links[port], frame);
+        bpdus_sent++;
+    }
+
+    void setForwarding(uint32_t port) {
+        StpPort& stp = stp_ports[port];
+        stp.timer_generation++;
+        stp.proposing = false;
+        if (stp.forwarding) {
+            return;
+        }
+        stp.forwarding = true;
+        stp.learning = true;
+        last_stp_change = simulator.now();
+        stp_changes++;
+        if (!stp.edge && stp_mode == STP_RAPID) {
+            topologyChange(port);
+        }
+    }
+
+    void setDiscarding(uint32_t port) {
+        StpPort& stp = stp_ports[port];
+        stp.timer_generation++;
+        stp.proposing = false;
+        if (!stp.forwarding && !stp.learning) {
+            return;
+        }
+        stp.forwarding = false;
+        stp.learning = false;
+        last_stp_change = simulator.now();
+        stp_changes++;
+        mac_address_table.eraseIf([port](const MacTableEntry& entry) { return entry.port == port && !entry.is_static; });
+    }
+
+    // A designated port that isn't forwarding asks the neighbour for an agreement. If none
+    // comes (the neighbour doesn't run RSTP) it falls back to the 802.1D forward-delay timers.
+    void propose(uint32_t port) {
+        StpPort& stp = stp_ports[port];
+        if (stp.forwarding || stp.proposing) {
+            return;
+        }
+        stp.proposing = true;
+        long long generation = ++stp.timer_generation;
+        transmitBpdu(port, 0);
+        simulator.schedule(STP_FORWARD_DELAY, [this, port, generation]() {
+            if (stp_ports[port].timer_generation != generation) {
+                return;
+            }
+            stp_ports[port].learning = true;
+            simulator.schedule(STP_FORWARD_DELAY, [this, port, generation]() {
+                if (stp_ports[port].timer_generation == generation) {
+                    setForwarding(port);
+                }
+            });
+        });
+    }
+
+    // A non-edge port started forwarding: addresses learned elsewhere may now sit behind
+    // a different port, so flush them and tell the rest of the tree
+    void topologyChange(uint32_t port) {
+        topology_changes++;
+        flushForTopologyChange(port);
+        tc_until = simulator.now() + 2 * STP_HELLO_TIME;
+        for (uint32_t other = 0; other < stp_ports.size(); other++) {
+            StpPortRole role = stp_ports[other].role;
+            if (other != port && takesPartInTree(other) && (role == STP_ROLE_ROOT || role == STP_ROLE_DESIGNATED)) {
+                transmitBpdu(other, 0);
+            }
+        }
+    }
+
+    void flushForTopologyChange(uint32_t port) {
+        mac_address_table.eraseIf([this, port](const MacTableEntry& entry) {
+            return !entry.is_static && entry.port != port && !stp_ports[entry.port].edge;
+        });
+    }
+
+    // 802.1w port role selection: pick the root port from the recorded messages, then decide
+    // for every other port whether we or the bridge across the link is designated
+    void updateRoles() {
+        PriorityVector best;
+        best.root_id = bridge_id;
+        best.root_path_cost = 0;
+        best.bridge_id = bridge_id;
+        best.port_id = 0;
+        int best_port = NO_PORT;
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            const StpPort& stp = stp_ports[port];
+            if (!takesPartInTree(port) || !stp.has_info || stp.port_priority.bridge_id == bridge_id) {
+                continue;
+            }
+            PriorityVector candidate = stp.port_priority;
+            candidate.root_path_cost += stp.path_cost;
+            if (candidate < best) { // Ties go to the lower port, which is scanned first
+                best = candidate;
+                best_port = port;
+            }
+        }
+        bool root_changed = best_port != root_port || best.root_id != root_priority.root_id ||
+                            best.root_path_cost != root_priority.root_path_cost;
+        root_priority.root_id = best.root_id;
+        root_priority.root_path_cost = best.root_path_cost;
+        root_port = best_port;
+
+        vector<StpPortRole> roles(stp_ports.size());
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            const StpPort& stp = stp_ports[port];
+            if (port_links[port] == nullptr) {
+                roles[port] = STP_ROLE_DISABLED;
+            } else if ((int)port == root_port) {
+                roles[port] = STP_ROLE_ROOT;
+            } else if (stp.edge || !stp.has_info || !(stp.port_priority < designatedPriority(port))) {
+                roles[port] = STP_ROLE_DESIGNATED;
+            } else {
+                roles[port] = stp.port_priority.bridge_id == bridge_id ? STP_ROLE_BACKUP : STP_ROLE_ALTERNATE;
+            }
+        }
+
+        // Block first, so the new active topology never contains a loop
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            if (roles[port] != STP_ROLE_ROOT && roles[port] != STP_ROLE_DESIGNATED) {
+                setRole(port, roles[port]);
+                setDiscarding(port);
+            }
+        }
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            if ((roles[port] == STP_ROLE_ALTERNATE || roles[port] == STP_ROLE_BACKUP) && stp_ports[port].proposed) {
+                transmitBpdu(port, BPDU_AGREEMENT); // Proposal heard before this port lost the designated role
+            }
+        }
+        if (root_port != NO_PORT) {
+            bool new_root_port = stp_ports[root_port].role != STP_ROLE_ROOT;
+            setRole(root_port, STP_ROLE_ROOT);
+            setForwarding(root_port);
+            if (new_root_port && stp_ports[root_port].proposed) {
+                agreeOnRootPort(root_port);
+            }
+        }
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            if (roles[port] == STP_ROLE_DESIGNATED) {
+                setRole(port, STP_ROLE_DESIGNATED);
+                if (stp_ports[port].edge) {
+                    setForwarding(port);
+                } else if (!stp_ports[port].forwarding && !stp_ports[port].proposing) {
+                    propose(port);
+                } else if (root_changed) {
+                    transmitBpdu(port, 0); // Pass the new root information downstream
+                }
+            }
+        }
+    }
+
+    void setRole(uint32_t port, StpPortRole role) {
+        if (stp_ports[port].role != role) {
+            stp_ports[port].role = role;
+            last_stp_change = simulator.now();
+            stp_changes++;
+        }
+    }
+
+    void receiveBpdu(uint32_t port, const Bpdu& bpdu) {
+        StpPort& stp = stp_ports[port];
+        stp.edge = false; // A bridge is on the other end after all
+        const PriorityVector& message = bpdu.priority;
+        bool changed = false;
+        if (bpdu.flags & BPDU_ROLE_DESIGNATED) {
+            stp.proposed = (bpdu.flags & BPDU_PROPOSAL) != 0;
+            // Superior information always wins; the current designated bridge may also report worse news
+            bool same_designated = stp.has_info && message.bridge_id == stp.port_priority.bridge_id &&
+                                   message.port_id == stp.port_priority.port_id;
+            if (!stp.has_info || message < stp.port_priority || same_designated) {
+                changed = !stp.has_info || !(message == stp.port_priority);
+                stp.port_priority = message;
+                stp.has_info = true;
+                stp.info_expires = simulator.now() + 3 * STP_HELLO_TIME;
+            } else if (stp.role == STP_ROLE_DESIGNATED) {
+                transmitBpdu(port, 0); // The neighbour has stale information; correct it straight away
+            }
+        }
+        if ((bpdu.flags & BPDU_AGREEMENT) && stp.role == STP_ROLE_DESIGNATED && stp.proposing) {
+            setForwarding(port);
+        }
+        if (bpdu.flags & BPDU_TOPOLOGY_CHANGE) {
+            if (simulator.now() >= tc_until) {
+                topologyChange(port);
+            } else {
+                flushForTopologyChange(port);
+            }
+        }
+        if (changed) {
+            updateRoles();
+        }
+        if ((bpdu.flags & BPDU_PROPOSAL) && (bpdu.flags & BPDU_ROLE_DESIGNATED)) {
+            StpPortRole role = stp_ports[port].role;
+            if (role == STP_ROLE_ROOT) {
+                agreeOnRootPort(port);
+            } else if (role == STP_ROLE_ALTERNATE || role == STP_ROLE_BACKUP) {
+                transmitBpdu(port, BPDU_AGREEMENT); // Already discarding, so already in sync
+            }
+        }
+    }
+
+    // Sync: block our own designated ports before agreeing, then let them propose downstream
+    void agreeOnRootPort(uint32_t port) {
+        for (uint32_t other = 0; other < stp_ports.size(); other++) {
+            if (other != port && takesPartInTree(other) && stp_ports[other].role == STP_ROLE_DESIGNATED &&
+                stp_ports[other].forwarding) {
+                setDiscarding(other);
+                propose(other);
+            }
+        }
+        setForwarding(port);
+        transmitBpdu(port, BPDU_AGREEMENT);
+    }
+
+    void helloTick(long long generation) {
+        if (generation != hello_generation || stp_mode != STP_RAPID) {
+            return;
+        }
+        bool expired = false;
+        for (StpPort& stp : stp_ports) {
+            if (stp.has_info && !stp.edge && simulator.now() >= stp.info_expires) {
+                stp.has_info = false; // Three hellos missed
+                expired = true;
+            }
+        }
+        if (expired) {
+            updateRoles();
+        }
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            if (takesPartInTree(port) && stp_ports[port].role == STP_ROLE_DESIGNATED) {
+                transmitBpdu(port, 0);
+            }
+        }
+        simulator.schedule(STP_HELLO_TIME, [this, generation]() { helloTick(generation); });
+    }
+
+    void linkUp(uint32_t port) {
+        StpPort& stp = stp_ports[port];
+        stp.edge = false;
+        stp.has_info = false;
+        if (stp_mode == STP_RAPID) {
+            setDiscarding(port);
+            setRole(port, STP_ROLE_DISABLED);
+            updateRoles();
+        }
+    }
+
+    void linkDown(Layer2Device* neighbour) {
+        auto it = link_ports.find(neighbour);
+        if (it == link_ports.end()) {
+            return;
+        }
+        uint32_t port = it->second;
+        link_ports.erase(it);
+        port_links[port] = nullptr;
+        stp_ports[port].has_info = false;
+        mac_address_table.eraseIf([port](const MacTableEntry& entry) { return entry.port == port && !entry.is_static; });
+        if (stp_mode == STP_RAPID) {
+            updateRoles();
+        }
+    }
+
+    void sendOnPort(int in_port, uint32_t port, const Frame& frame, uint16_t vlan) {
+        if (fabric_enabled && in_port != NO_PORT) {
+            enqueueVoq(in_port, port, frame, vlan);
+            return;
+        }
+        uint16_t tag = port_vlans[port].tagged.test(vlan) ? vlan : 0;
+        int out_bytes = frameBytes(frame) + (tag != 0 ? 4 : 0) - (frame.vlan_id != 0 ? 4 : 0);
+        SimTime delay;
+        if (port_lags[port] != nullptr) {
+            LagMember& member = selectMember(port, frame, vlan);
+            if (!member.up) {
+                member.drops++;
+                return;
+            }
+            SimTime before = max(simulator.now(), member.line_free_at);
+            delay = egressDelay(in_port, port, frame, out_bytes, member.line_free_at);
+            member.frames++;
+            member.bytes += out_bytes;
+            member.busy_time += member.line_free_at - before;
+        } else {
+            delay = egressDelay(in_port, port, frame, out_bytes, line_free_at[port]);
+        }
+        if (frame.vlan_id == tag) {
+            transmitFrame(port_links[port], frame, delay);
+        } else {
+            transmitFrame(port_links[port], retagged(frame, tag), delay);
+        }
+        frames_forwarded++;
+    }
+
+    // Adding or stripping a tag rewrites the FCS. The old error syndrome is carried over, so a
+    // frame cut through while corrupt still fails the next check.
+    static Frame retagged(const Frame& frame, uint16_t tag) {
+        Frame egress = frame;
+        egress.vlan_id = tag;
+        if (tag != frame.vlan_id) {
+            egress.fcs = frameChecksum(egress) ^ frameChecksum(frame) ^ frame.fcs;
+        }
+        return egress;
+    }
+
+    // Books the egress port for a frame whose last bit has just arrived and returns the delay
+    // until its last bit reaches the next device
+    SimTime egressDelay(int in_port, uint32_t port, const Frame& frame, int out_bytes, SimTime& free_at) {
+        SimTime now = simulator.now();
+        SimTime start = max(now, free_at);
+        if (forwarding_mode == FORWARD_CUT_THROUGH && in_port != NO_PORT && port_speeds[port] <= port_speeds[in_port]) {
+            long long in_speed = port_speeds[in_port];
+            SimTime first_bit = now - serializationTime(frameBytes(frame), in_speed);
+            SimTime header = (ETHERNET_PREAMBLE + ETHERNET_HEADER + (frame.vlan_id != 0 ? 4 : 0)) * 8 * SECOND / in_speed;
+            start = max(first_bit + header, free_at);
+            if (start < now) {
+                frames_cut_through++;
+            }
+        }
+        free_at = start + serializationTime(out_bytes, port_speeds[port]);
+        return free_at - now + LINK_DELAY;
+    }
+
+    // Layer 2+3 flow hash: both MACs, the VLAN and both IP addresses
+    static uint32_t flowHash(const Frame& frame, uint16_t vlan) {
+        uint64_t key = (frame.src_key ^ (frame.dst_key << 16) ^ ((uint64_t)vlan << 52)) * 0x9E3779B97F4A7C15ULL;
+        if (frame.ether_type == ETHERTYPE_IPV4) {
+            key ^= ((uint64_t)ArpCache::packIP(frame.sender_ip) << 32 | ArpCache::packIP(frame.target_ip)) * 0xC2B2AE3D27D4EB4FULL;
+        }
+        key ^= key >> 29;
+        return (uint32_t)(key ^ (key >> 32));
+    }
+
+    LagMember& selectMember(uint32_t port, const Frame& frame, uint16_t vlan) {
+        LinkAggregate& lag = *port_lags[port];
+        return lag.members[lag.buckets[flowHash(frame, vlan) % LAG_BUCKETS]];
+    }
+
+    // Moves the buckets of inactive members onto the active ones, round robin; with rebalance
+    // every bucket is dealt out afresh
+    static void distributeBuckets(LinkAggregate& lag, bool rebalance) {
+        vector<uint8_t> active;
+        for (size_t m = 0; m < lag.members.size(); m++) {
+            if (lag.members[m].active) {
+                active.push_back(m);
+            }
+        }
+        if (active.empty()) {
+            return;
+        }
+        size_t next = 0;
+        for (int bucket = 0; bucket < LAG_BUCKETS; bucket++) {
+            if (rebalance || !lag.members[lag.buckets[bucket]].active) {
+                lag.buckets[bucket] = active[next++ % active.size()];
+            }
+        }
+    }
+
+    // A member came back: it takes an even share of buckets from members holding more than
+    // that, and every other flow stays where it is
+    static void restoreBuckets(LinkAggregate& lag, int member) {
+        distributeBuckets(lag, false); // Anything left on dead members first
+        vector<int> load(lag.members.size(), 0);
+        int active = 0;
+        for (size_t m = 0; m < lag.members.size(); m++) {
+            active += lag.members[m].active;
+        }
+        for (int bucket = 0; bucket < LAG_BUCKETS; bucket++) {
+            load[lag.buckets[bucket]]++;
+        }
+        int share = LAG_BUCKETS / max(active, 1);
+        for (int bucket = 0; bucket < LAG_BUCKETS && load[member] < share; bucket++) {
+            uint8_t owner = lag.buckets[bucket];
+            if (owner != member && load[owner] > share) {
+                lag.buckets[bucket] = member;
+                load[owner]--;
+                load[member]++;
+            }
+        }
+    }
+
+    void createAggregate(uint32_t port, int members, Switch* peer, uint32_t peer_port) {
+        port_lags[port].reset(new LinkAggregate());
+        LinkAggregate& lag = *port_lags[port];
+        lag.members.resize(members);
+        lag.peer = peer;
+        lag.peer_port = peer_port;
+        lag.generation = ++lag_generation;
+        distributeBuckets(lag, true);
+    }
+
+    void setMemberCarrier(const string& port, int member, bool up, SimTime detection) {
+        auto it = port_ids.find(port);
+        if (it == port_ids.end() || port_lags[it->second] == nullptr) {
+            return;
+        }
+        LinkAggregate& lag = *port_lags[it->second];
+        if (member < 0 || member >= (int)lag.members.size()) {
+            return;
+        }
+        memberCarrier(it->second, member, up, detection);
+        lag.peer->memberCarrier(lag.peer_port, member, up, detection);
+    }
+
+    // Carrier change on one member, seen at this end
+    void memberCarrier(uint32_t port, int member, bool up, SimTime detection) {
+        LinkAggregate& lag = *port_lags[port];
+        lag.members[member].up = up;
+        long long generation = lag.generation;
+        simulator.schedule(up ? 0 : detection, [this, port, member, up, generation]() {
+            if (port_lags[port] == nullptr || port_lags[port]->generation != generation) {
+                return; // Cabling pulled in the meantime
+            }
+            LinkAggregate& lag = *port_lags[port];
+            if (lag.members[member].up != up) {
+                return; // Flapped back before LACP caught up
+            }
+            bool was_linked = port_links[port] != nullptr;
+            lag.members[member].active = up;
+            if (up) {
+                restoreBuckets(lag, member);
+            } else {
+                distributeBuckets(lag, false);
+            }
+            bool any = false;
+            for (const LagMember& m : lag.members) {
+                any = any || m.active;
+            }
+            if (!any && was_linked) {
+                linkDown(lag.peer); // Last member gone: the logical port goes down
+            } else if (any && !was_linked) {
+                attachPort(port_names[port], lag.peer);
+                linkUp(port);
+            }
+        });
+    }
+
+    void growFabric() {
+        size_t ports = port_names.size();
+        voqs.resize(ports);
+        for (auto& row : voqs) {
+            row.resize(ports);
+        }
+        voq_egress.resize(ports);
+        egress_queues.resize(ports);
+        port_bytes.resize(ports, 0);
+        input_busy_until.resize(ports, 0);
+        output_busy_until.resize(ports, 0);
+        line_busy.resize(ports, false);
+        grant_pointer.resize(ports, 0);
+        accept_pointer.resize(ports, 0);
+        ingress_stats.resize(ports);
+        egress_stats.resize(ports);
+    }
+
+    static void adjustOccupancy(PortQueueStats& stats, int delta) {
+        SimTime now = simulator.now();
+        stats.occupancy_area += (double)stats.occupancy * (now - stats.last_update);
+        stats.last_update = now;
+        stats.occupancy += delta;
+        stats.max_occupancy = max(stats.max_occupancy, stats.occupancy);
+    }
+
+    void enqueueVoq(uint32_t in_port, uint32_t out_port, const Frame& frame, uint16_t vlan) {
+        PortQueueStats& ingress = ingress_stats[in_port];
+        uint32_t bytes = frameBytes(frame);
+        PacketQueue& voq = voqs[in_port][out_port];
+        SharedPacketBuffer::DropCause cause = packet_buffer.admit(voq, port_bytes[out_port], bytes, port_names.size());
+        if (cause != SharedPacketBuffer::DROP_CAUSES) {
+            packet_buffer.countDrop(cause);
+            ingress.drops++;
+            egress_stats[out_port].drops++;
+            return;
+        }
+        if (voq.empty()) {
+            voq_egress[in_port].push_back(out_port);
+        }
+        packet_buffer.push(voq, frame, vlan, bytes, simulator.now());
+        port_bytes[out_port] += bytes;
+        ingress.frames++;
+        ingress.bytes += bytes;
+        adjustOccupancy(ingress, 1);
+        adjustOccupancy(egress_stats[out_port], 1);
+        requestSchedule(simulator.now());
+    }
+
+    void requestSchedule(SimTime at) {
+        if (scheduler_next != -1 && scheduler_next <= at) {
+            return;
+        }
+        scheduler_next = at;
+        simulator.scheduleAt(at, [this, at]() {
+            if (scheduler_next != at) {
+                return; // Superseded by an earlier run
+            }
+            scheduler_next = -1;
+            runScheduler();
+        });
+    }
+
+    // One iSLIP round over the inputs and outputs not busy with a crossbar transfer:
+    // request, grant and accept, repeated for islip_iterations. Pointers only advance on
+    // first-iteration matches, which is what desynchronises the outputs under load.
+    void runScheduler() {
+        SimTime now = simulator.now();
+        size_t ports = port_names.size();
+        vector<int> input_match(ports, NO_PORT);
+        vector<int> output_match(ports, NO_PORT);
+        vector<int> grants(ports, NO_PORT); // Output -> input it granted this iteration
+        for (int iteration = 0; iteration < islip_iterations; iteration++) {
+            // Request + grant: each free output grants the first requesting input from its pointer
+            fill(grants.begin(), grants.end(), NO_PORT);
+            vector<vector<uint32_t>> granted_to(ports);
+            bool any = false;
+            for (uint32_t in = 0; in < ports; in++) {
+                if (input_match[in] != NO_PORT || input_busy_until[in] > now) {
+                    continue;
+                }
+                for (uint32_t out : voq_egress[in]) {
+                    if (output_match[out] != NO_PORT || output_busy_until[out] > now) {
+                        continue;
+                    }
+                    uint32_t distance = (in + ports - grant_pointer[out]) % ports;
+                    if (grants[out] == NO_PORT || distance < (grants[out] + ports - grant_pointer[out]) % ports) {
+                        grants[out] = in;
+                    }
+                }
+            }
+            for (uint32_t out = 0; out < ports; out++) {
+                if (grants[out] != NO_PORT) {
+                    granted_to[grants[out]].push_back(out);
+                    any = true;
+                }
+            }
+            if (!any) {
+                break;
+            }
+            // Accept: each input takes the first granting output from its pointer
+            for (uint32_t in = 0; in < ports; in++) {
+                if (granted_to[in].empty()) {
+                    continue;
+                }
+                uint32_t best = granted_to[in][0];
+                for (uint32_t out : granted_to[in]) {
+                    if ((out + ports - accept_pointer[in]) % ports < (best + ports - accept_pointer[in]) % ports) {
+                        best = out;
+                    }
+                }
+                input_match[in] = best;
+                output_match[best] = in;
+                if (iteration == 0) {
+                    grant_pointer[best] = (in + 1) % ports;
+                    accept_pointer[in] = (best + 1) % ports;
+                }
+            }
+        }
+        for (uint32_t in = 0; in < ports; in++) {
+            if (input_match[in] != NO_PORT) {
+                startTransfer(in, input_match[in]);
+            }
+        }
+    }
+
+    void startTransfer(uint32_t in_port, uint32_t out_port) {
+        PacketQueue& voq = voqs[in_port][out_port];
+        uint32_t queued = packet_buffer.pop(voq);
+        if (voq.empty()) {
+            vector<uint32_t>& active = voq_egress[in_port];
+            active.erase(find(active.begin(), active.end(), out_port));
+        }
+        adjustOccupancy(ingress_stats[in_port], -1);
+        SimTime transfer = serializationTime(packet_buffer[queued].bytes, (long long)(port_speeds[out_port] * fabric_speedup));
+        SimTime done = simulator.now() + transfer;
+        input_busy_until[in_port] = done;
+        output_busy_until[out_port] = done;
+        simulator.scheduleAt(done, [this, out_port, queued]() {
+            packet_buffer.append(egress_queues[out_port], queued);
+            startTransmission(out_port);
+            requestSchedule(simulator.now());
+        });
+    }
+
+    void startTransmission(uint32_t port) {
+        if (line_busy[port] || egress_queues[port].empty()) {
+            return;
+        }
+        LagMember* member = nullptr;
+        uint32_t index;
+        if (port_lags[port] != nullptr) {
+            // Each member is its own line. A frame whose member is busy waits while later frames
+            // go out on idle members; a flow always hashes to one member, so it stays in order.
+            bool idle = false;
+            for (const LagMember& m : port_lags[port]->members) {
+                idle = idle || !m.line_busy;
+            }
+            if (!idle) {
+                return;
+            }
+            uint32_t prev = SharedPacketBuffer::NIL;
+            uint32_t at = egress_queues[port].head;
+            while (at != SharedPacketBuffer::NIL) {
+                LagMember& candidate = selectMember(port, packet_buffer[at].frame, packet_buffer[at].vlan);
+                if (!candidate.line_busy) {
+                    member = &candidate;
+                    break;
+                }
+                prev = at;
+                at = packet_buffer[at].next;
+            }
+            if (member == nullptr) {
+                return;
+            }
+            index = packet_buffer.unlinkAfter(egress_queues[port], prev);
+        } else {
+            index = packet_buffer.pop(egress_queues[port]);
+        }
+        SharedPacketBuffer::Descriptor& head = packet_buffer[index];
+        SimTime transmit = serializationTime(head.bytes, port_speeds[port]);
+        PortQueueStats& egress = egress_stats[port];
+        adjustOccupancy(egress, -1);
+        if (member != nullptr && (!member->up || port_links[port] == nullptr)) {
+            member->drops++;
+            egress.drops++;
+            port_bytes[port] -= head.bytes;
+            packet_buffer.release(index);
+            startTransmission(port);
+            return;
+        }
+        if (member != nullptr) {
+            member->frames++;
+            member->bytes += head.bytes;
+            member->busy_time += transmit;
+            member->line_busy = true;
+            size_t m = member - port_lags[port]->members.data();
+            long long generation = port_lags[port]->generation;
+            simulator.schedule(transmit, [this, port, index, m, generation]() {
+                port_bytes[port] -= packet_buffer[index].bytes;
+                packet_buffer.release(index);
+                if (port_lags[port] != nullptr && port_lags[port]->generation == generation) {
+                    port_lags[port]->members[m].line_busy = false;
+                }
+                startTransmission(port);
+            });
+            Frame out = retagged(head.frame, port_vlans[port].tagged.test(head.vlan) ? head.vlan : 0);
+            transmitFrame(port_links[port], out, transmit + LINK_DELAY);
+            frames_forwarded++;
+            SimTime latency = simulator.now() + transmit - head.arrived;
+            egress.frames++;
+            egress.bytes += head.bytes;
+            egress.total_latency += latency;
+            egress.max_latency = max(egress.max_latency, latency);
+            startTransmission(port); // Another member may be free for the next frame
+            return;
+        }
+        if (port_links[port] != nullptr) {
+            Frame out = retagged(head.frame, port_vlans[port].tagged.test(head.vlan) ? head.vlan : 0);
+            transmitFrame(port_links[port], out, transmit + LINK_DELAY);
+            frames_forwarded++;
+            SimTime latency = simulator.now() + transmit - head.arrived;
+            egress.frames++;
+            egress.bytes += head.bytes;
+            egress.total_latency += latency;
+            egress.max_latency = max(egress.max_latency, latency);
+        } else {
+            egress.drops++; // Cable pulled while the frame was queued
+        }
+        line_busy[port] = true;
+        simulator.schedule(transmit, [this, port, index]() {
+            // Memory is held until the last bit is out
+            port_bytes[port] -= packet_buffer[index].bytes;
+            packet_buffer.release(index);
+            line_busy[port] = false;
+            startTransmission(port);
+        });
+    }
+
+    void attachPort(const string& port, Layer2Device* device) {
+        uint32_t id = portId(port);
+        port_links[id] = device;
+        link_ports[device] = id;
+    }
+
+    void indexDevice(EndDevice* device) {
+        unindexDevice(device); // Drop the entry from an earlier connect in case the IP has changed since
+        string ip = device->getIpAddress();
+        if (!ip.empty()) {
+            string mac = device->getMacAddress();
+            uint32_t packed = ArpCache::packIP(ip);
+            ip_index[packed] = {device, mac, macKey(mac)};
+            indexed_ips[device] = packed;
+        }
+    }
+
+    void unindexDevice(EndDevice* device) {
+        auto indexed = indexed_ips.find(device);
+        if (indexed == indexed_ips.end()) {
+            return;
+        }
+        auto it = ip_index.find(indexed->second);
+        if (it != ip_index.end() && it->second.device == device) { // Another device may have taken the address since
+            ip_index.erase(it);
+        }
+        indexed_ips.erase(indexed);
+    }
+
+public:
+    static constexpr int NO_PORT = -1;
+
+    Switch(FlowControlProtocol* flow_control, AccessControlProtocol* acp, size_t mac_table_capacity = 8192)
+        : mac_address_table(mac_table_capacity) {
+        flow_control_protocol = flow_control;
+        access_control_protocol = acp;
+        frames_forwarded = 0;
+        frames_filtered = 0;
+        forwarding_mode = FORWARD_STORE_AND_FORWARD;
+        frames_cut_through = 0;
+        lag_generation = 0;
+        fcs_drops = 0;
+        fcs_forwarded = 0;
+        acl_drops = 0;
+        fabric_enabled = false;
+        islip_iterations = 4;
+        fabric_speedup = 1.0;
+        scheduler_next = -1;
+        aging_time = 300 * SECOND; // IEEE 802.1D default
+        stp_mode = STP_OFF;
+        bridge_address = next_bridge_address++;
+        bridge_id = ((uint64_t)STP_DEFAULT_PRIORITY << 48) | bridge_address;
+        root_port = NO_PORT;
+        hello_generation = 0;
+        tc_until = 0;
+        bpdus_sent = 0;
+        topology_changes = 0;
+        last_stp_change = 0;
+        stp_changes = 0;
+    }
+
+    DomainRole domainRole() const override {
+        return DOMAIN_BRIDGE;
+    }
+
+    void setAgingTime(SimTime aging) {
+        aging_time = aging;
+    }
+
+    void connectDevice(EndDevice* device, string port, string mac_address) {
+        uint32_t id = portId(port);
+        uint64_t mac = macKey(mac_address);
+        mac_address_table.insert(vlanKey(port_vlans[id].pvid, mac), {id, simulator.now(), true}, true);  // Update MAC address table
+        port_static_macs[id].push_back(mac);
+        connectDevice(device, port);
+    }
+
+    // Plugs a device in without registering its MAC; the switch learns it from traffic
+    void connectDevice(EndDevice* device, string port) {
+        auto previous = connected_devices.find(port);
+        if (previous != connected_devices.end() && previous->second != device) {
+            unindexDevice(previous->second);
+            domains.disconnect(this, previous->second);
+        }
+        if (previous == connected_devices.end() || previous->second != device) {
+            domains.connect(this, DOMAIN_BRIDGE, device, device->domainRole());
+        }
+        connected_devices[port] = device;
+        indexDevice(device);
+        attachPort(port, device);
+        uint32_t id = port_ids[port];
+        stp_ports[id].edge = true;
+        stp_ports[id].has_info = false;
+        stp_ports[id].role = STP_ROLE_DESIGNATED;
+        setForwarding(id);
+        device->attachTo(this);
+        device->connect();
+    }
+
+    void disconnectDevice(EndDevice* device, string port, string mac_address) {
+        if (connected_devices.erase(port) > 0) {
+            domains.disconnect(this, device);
+        }
+        unindexDevice(device);
+        flushPort(port);
+        auto id = port_ids.find(port);
+        if (id != port_ids.end()) {
+            uint64_t mac = macKey(mac_address);
+            mac_address_table.erase(vlanKey(port_vlans[id->second].pvid, mac));  // Remove MAC address from the table
+            vector<uint64_t>& statics = port_static_macs[id->second];
+            statics.erase(remove(statics.begin(), statics.end(), mac), statics.end());
+            port_links[id->second] = nullptr;
+        }
+        link_ports.erase(device);
+        if (stp_mode == STP_RAPID) {
+            updateRoles();
+        }
+        if (device->getUplink() == this) {
+            device->attachTo(nullptr);
+        }
+        device->disconnect();
+    }
+
+    // Cables a port of this switch to a port of another switch
+    void connectSwitch(Switch* other, string port, string other_port) {
+        domains.connect(this, DOMAIN_BRIDGE, other, DOMAIN_BRIDGE);
+        attachPort(port, other);
+        other->attachPort(other_port, this);
+        linkUp(port_ids[port]);
+        other->linkUp(other->port_ids[other_port]);
+    }
+
+    // Bonds parallel cables between a port here and a port on another switch into one aggregate.
+    // Switch-to-switch only: a Router here is a host with a single NIC, so it has no ports to bond.
+    void connectAggregate(Switch* other, string port, string other_port, int members) {
+        members = min(max(members, 1), LAG_BUCKETS);
+        for (int m = 0; m < members; m++) {
+            domains.connect(this, DOMAIN_BRIDGE, other, DOMAIN_BRIDGE);
+        }
+        attachPort(port, other);
+        other->attachPort(other_port, this);
+        createAggregate(port_ids[port], members, other, other->port_ids[other_port]);
+        other->createAggregate(other->port_ids[other_port], members, this, port_ids[port]);
+        linkUp(port_ids[port]);
+        other->linkUp(other->port_ids[other_port]);
+    }
+
+    // Cuts one member cable. Both ends keep hashing onto it, losing those frames, until LACP
+    // times out and its buckets move to the surviving members.
+    void failAggregateMember(const string& port, int member, SimTime detection = LACP_TIMEOUT) {
+        setMemberCarrier(port, member, false, detection);
+    }
+
+    void restoreAggregateMember(const string& port, int member) {
+        setMemberCarrier(port, member, true, 0);
+    }
+
+    vector<LagMember> getAggregateMembers(const string& port) {
+        auto it = port_ids.find(port);
+        if (it == port_ids.end() || port_lags[it->second] == nullptr) {
+            return vector<LagMember>();
+        }
+        return port_lags[it->second]->members;
+    }
+
+    void printAggregateStats(const string& port, SimTime since) {
+        SimTime elapsed = max(simulator.now() - since, (SimTime)1);
+        vector<LagMember> members = getAggregateMembers(port);
+        cout << "member,state,frames,bytes,utilisation_pct,drops" << endl;
+        for (size_t m = 0; m < members.size(); m++) {
+            const LagMember& member = members[m];
+            cout << m << "," << (member.active ? "active" : member.up ? "joining" : "down") << "," << member.frames << ","
+                 << member.bytes << "," << 100.0 * member.busy_time / elapsed << "," << member.drops << endl;
+        }
+    }
+
+    // Pulls the cable to another switch; both ends see loss of carrier at once
+    void disconnectSwitch(Switch* other) {
+        auto port = link_ports.find(other);
+        size_t cables = port != link_ports.end() && port_lags[port->second] != nullptr ? port_lags[port->second]->members.size() : 1;
+        for (size_t c = 0; c < cables; c++) {
+            domains.disconnect(this, other);
+        }
+        // The bundle goes with the cables, so a port cabled again later starts as a single link
+        auto other_port = other->link_ports.find(this);
+        if (port != link_ports.end()) {
+            port_lags[port->second].reset();
+        }
+        if (other_port != other->link_ports.end()) {
+            other->port_lags[other_port->second].reset();
+        }
+        linkDown(other);
+        other->linkDown(this);
+    }
+
+    void setBridgePriority(uint16_t priority) {
+        bridge_id = ((uint64_t)priority << 48) | bridge_address;
+    }
+
+    void setPortPathCost(const string& port, uint32_t cost) {
+        stp_ports[portId(port)].path_cost = cost;
+    }
+
+    // Starts Rapid Spanning Tree: every inter-switch port begins discarding and the tree
+    // forms through BPDU proposals and agreements. Host ports are edge ports and forward at once.
+    void enableSpanningTree() {
+        stp_mode = STP_RAPID;
+        root_priority = PriorityVector();
+        root_priority.root_id = bridge_id;
+        root_priority.root_path_cost = 0;
+        root_port = NO_PORT;
+        tc_until = 0;
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            stp_ports[port].has_info = false;
+            if (!stp_ports[port].edge) {
+                setDiscarding(port);
+                setRole(port, STP_ROLE_DISABLED);
+            }
+        }
+        updateRoles();
+        long long generation = ++hello_generation;
+        simulator.schedule(STP_HELLO_TIME, [this, generation]() { helloTick(generation); });
+    }
+
+    void disableSpanningTree() {
+        stp_mode = STP_OFF;
+        hello_generation++;
+        for (StpPort& stp : stp_ports) {
+            stp.timer_generation++;
+            stp.proposing = false;
+            stp.forwarding = true;
+            stp.learning = true;
+            stp.role = STP_ROLE_DESIGNATED;
+        }
+    }
+
+    // Offline mode: installs roles computed from the whole topology (see computeSpanningTree).
+    // No BPDUs are exchanged, so the roles stay until installed again.
+    void setStaticSpanningTree(const vector<StpPortRole>& roles, uint64_t root_id) {
+        stp_mode = STP_STATIC;
+        hello_generation++;
+        root_priority.root_id = root_id;
+        root_port = NO_PORT;
+        for (uint32_t port = 0; port < stp_ports.size() && port < roles.size(); port++) {
+            setRole(port, roles[port]);
+            if (roles[port] == STP_ROLE_ROOT) {
+                root_port = port;
+            }
+            if (roles[port] == STP_ROLE_ALTERNATE || roles[port] == STP_ROLE_BACKUP) {
+                setDiscarding(port);
+            } else {
+                setForwarding(port);
+            }
+        }
+    }
+
+    // Ports cabled to other switches, with the switch on the far end
+    vector<pair<uint32_t, Switch*>> getBridgePorts() {
+        vector<pair<uint32_t, Switch*>> ports;
+        for (uint32_t port = 0; port < port_links.size(); port++) {
+            Switch* neighbour = dynamic_cast<Switch*>(port_links[port]);
+            if (neighbour != nullptr) {
+                ports.push_back({port, neighbour});
+            }
+        }
+        return ports;
+    }
+
+    int getPortTowards(Layer2Device* neighbour) {
+        auto it = link_ports.find(neighbour);
+        return it != link_ports.end() ? (int)it->second : NO_PORT;
+    }
+
+    size_t getPortCount() {
+        return port_names.size();
+    }
+
+    uint32_t getPortPathCost(uint32_t port) {
+        return stp_ports[port].path_cost;
+    }
+
+    uint16_t getStpPortId(uint32_t port) {
+        return stpPortId(port);
+    }
+
+    uint64_t getBridgeId() {
+        return bridge_id;
+    }
+
+    uint64_t getRootId() {
+        return stp_mode == STP_OFF ? bridge_id : root_priority.root_id;
+    }
+
+    int getRootPort() {
+        return stp_mode == STP_OFF ? NO_PORT : root_port;
+    }
+
+    int getBlockedPortCount() {
+        int blocked = 0;
+        for (uint32_t port = 0; port < stp_ports.size(); port++) {
+            blocked += port_links[port] != nullptr && !portForwarding(port);
+        }
+        return blocked;
+    }
+
+    long long getBpdusSent() {
+        return bpdus_sent;
+    }
+
+    long long getTopologyChanges() {
+        return topology_changes;
+    }
+
+    SimTime getLastStpChange() {
+        return last_stp_change;
+    }
+
+    long long getStpChanges() {
+        return stp_changes;
+    }
+
+    // Access port: untagged traffic, all in one VLAN
+    bool setAccessVlan(const string& port, uint16_t vlan) {
+        if (!validVlan(vlan)) {
+            return false;
+        }
+        PortVlanConfig config;
+        config.pvid = vlan;
+        config.members.set(vlan);
+        setPortVlans(portId(port), config);
+        return true;
+    }
+
+    // Trunk port: carries the listed VLANs tagged, and the native VLAN untagged
+    bool setTrunkVlans(const string& port, const vector<uint16_t>& vlans, uint16_t native_vlan = DEFAULT_VLAN) {
+        if (!validVlan(native_vlan)) {
+            return false;
+        }
+        PortVlanConfig config;
+        config.pvid = native_vlan;
+        config.members.set(native_vlan);
+        for (uint16_t vlan : vlans) {
+            if (!validVlan(vlan)) {
+                return false;
+            }
+            config.members.set(vlan);
+            if (vlan != native_vlan) {
+                config.tagged.set(vlan);
+            }
+        }
+        setPortVlans(portId(port), config);
+        return true;
+    }
+
+    uint16_t getPortVlan(const string& port) {
+        auto it = port_ids.find(port);
+        return it != port_ids.end() ? port_vlans[it->second].pvid : DEFAULT_VLAN;
+    }
+
+    long long getFramesFiltered() {
+        return frames_filtered;
+    }
+
+    // IPv4 frames arriving on the port are checked against the list after VLAN classification,
+    // so rules can match the VLAN an untagged frame was assigned. ARP and BPDUs are not filtered.
+    void setIngressAcl(const string& port, PacketClassifier* acl) {
+        port_acls[portId(port)] = acl;
+    }
+
+    long long getAclDrops() {
+        return acl_drops;
+    }
+
+    // Forgets everything learned on a port, e.g. when its cable is pulled
+    void flushPort(const string& port) {
+        auto it = port_ids.find(port);
+        if (it == port_ids.end()) {
+            return;
+        }
+        uint32_t id = it->second;
+        mac_address_table.eraseIf([id](const MacTableEntry& entry) { return entry.port == id && !entry.is_static; });
+    }
+
+    // Source-address learning: the sender is reachable through the port the frame came in on
+    void learnAddress(uint64_t mac_key, uint16_t vlan, int port) {
+        if (port == NO_PORT || mac_key == 0 || mac_key == BROADCAST_KEY) {
+            return;
+        }
+        uint64_t key = vlanKey(vlan, mac_key);
+        MacTableEntry* entry = mac_address_table.find(key);
+        if (entry == nullptr) {
+            mac_address_table.insert(key, {(uint32_t)port, simulator.now(), false});
+        } else if (!entry->is_static) {
+            entry->port = port; // Station moved
+            entry->last_seen = simulator.now();
+        }
+    }
+
+    // Egress port index for a MAC within a VLAN, or NO_PORT if unknown. Aged entries are dropped on lookup.
+    int lookupPortId(uint64_t mac_key, uint16_t vlan) {
+        uint64_t key = vlanKey(vlan, mac_key);
+        MacTableEntry* entry = mac_address_table.find(key);
+        if (entry == nullptr) {
+            return NO_PORT;
+        }
+        if (!entry->is_static && simulator.now() - entry->last_seen > aging_time) {
+            mac_address_table.erase(key);
+            return NO_PORT;
+        }
+        return entry->port;
+    }
+
+    // Egress port name for a MAC, or "" if unknown
+    string lookupPort(const string& mac_address, uint16_t vlan = DEFAULT_VLAN) {
+        int port = lookupPortId(macKey(mac_address), vlan);
+        return port == NO_PORT ? "" : port_names[port];
+    }
+
+    size_t getMacTableSize() {
+        return mac_address_table.size();
+    }
+
+    long long getMacTableEvictions() {
+        return mac_address_table.evictions();
+    }
+
+    void receiveFrame(const Frame& frame, Layer2Device* from) override {
+        auto ingress = link_ports.find(from);
+        int in_port = ingress != link_ports.end() ? (int)ingress->second : NO_PORT;
+        uint64_t src_key = frame.src_key != 0 ? frame.src_key : macKey(frame.src_mac);
+        uint64_t dst_key = frame.dst_key != 0 ? frame.dst_key : macKey(frame.dst_mac);
+        if (dst_key == STP_MULTICAST_KEY) { // Link-local: consumed here, never forwarded
+            if (stp_mode == STP_RAPID && in_port != NO_PORT) {
+                receiveBpdu(in_port, frame.bpdu);
+            }
+            return;
+        }
+        if (frameChecksum(frame) != frame.fcs) {
+            if (forwarding_mode == FORWARD_STORE_AND_FORWARD || fabric_enabled) {
+                fcs_drops++;
+                return;
+            }
+            fcs_forwarded++; // Already on its way out by the time the FCS arrives
+        }
+        // Untagged frames join the ingress port's PVID; anything the port isn't a member of is dropped
+        uint16_t vlan = frame.vlan_id;
+        if (vlan >= VLAN_ID_COUNT - 1) {
+            frames_filtered++; // 0xFFF is reserved and anything wider isn't a 12-bit VID
+            return;
+        }
+        if (in_port != NO_PORT) {
+            const PortVlanConfig& config = port_vlans[in_port];
+            if (vlan == 0) {
+                vlan = config.pvid;
+            }
+            if (!config.members.test(vlan)) {
+                frames_filtered++;
+                return;
+            }
+        } else if (vlan == 0) {
+            vlan = DEFAULT_VLAN;
+        }
+        if (in_port != NO_PORT && !portForwarding(in_port)) {
+            if (stp_ports[in_port].learning) {
+                learnAddress(src_key, vlan, in_port);
+            }
+            return; // Blocked by the spanning tree
+        }
+        if (in_port != NO_PORT && port_acls[in_port] != nullptr && frame.ether_type == ETHERTYPE_IPV4 &&
+            port_acls[in_port]->classify(packetHeader(frame, vlan)) == ACL_DENY) {
+            acl_drops++;
+            return;
+        }
+        learnAddress(src_key, vlan, in_port);
+        if (dst_key != BROADCAST_KEY) {
+            int out_port = lookupPortId(dst_key, vlan);
+            if (out_port != NO_PORT) {
+                if (port_links[out_port] != nullptr && out_port != in_port && port_vlans[out_port].members.test(vlan) &&
+                    portForwarding(out_port)) {
+                    sendOnPort(in_port, out_port, frame, vlan);
+                }
+                return;
+            }
+        }
+        floodFrame(frame, in_port, vlan); // Broadcast or unknown unicast, confined to the VLAN
+    }
+
+    void floodFrame(const Frame& frame, int in_port, uint16_t vlan = DEFAULT_VLAN) {
+        auto members = vlan_ports.find(vlan);
+        if (members == vlan_ports.end()) {
+            return;
+        }
+        for (uint32_t port : members->second) {
+            if ((int)port != in_port && port_links[port] != nullptr && portForwarding(port)) {
+                sendOnPort(in_port, port, frame, vlan);
+            }
+        }
+    }
+
+    long long getFramesForwarded() {
+        return frames_forwarded;
+    }
+
+    void setForwardingMode(ForwardingMode mode) {
+        forwarding_mode = mode;
+    }
+
+    ForwardingMode getForwardingMode() {
+        return forwarding_mode;
+    }
+
+    long long getFramesCutThrough() {
+        return frames_cut_through;
+    }
+
+    long long getFcsDrops() {
+        return fcs_drops;
+    }
+
+    long long getFcsForwarded() {
+        return fcs_forwarded;
+    }
+
+    // Switches from per-port output lines to the queued crossbar datapath
+    void enableFabric(int iterations = 4, double speedup = 1.0) {
+        fabric_enabled = true;
+        islip_iterations = max(iterations, 1);
+        fabric_speedup = speedup > 0 ? speedup : 1.0;
+        growFabric();
+    }
+
+    void setPortSpeed(const string& port, long long bits_per_second) {
+        port_speeds[portId(port)] = bits_per_second > 0 ? bits_per_second : DEFAULT_PORT_SPEED;
+    }
+
+    long long getPortSpeed(const string& port) {
+        return port_speeds[portId(port)];
+    }
+
+    // Sizes the shared packet buffer and picks its admission policy. Only while it is empty.
+    void setSharedBuffer(size_t bytes, size_t descriptors, SharedPacketBuffer::Policy policy,
+                         double queue_alpha = 1.0, double port_alpha = 2.0) {
+        packet_buffer.configure(bytes, descriptors, queue_alpha, port_alpha, policy);
+    }
+
+    const SharedPacketBuffer& getSharedBuffer() const {
+        return packet_buffer;
+    }
+
+    PortQueueStats getPortStats(const string& port, bool egress) {
+        auto it = port_ids.find(port);
+        if (!fabric_enabled || it == port_ids.end()) {
+            return PortQueueStats();
+        }
+        PortQueueStats stats = egress ? egress_stats[it->second] : ingress_stats[it->second];
+        adjustOccupancy(stats, 0); // Bring the time average up to now
+        return stats;
+    }
+
+    void resetPortStats() {
+        for (size_t port = 0; port < ingress_stats.size(); port++) {
+            long long in_queued = ingress_stats[port].occupancy;
+            long long out_queued = egress_stats[port].occupancy;
+            ingress_stats[port] = PortQueueStats();
+            egress_stats[port] = PortQueueStats();
+            ingress_stats[port].occupancy = ingress_stats[port].max_occupancy = in_queued;
+            egress_stats[port].occupancy = egress_stats[port].max_occupancy = out_queued;
+            ingress_stats[port].last_update = egress_stats[port].last_update = simulator.now();
+        }
+    }
+
+    // One line per active port. Egress side: traffic, frames waiting for the port (in any
+    // VOQ or at egress) and arrival-to-departure latency. Ingress side: the port's own VOQs.
+    void printPortStats(SimTime since) {
+        SimTime elapsed = max(simulator.now() - since, (SimTime)1);
+        cout << "port,speed_mbps,frames_out,throughput_mbps,mean_queue,max_queue,mean_latency_us,max_latency_us,"
+             << "ingress_frames,ingress_mean_voq,ingress_max_voq,ingress_drops" << endl;
+        for (uint32_t port = 0; port < port_names.size() && fabric_enabled; port++) {
+            PortQueueStats egress = egress_stats[port];
+            PortQueueStats ingress = ingress_stats[port];
+            adjustOccupancy(egress, 0);
+            adjustOccupancy(ingress, 0);
+            if (egress.frames == 0 && ingress.frames == 0 && ingress.drops == 0) {
+                continue;
+            }
+            cout << port_names[port] << "," << port_speeds[port] / 1000000 << "," << egress.frames << ","
+                 << (double)egress.bytes * 8 * SECOND / elapsed / 1e6 << ","
+                 << egress.occupancy_area / elapsed << "," << egress.max_occupancy << ","
+                 << (egress.frames > 0 ? (double)egress.total_latency / egress.frames / MICROSECOND : 0.0) << ","
+                 << (double)egress.max_latency / MICROSECOND << "," << ingress.frames << ","
+                 << ingress.occupancy_area / elapsed << "," << ingress.max_occupancy << "," << ingress.drops << endl;
+        }
+        if (fabric_enabled) {
+            printBufferStats();
+        }
+    }
+
+    void printBufferStats() {
+        cout << "Shared buffer: " << packet_buffer.getCapacity() / 1024 << " KB "
+             << (packet_buffer.getPolicy() == SharedPacketBuffer::BUFFER_DYNAMIC ? "dynamic" : "static")
+             << ", peak " << packet_buffer.getPeak() / 1024 << " KB, drops:";
+        for (int cause = 0; cause < SharedPacketBuffer::DROP_CAUSES; cause++) {
+            SharedPacketBuffer::DropCause c = (SharedPacketBuffer::DropCause)cause;
+            cout << " " << SharedPacketBuffer::causeName(c) << "=" << packet_buffer.getDrops(c);
+        }
+        cout << endl;
+    }
+
+     string resolveMACAddress(const string& ip_address) {
+        auto it = ip_index.find(ArpCache::packIP(ip_address));
+        if (it != ip_index.end()) {
+            return it->second.mac_address;
+        }
+        return "";  // MAC address not found
+    }
+
+    // Bulk form for fabric-wide address mapping; unresolved addresses come back as ""
+    vector<string> resolveMACAddresses(const vector<string>& ip_addresses) {
+        vector<string> macs;
+        macs.reserve(ip_addresses.size());
+        for (const string& ip : ip_addresses) {
+            macs.push_back(resolveMACAddress(ip));
+        }
+        return macs;
+    }
+
+    // Same on packed addresses: fills macs with packed MACs (0 if unresolved) and returns how many resolved
+    size_t resolveMACAddresses(const vector<uint32_t>& ip_addresses, vector<uint64_t>& macs) {
+        macs.resize(ip_addresses.size());
+        size_t resolved = 0;
+        for (size_t i = 0; i < ip_addresses.size(); i++) {
+            auto it = ip_index.find(ip_addresses[i]);
+            macs[i] = it != ip_index.end() ? it->second.mac_key : 0;
+            resolved += macs[i] != 0;
+        }
+        return resolved;
+    }
+
+    void performStaticRouting(const string& destinationIP) {
+        string nextHopIP = routingTable.getNextHop(destinationIP);
+        if (!nextHopIP.empty()) {
+            cout << "Performing static routing for destination IP: " << destinationIP << endl;
+            cout << "Next hop IP: " << nextHopIP << endl;
+        } else {
+            cout << "No static route found for destination IP: " << destinationIP << endl;
+        }
+    }
+
+    bool canSendPacket(const string& destination_mac, int seqNum) override {
+    // Unknown destinations are flooded, as a transparent bridge would
+    bool known = !lookupPort(destination_mac).empty();
+    bool accessControlResult = access_control_protocol->canSendPacket();
+    bool flowControlResult = flow_control_protocol->canSendPacket(destination_mac, seqNum);
+
+    if (accessControlResult && flowControlResult) {
+        if (known) {
+            cout << "Sending packet to MAC address " << destination_mac << " with sequence number " << seqNum << endl;
+        } else {
+            cout << "Destination MAC address " << destination_mac << " not learned yet; flooding packet with sequence number " << seqNum << endl;
+        }
+    } else {
+        cout << "Packet sending to MAC address " << destination_mac << " with sequence number " << seqNum << " is blocked by access control or flow control." << endl;
+    }
+
+    return flowControlResult;
+}
+
+bool canSendPacket() override {
+    
+    if (access_control_protocol->canSendPacket()) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void receiveAck(int ackNum) override {
+     // Process the acknowledgement
+    cout << "Received acknowledgement for packet with sequence number " << ackNum << endl;
+    }
+};
+
+// Offline spanning tree: computes the roles RSTP would converge to straight from the
+// topology graph (Dijkstra from the lowest bridge ID of each connected component, with the
+// same priority-vector tie-breaks) and installs them without any BPDU exchange.
+// Returns the number of ports blocked.
+int computeSpanningTree(const vector<Switch*>& switches) {
+    int n = switches.size();
+    unordered_map<Switch*, int> index;
+    vector<vector<pair<uint32_t, Switch*>>> ports(n);
+    for (int i = 0; i < n; i++) {
+        index[switches[i]] = i;
+        ports[i] = switches[i]->getBridgePorts();
+    }
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) { return switches[a]->getBridgeId() < switches[b]->getBridgeId(); });
+
+    const uint64_t UNREACHED = ~0ULL;
+    vector<uint64_t> cost(n, UNREACHED);
+    vector<uint64_t> root(n, 0);
+    for (int start : order) {
+        if (cost[start] != UNREACHED) {
+            continue;
+        }
+        // Lowest bridge ID not yet reached: the root of its component
+        typedef tuple<uint64_t, uint64_t, int> QueueEntry; // cost, bridge ID, switch
+        priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> queue;
+        cost[start] = 0;
+        queue.push(QueueEntry(0, switches[start]->getBridgeId(), start));
+        while (!queue.empty()) {
+            QueueEntry top = queue.top();
+            queue.pop();
+            int u = get<2>(top);
+            if (get<0>(top) != cost[u]) {
+                continue;
+            }
+            root[u] = switches[start]->getBridgeId();
+            for (const auto& link : ports[u]) {
+                auto found = index.find(link.second);
+                if (found == index.end()) {
+                    continue;
+                }
+                int v = found->second;
+                int back = link.second->getPortTowards(switches[u]);
+                uint64_t through = cost[u] + link.second->getPortPathCost(back);
+                if (through < cost[v]) {
+                    cost[v] = through;
+                    queue.push(QueueEntry(through, link.second->getBridgeId(), v));
+                }
+            }
+        }
     }
 
-    void printConnectedDevices() {
-        cout << "Connected Devices to " << router_name << ": " << endl;
-        for (const auto& device : connected_devices) {
-            cout << "ID: " << device->getDeviceId() << ", Name: " << device->getDeviceName() << ", IP: " << device->getIpAddress() << endl;
+    int blocked = 0;
+    for (int u = 0; u < n; u++) {
+        Switch* self = switches[u];
+        vector<StpPortRole> roles(self->getPortCount(), STP_ROLE_DESIGNATED);
+        // Root port: lowest (root path cost, designated bridge, designated port, own port)
+        int root_port = Switch::NO_PORT;
+        tuple<uint64_t, uint64_t, uint16_t, uint16_t> best(UNREACHED, 0, 0, 0);
+        for (const auto& link : ports[u]) {
+            auto found = index.find(link.second);
+            if (found == index.end() || cost[u] == 0) {
+                continue;
+            }
+            int v = found->second;
+            int back = link.second->getPortTowards(self);
+            auto candidate = make_tuple(cost[v] + self->getPortPathCost(link.first), link.second->getBridgeId(),
+                                        link.second->getStpPortId(back), self->getStpPortId(link.first));
+            if (candidate < best) {
+                best = candidate;
+                root_port = link.first;
+            }
+        }
+        for (const auto& link : ports[u]) {
+            auto found = index.find(link.second);
+            if (found == index.end()) {
+                continue;
+            }
+            if ((int)link.first == root_port) {
+                roles[link.first] = STP_ROLE_ROOT;
+                continue;
+            }
+            // Whichever end offers the better message to the link is designated
+            int v = found->second;
+            int back = link.second->getPortTowards(self);
+            auto ours = make_tuple(root[u], cost[u], self->getBridgeId(), self->getStpPortId(link.first));
+            auto theirs = make_tuple(root[v], cost[v], link.second->getBridgeId(), link.second->getStpPortId(back));
+            if (theirs < ours) {
+                roles[link.first] = STP_ROLE_ALTERNATE;
+                blocked++;
+            }
         }
+        self->setStaticSpanningTree(roles, root[u]);
     }
+    return blocked;
+}
 
+// Sends a constant packet stream R1 -> R4 across a diamond topology, fails the primary
+// link R1-R2 and reports how many packets are lost before forwarding recovers.
+// Without fast reroute the outage lasts until SPF reconverges; with loop-free alternates
+// it ends as soon as the failure is detected.
+void runFastRerouteStudy(bool fastReroute, SimTime detectionDelay, SimTime spfDelay) {
+    simulator.reset();
+    LinkStateDatabase lsdb;
+    Router r1(1, "R1", 101, "R1", "10.0.0.1", "00:00:00:00:01:01", "255.255.255.0");
+    Router r2(2, "R2", 102, "R2", "10.0.0.2", "00:00:00:00:01:02", "255.255.255.0");
+    Router r3(3, "R3", 103, "R3", "10.0.0.3", "00:00:00:00:01:03", "255.255.255.0");
+    Router r4(4, "R4", 104, "R4", "10.0.0.4", "00:00:00:00:01:04", "255.255.255.0");
+    vector<Router*> routers = {&r1, &r2, &r3, &r4};
+
+    r1.connectRouter(&r2, 1, &lsdb);
+    r2.connectRouter(&r4, 1, &lsdb);
+    r1.connectRouter(&r3, 2, &lsdb);
+    r3.connectRouter(&r4, 1, &lsdb);
+
+    vector<OSPF*> instances;
+    unordered_map<string, Router*> byIP;
+    for (Router* router : routers) {
+        OSPF* ospf = new OSPF(&router->getRoutingTable());
+        ospf->attachLinkStateDatabase(&lsdb, router->getIpAddress());
+        ospf->setLoopFreeAlternates(fastReroute);
+        ospf->runSPF();
+        router->setRoutingProtocol(ospf);
+        router->setFastReroute(fastReroute);
+        instances.push_back(ospf);
+        byIP[router->getIpAddress()] = router;
+    }
 
-    void connectHub(Hub* hub) {
-        connected_hubs.push_back(hub);
+    const SimTime interval = 10 * MICROSECOND;
+    const SimTime failureTime = 1 * MILLISECOND;
+    const SimTime endTime = failureTime + detectionDelay + spfDelay + 1 * MILLISECOND;
+    bool physicalLinkUp = true; // State of the R1-R2 wire itself
+    long long sent = 0;
+    long long lost = 0;
+    SimTime firstLoss = -1;
+    SimTime lastLoss = -1;
+
+    function<void()> sendNext = [&]() {
+        sent++;
+        // Walk the packet hop by hop so every router's current FIB is used
+        Router* at = &r1;
+        bool delivered = false;
+        for (int ttl = 16; ttl > 0; ttl--) {
+            if (at == &r4) {
+                delivered = true;
+                break;
+            }
+            string nextHop = at->forwardPacket(r4.getIpAddress());
+            if (nextHop.empty()) {
+                break;
+            }
+            bool failedWire = (at == &r1 && nextHop == r2.getIpAddress()) || (at == &r2 && nextHop == r1.getIpAddress());
+            if (failedWire && !physicalLinkUp) {
+                break;
+            }
+            at = byIP[nextHop];
+        }
+        if (!delivered) {
+            lost++;
+            if (firstLoss < 0) {
+                firstLoss = simulator.now();
+            }
+            lastLoss = simulator.now();
+        }
+        if (simulator.now() + interval < endTime) {
+            simulator.schedule(interval, sendNext);
+        }
+    };
+    simulator.schedule(0, sendNext);
+
+    simulator.scheduleAt(failureTime, [&]() {
+        physicalLinkUp = false;
+    });
+    simulator.scheduleAt(failureTime + detectionDelay, [&]() {
+        r1.setLinkState(r2.getIpAddress(), false);
+        r2.setLinkState(r1.getIpAddress(), false);
+        lsdb.removeLink(r1.getIpAddress(), r2.getIpAddress());
+    });
+    simulator.scheduleAt(failureTime + detectionDelay + spfDelay, [&]() {
+        for (OSPF* ospf : instances) {
+            ospf->runSPF();
+        }
+    });
+    simulator.run();
+
+    cout << "Fast reroute " << (fastReroute ? "on " : "off") << ": sent " << sent << ", lost " << lost;
+    if (lost > 0) {
+        cout << ", outage " << (lastLoss - firstLoss + interval) / MICROSECOND << " us";
     }
+    cout << endl;
 
-    void disconnectHub(Hub* hub) {
-        auto it = find(connected_hubs.begin(), connected_hubs.end(), hub);
-    if (it != connected_hubs.end()) {
-        connected_hubs.erase(it);
-        hub->disconnectDevice(this);
-        disconnect();
+    for (OSPF* ospf : instances) {
+        delete ospf;
     }
+}
+
+// Feeds a router a stream of updates in which a subset of prefixes keeps flapping
+// between two next hops, and reports how much FIB work is done with and without
+// update coalescing plus flap damping. With damping on, one suppressed prefix is then
+// withdrawn to check that it stops forwarding at once instead of at reuse.
+void runFlapDampingStudy(bool damping) {
+    simulator.reset();
+    Router router(1, "R1", 101, "R1", "10.0.0.1", "00:00:00:00:01:01", "255.255.255.0");
+    RIP rip(&router.getRoutingTable());
+    router.setRoutingProtocol(&rip);
+    RouteFlapDamper damper(100 * MILLISECOND);
+    if (damping) {
+        router.setUpdateHolddown(1 * MILLISECOND);
+        router.setFlapDamping(&damper);
     }
 
-     RoutingTable& getRoutingTable() { // Add this method to retrieve the routing table
-        return routingTable;
+    const int prefixCount = 10000;
+    const int unstableCount = 500;
+    const SimTime churnInterval = 10 * MICROSECOND;
+    const SimTime duration = 1 * SECOND;
+    mt19937 gen(42);
+
+    unordered_map<string, string> initial;
+    for (int i = 0; i < prefixCount; i++) {
+        initial["10." + to_string(i / 256) + "." + to_string(i % 256) + ".0"] = "10.0.0.2";
+    }
+    router.updateRoutingTable(initial);
+
+    vector<bool> onBackup(unstableCount, false);
+    function<void()> flap = [&]() {
+        int i = gen() % unstableCount;
+        onBackup[i] = !onBackup[i];
+        string prefix = "10." + to_string(i / 256) + "." + to_string(i % 256) + ".0";
+        router.updateRoutingTable({{prefix, onBackup[i] ? "10.0.0.3" : "10.0.0.2"}});
+        if (simulator.now() + churnInterval < duration) {
+            simulator.schedule(churnInterval, flap);
+        }
+    };
+    simulator.schedule(churnInterval, flap);
+
+    // Once the churn stops, withdraw a prefix that is still suppressed and look it up
+    // after the hold-down but well before its reuse time
+    string withdrawn, withdrawnHop;
+    if (damping) {
+        simulator.scheduleAt(duration, [&]() {
+            for (int i = 0; i < unstableCount && withdrawn.empty(); i++) {
+                string prefix = "10." + to_string(i / 256) + "." + to_string(i % 256) + ".0";
+                if (damper.isSuppressed(prefix)) {
+                    withdrawn = prefix;
+                    router.updateRoutingTable({{prefix, ""}});
+                }
+            }
+        });
+        simulator.scheduleAt(duration + 2 * MILLISECOND, [&]() {
+            if (!withdrawn.empty()) {
+                withdrawnHop = router.forwardPacket(withdrawn);
+            }
+        });
     }
 
-     void setRoutingProtocol(RoutingProtocol* protocol) {
-        routingProtocol = protocol;
+    auto start = chrono::steady_clock::now();
+    simulator.run();
+    double cpuMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "Flap damping " << (damping ? "on " : "off") << ": updates " << router.getUpdatesReceived()
+         << ", FIB commits " << router.getFibCommits() << ", routes written " << router.getRoutesCommitted()
+         << ", suppressed " << router.getUpdatesSuppressed() << ", CPU " << cpuMs << " ms" << endl;
+    if (!withdrawn.empty()) {
+        cout << "  " << withdrawn << " withdrawn while suppressed: "
+             << (withdrawnHop.empty() ? "dropped" : "still forwarded to " + withdrawnHop) << endl;
     }
+}
 
-    void updateRoutingTable() {
-        // Simulating dynamic routing updates
-        unordered_map<string, string> dynamicRoutes;
+string benchmarkIP(int i) {
+    return "10." + to_string((i >> 16) & 255) + "." + to_string((i >> 8) & 255) + "." + to_string(i & 255);
+}
+
+string benchmarkMAC(int i) {
+    return ArpCache::unpackMAC(0x020000000000ULL + i);
+}
+
+// Flat layer-2 domain: access switches of `hostsPerSwitch` hosts hang off one core switch.
+// Every host starts talking to a random peer within the first millisecond, so all ARP
+// resolutions overlap. Reports broadcast load and first-packet latency.
+// Hosts are spread round-robin over tenants and only talk within their tenant. With useVlans
+// each tenant gets its own VLAN (access ports untagged, switch-to-switch links trunked).
+void runArpStormStudy(int hosts, int hostsPerSwitch, int tenants = 1, bool useVlans = false) {
+    simulator.reset();
+    verbose = false;
+    mt19937 gen(7);
+    const uint16_t firstTenantVlan = 100;
+    vector<uint16_t> tenantVlans;
+    for (int t = 0; t < tenants; t++) {
+        tenantVlans.push_back(firstTenantVlan + t);
+    }
+    Switch core(nullptr, nullptr);
+    vector<Switch*> access;
+    vector<EndDevice*> devices;
+    for (int i = 0; i < hosts; i++) {
+        if (i % hostsPerSwitch == 0) {
+            access.push_back(new Switch(nullptr, nullptr));
+            string corePort = "port" + to_string(access.size());
+            access.back()->connectSwitch(&core, "uplink", corePort);
+            if (useVlans) {
+                access.back()->setTrunkVlans("uplink", tenantVlans);
+                core.setTrunkVlans(corePort, tenantVlans);
+            }
+        }
+        EndDevice* device = new EndDevice(0, "", i, "Host " + to_string(i), nullptr, benchmarkMAC(i), "255.0.0.0");
+        device->setIpAddress(benchmarkIP(i));
+        string port = "port" + to_string(i % hostsPerSwitch);
+        if (useVlans) {
+            access.back()->setAccessVlan(port, tenantVlans[i % tenants]);
+        }
+        access.back()->connectDevice(device, port);
+        devices.push_back(device);
+    }
+
+    // A flow's packets all leave together, so the first one to arrive is the first packet
+    set<pair<string, int>> flowsSeen;
+    long long flows = 0;
+    SimTime firstLatency = 0, maxFirstLatency = 0;
+    for (int i = 0; i < hosts; i++) {
+        devices[i]->onDelivered([&flowsSeen, &flows, &firstLatency, &maxFirstLatency, i](const Frame& frame) {
+            if (flowsSeen.insert({frame.src_mac, i}).second) {
+                SimTime latency = simulator.now() - frame.created_at;
+                flows++;
+                firstLatency += latency;
+                maxFirstLatency = max(maxFirstLatency, latency);
+            }
+        });
+    }
+
+    const int packetsPerFlow = 3;
+    for (int i = 0; i < hosts; i++) {
+        int tenant = i % tenants;
+        int tenantSize = (hosts - tenant + tenants - 1) / tenants;
+        int peer = tenant + (i / tenants + 1 + gen() % (tenantSize - 1)) % tenantSize * tenants;
+        SimTime start = gen() % MILLISECOND;
+        EndDevice* device = devices[i];
+        string peerIP = devices[peer]->getIpAddress();
+        simulator.scheduleAt(start, [device, peerIP]() {
+            for (int p = 0; p < packetsPerFlow; p++) {
+                device->sendPacket(peerIP, "data");
+            }
+        });
+    }
+    simulator.run();
+
+    long long requests = 0, coalesced = 0, arpReceived = 0, delivered = 0, dropped = 0, switched = core.getFramesForwarded();
+    SimTime totalLatency = 0, maxLatency = 0;
+    for (EndDevice* device : devices) {
+        requests += device->getArpRequestsSent();
+        coalesced += device->getArpRequestsCoalesced();
+        arpReceived += device->getArpFramesReceived();
+        delivered += device->getPacketsDelivered();
+        dropped += device->getPacketsDropped();
+        totalLatency += device->getTotalLatency();
+        maxLatency = max(maxLatency, device->getMaxLatency());
+    }
+    for (Switch* sw : access) {
+        switched += sw->getFramesForwarded();
+    }
+    cout << "Hosts: " << hosts << ", switches: " << access.size() + 1;
+    if (tenants > 1) {
+        cout << ", tenants: " << tenants << (useVlans ? " (one VLAN each)" : " (shared VLAN)");
+    }
+    cout << endl;
+    cout << "ARP requests broadcast: " << requests << ", duplicate requests coalesced: " << coalesced << endl;
+    cout << "ARP frames received by hosts: " << arpReceived << " (" << (double)arpReceived / hosts << " per host)" << endl;
+    cout << "Frames forwarded by switches: " << switched << endl;
+    cout << "Packets delivered: " << delivered << ", dropped: " << dropped << endl;
+    if (flows > 0) {
+        cout << "First-packet latency: mean " << (double)firstLatency / flows / MICROSECOND << " us, max "
+             << (double)maxFirstLatency / MICROSECOND << " us over " << flows << " flows" << endl;
+    }
+    if (delivered > 0) {
+        cout << "All-packet latency: mean " << (double)totalLatency / delivered / MICROSECOND << " us, max "
+             << (double)maxLatency / MICROSECOND << " us" << endl;
+    }
+
+    for (EndDevice* device : devices) {
+        delete device;
+    }
+    for (Switch* sw : access) {
+        delete sw;
+    }
+    verbose = true;
+}
+
+struct BenchmarkTopology {
+    string name;
+    int nodes;
+    vector<pair<int, int>> links;
+};
+
+// Builds a ring, grid, random or fat-tree topology with roughly `size` routers
+BenchmarkTopology makeBenchmarkTopology(const string& kind, int size, mt19937& gen) {
+    BenchmarkTopology topology;
+    topology.name = kind;
+    if (kind == "ring") {
+        topology.nodes = max(size, 3);
+        for (int i = 0; i < topology.nodes; i++) {
+            topology.links.push_back({i, (i + 1) % topology.nodes});
+        }
+    } else if (kind == "grid") {
+        int side = max(2, (int)lround(sqrt((double)size)));
+        topology.nodes = side * side;
+        for (int r = 0; r < side; r++) {
+            for (int c = 0; c < side; c++) {
+                if (c + 1 < side) {
+                    topology.links.push_back({r * side + c, r * side + c + 1});
+                }
+                if (r + 1 < side) {
+                    topology.links.push_back({r * side + c, (r + 1) * side + c});
+                }
+            }
+        }
+    } else if (kind == "random") {
+        // Random spanning tree for connectivity plus n/2 extra links (average degree about 3)
+        topology.nodes = max(size, 2);
+        map<pair<int, int>, bool> present;
+        for (int i = 1; i < topology.nodes; i++) {
+            int j = gen() % i;
+            topology.links.push_back({j, i});
+            present[{j, i}] = true;
+        }
+        for (int attempts = 0, added = 0; added < topology.nodes / 2 && attempts < topology.nodes * 10; attempts++) {
+            int a = gen() % topology.nodes;
+            int b = gen() % topology.nodes;
+            if (a == b || present.count({min(a, b), max(a, b)}) > 0) {
+                continue;
+            }
+            present[{min(a, b), max(a, b)}] = true;
+            topology.links.push_back({min(a, b), max(a, b)});
+            added++;
+        }
+    } else if (kind == "fattree") {
+        // k-ary fat tree: (k/2)^2 core routers, k pods of k/2 aggregation + k/2 edge routers
+        int k = 2;
+        while (5 * k * k / 4 < size) {
+            k += 2;
+        }
+        int half = k / 2;
+        int cores = half * half;
+        topology.nodes = cores + k * k;
+        for (int pod = 0; pod < k; pod++) {
+            int aggBase = cores + pod * k;
+            int edgeBase = aggBase + half;
+            for (int a = 0; a < half; a++) {
+                for (int e = 0; e < half; e++) {
+                    topology.links.push_back({aggBase + a, edgeBase + e});
+                }
+                for (int c = 0; c < half; c++) {
+                    topology.links.push_back({a * half + c, aggBase + a});
+                }
+            }
+        }
+    } else {
+        topology.nodes = 0;
+    }
+    return topology;
+}
+
+// Routing convergence benchmark: brings RIP or OSPF up from a cold start on a topology,
+// then fails links one at a time. Every control message crosses a link in virtual time;
+// for each phase it records convergence time, control messages, CPU time spent computing
+// and committing routes, and peak RoutingTable memory.
+class RoutingConvergenceBenchmark {
+private:
+    struct LinkStateAdvertisement {
+        string origin;
+        long long seq;
+        unordered_map<string, int> links;
+    };
+
+    struct Node {
+        Router* router;
+        RIP* rip;
+        OSPF* ospf;
+        LinkStateDatabase lsdb;
+        unordered_map<int, int> neighbours; // Neighbour index -> cost, links currently up
+        unordered_map<string, long long> lsa_seq; // Originator IP -> newest LSA sequence seen
+        long long own_seq = 0;
+        unordered_map<string, int> pending_advert; // RIP changes waiting for the triggered update
+        bool advert_scheduled = false;
+        bool spf_scheduled = false;
+        size_t table_bytes = 0;
+    };
+
+    string protocol;
+    BenchmarkTopology topology;
+    vector<Node> nodes;
+    map<pair<int, int>, bool> link_up;
+    long long control_messages;
+    double update_cpu_us;
+    size_t table_bytes_total;
+    size_t peak_table_bytes;
+    SimTime last_change;
+
+    const SimTime link_delay = 1 * MILLISECOND;
+    const SimTime detection_delay = 10 * MILLISECOND;
+    const SimTime spf_delay = 5 * MILLISECOND;        // OSPF SPF throttle
+    const SimTime rip_period = 30 * SECOND;           // RIP periodic full update (RFC 2453)
+    const SimTime rip_phase_length = 6 * rip_period;  // RIP has no quiet state, so phases run for a fixed window
+
+    bool isLinkUp(int a, int b) {
+        return link_up[{min(a, b), max(a, b)}];
+    }
+
+    void send(int from, int to, function<void()> handler) {
+        control_messages++;
+        simulator.schedule(link_delay, [this, from, to, handler]() {
+            if (isLinkUp(from, to)) {
+                handler();
+            }
+        });
+    }
+
+    void noteChange(int i) {
+        last_change = simulator.now();
+        size_t bytes = nodes[i].router->getRoutingTable().memoryUsage();
+        table_bytes_total += bytes - nodes[i].table_bytes;
+        nodes[i].table_bytes = bytes;
+        peak_table_bytes = max(peak_table_bytes, table_bytes_total);
+    }
+
+    template <typename F>
+    auto timed(F work) {
+        auto start = chrono::steady_clock::now();
+        auto result = work();
+        update_cpu_us += chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // RIP: triggered updates carry only changed routes; coalesced per router
+    void ripSchedule(int i, const unordered_map<string, int>& changed) {
+        for (const auto& entry : changed) {
+            nodes[i].pending_advert[entry.first] = entry.second;
+        }
+        if (!nodes[i].advert_scheduled) {
+            nodes[i].advert_scheduled = true;
+            simulator.schedule(0, [this, i]() {
+                nodes[i].advert_scheduled = false;
+                unordered_map<string, int> routes;
+                routes.swap(nodes[i].pending_advert);
+                ripSend(i, routes);
+            });
+        }
+    }
+
+    void ripSend(int i, const unordered_map<string, int>& routes) {
+        for (const auto& link : nodes[i].neighbours) {
+            int j = link.first;
+            auto advert = make_shared<unordered_map<string, int>>(nodes[i].rip->advertisementFor(nodes[j].router->getIpAddress(), routes));
+            send(i, j, [this, i, j, advert]() { ripReceive(j, i, *advert); });
+        }
+    }
+
+    void ripReceive(int j, int from, const unordered_map<string, int>& advert) {
+        auto link = nodes[j].neighbours.find(from);
+        if (link == nodes[j].neighbours.end()) {
+            return;
+        }
+        int cost = link->second;
+        const string& fromIP = nodes[from].router->getIpAddress();
+        unordered_map<string, int> changed = timed([&]() { return nodes[j].rip->processAdvertisement(fromIP, cost, advert); });
+        if (!changed.empty()) {
+            noteChange(j);
+            ripSchedule(j, changed);
+        }
+    }
+
+    void ripPeriodic(int i) {
+        ripSend(i, nodes[i].rip->getMetrics());
+        simulator.schedule(rip_period, [this, i]() { ripPeriodic(i); });
+    }
+
+    // OSPF: router LSAs are flooded hop by hop; SPF runs after a throttle delay
+    void ospfOriginate(int i) {
+        auto lsa = make_shared<LinkStateAdvertisement>();
+        lsa->origin = nodes[i].router->getIpAddress();
+        lsa->seq = ++nodes[i].own_seq;
+        for (const auto& link : nodes[i].neighbours) {
+            lsa->links[nodes[link.first].router->getIpAddress()] = link.second;
+        }
+        ospfReceive(i, -1, lsa);
+    }
+
+    void ospfReceive(int j, int from, shared_ptr<LinkStateAdvertisement> lsa) {
+        auto seen = nodes[j].lsa_seq.find(lsa->origin);
+        if (seen != nodes[j].lsa_seq.end() && seen->second >= lsa->seq) {
+            return;
+        }
+        nodes[j].lsa_seq[lsa->origin] = lsa->seq;
+        nodes[j].lsdb.setRouterLinks(lsa->origin, lsa->links);
+        for (const auto& link : nodes[j].neighbours) {
+            int k = link.first;
+            if (k != from) {
+                send(j, k, [this, k, j, lsa]() { ospfReceive(k, j, lsa); });
+            }
+        }
+        if (!nodes[j].spf_scheduled) {
+            nodes[j].spf_scheduled = true;
+            simulator.schedule(spf_delay, [this, j]() {
+                nodes[j].spf_scheduled = false;
+                int changed = timed([&]() { return nodes[j].ospf->runSPF(); });
+                if (changed > 0) {
+                    noteChange(j);
+                }
+            });
+        }
+    }
+
+    void beginPhase() {
+        control_messages = 0;
+        update_cpu_us = 0;
+        last_change = simulator.now();
+        peak_table_bytes = table_bytes_total;
+    }
+
+    void endPhase(const string& event, SimTime start) {
+        if (protocol == "rip") {
+            simulator.runUntil(start + rip_phase_length);
+        } else {
+            simulator.run();
+        }
+        long long routes = 0;
+        for (Node& node : nodes) {
+            routes += node.router->getRoutingTable().getDynamicRoutes().size();
+        }
+        cout << protocol << "," << topology.name << "," << topology.nodes << "," << topology.links.size() << ","
+             << event << "," << (last_change - start) / MICROSECOND << "," << control_messages << ","
+             << (long long)update_cpu_us << "," << peak_table_bytes << "," << routes << endl;
+    }
+
+public:
+    RoutingConvergenceBenchmark(const string& protocolName, const BenchmarkTopology& topo) : nodes(topo.nodes) {
+        protocol = protocolName;
+        topology = topo;
+        table_bytes_total = 0;
+        for (int i = 0; i < topology.nodes; i++) {
+            string ip = benchmarkIP(i);
+            Node& node = nodes[i];
+            node.router = new Router(i, "R" + to_string(i), i, "R" + to_string(i), ip, "", "255.255.255.255");
+            node.rip = new RIP(&node.router->getRoutingTable());
+            node.rip->attachRouter(ip);
+            node.ospf = new OSPF(&node.router->getRoutingTable());
+            node.ospf->attachLinkStateDatabase(&node.lsdb, ip);
+            node.router->setRoutingProtocol(protocol == "rip" ? (RoutingProtocol*)node.rip : (RoutingProtocol*)node.ospf);
+            node.table_bytes = node.router->getRoutingTable().memoryUsage();
+            table_bytes_total += node.table_bytes;
+        }
+        for (const auto& link : topology.links) {
+            nodes[link.first].neighbours[link.second] = 1;
+            nodes[link.second].neighbours[link.first] = 1;
+            link_up[{min(link.first, link.second), max(link.first, link.second)}] = true;
+        }
+    }
+
+    ~RoutingConvergenceBenchmark() {
+        for (Node& node : nodes) {
+            delete node.rip;
+            delete node.ospf;
+            delete node.router;
+        }
+    }
+
+    void run(int failures, mt19937& gen) {
+        simulator.reset();
+        beginPhase();
+        for (int i = 0; i < topology.nodes; i++) {
+            if (protocol == "rip") {
+                // Jitter periodic updates so routers do not synchronise
+                simulator.schedule(gen() % rip_period, [this, i]() { ripPeriodic(i); });
+                ripSchedule(i, nodes[i].rip->getMetrics());
+            } else {
+                ospfOriginate(i);
+            }
+        }
+        endPhase("cold-start", 0);
+
+        for (int f = 0; f < failures; f++) {
+            vector<pair<int, int>> candidates;
+            for (const auto& link : link_up) {
+                if (link.second) {
+                    candidates.push_back(link.first);
+                }
+            }
+            if (candidates.empty()) {
+                break;
+            }
+            pair<int, int> failed = candidates[gen() % candidates.size()];
+            SimTime start = simulator.now();
+            beginPhase();
+            link_up[failed] = false;
+            simulator.schedule(detection_delay, [this, failed]() {
+                int a = failed.first;
+                int b = failed.second;
+                nodes[a].neighbours.erase(b);
+                nodes[b].neighbours.erase(a);
+                if (protocol == "rip") {
+                    for (auto end : {make_pair(a, b), make_pair(b, a)}) {
+                        const string& peerIP = nodes[end.second].router->getIpAddress();
+                        unordered_map<string, int> changed = timed([&]() { return nodes[end.first].rip->neighbourDown(peerIP); });
+                        if (!changed.empty()) {
+                            noteChange(end.first);
+                            ripSchedule(end.first, changed);
+                        }
+                    }
+                } else {
+                    ospfOriginate(a);
+                    ospfOriginate(b);
+                }
+            });
+            endPhase("fail R" + to_string(failed.first) + "-R" + to_string(failed.second), start);
+        }
+    }
+};
+
+// network_new bench-routing [ring|grid|random|fattree|all] [size] [failures] [seed]
+void runRoutingBenchmark(int argc, char* argv[]) {
+    string kind = argc > 2 ? argv[2] : "all";
+    int size = argc > 3 ? atoi(argv[3]) : 64;
+    int failures = argc > 4 ? atoi(argv[4]) : 3;
+    unsigned seed = argc > 5 ? atoi(argv[5]) : 1;
+    vector<string> kinds = {kind};
+    if (kind == "all") {
+        kinds = {"ring", "grid", "random", "fattree"};
+    }
+
+    cout << "protocol,topology,nodes,links,event,convergence_us,control_messages,update_cpu_us,peak_table_bytes,routes_installed" << endl;
+    vector<string> protocols = {"rip", "ospf"};
+    for (const string& topologyKind : kinds) {
+        for (const string& protocol : protocols) {
+            // Same seed for both protocols so they see the same topology and failures
+            mt19937 gen(seed);
+            BenchmarkTopology topology = makeBenchmarkTopology(topologyKind, size, gen);
+            if (topology.nodes == 0) {
+                cerr << "Unknown topology: " << topologyKind << endl;
+                return;
+            }
+            RoutingConvergenceBenchmark benchmark(protocol, topology);
+            benchmark.run(failures, gen);
+        }
+    }
+}
+
+// network_new stp [ring|grid|random|fattree] [size] [seed]
+// Layer-2 fabric on a benchmark topology with one host per switch. Every host ARPs for a
+// random peer and sends it a packet, first with no loop prevention (broadcast storm), then
+// with RSTP, then with the offline tree. After that one tree link fails and the tree repairs.
+void runSpanningTreeStudy(const string& kind, int size, unsigned seed) {
+    vector<string> modes = {"none", "rstp", "offline"};
+    const long long stormBudget = 2000000; // Frames switched before a storm is called
+    for (const string& mode : modes) {
+        simulator.reset();
+        verbose = false;
+        mt19937 gen(seed);
+        BenchmarkTopology topology = makeBenchmarkTopology(kind, size, gen);
+        if (topology.nodes == 0) {
+            cerr << "Unknown topology: " << kind << endl;
+            verbose = true;
+            return;
+        }
+        vector<Switch*> switches;
+        vector<EndDevice*> hosts;
+        for (int i = 0; i < topology.nodes; i++) {
+            switches.push_back(new Switch(nullptr, nullptr));
+            EndDevice* host = new EndDevice(0, "", i, "Host " + to_string(i), nullptr, benchmarkMAC(i), "255.0.0.0");
+            host->setIpAddress(benchmarkIP(i));
+            switches[i]->connectDevice(host, "host");
+            hosts.push_back(host);
+        }
+        for (const auto& link : topology.links) {
+            switches[link.first]->connectSwitch(switches[link.second], "to" + to_string(link.second), "to" + to_string(link.first));
+        }
+
+        auto framesSwitched = [&switches]() {
+            long long total = 0;
+            for (Switch* sw : switches) {
+                total += sw->getFramesForwarded();
+            }
+            return total;
+        };
+        auto blockedPorts = [&switches]() {
+            int blocked = 0;
+            for (Switch* sw : switches) {
+                blocked += sw->getBlockedPortCount();
+            }
+            return blocked;
+        };
+        auto lastChange = [&switches]() {
+            SimTime last = 0;
+            for (Switch* sw : switches) {
+                last = max(last, sw->getLastStpChange());
+            }
+            return last;
+        };
+        auto stpChanges = [&switches]() {
+            long long changes = 0;
+            for (Switch* sw : switches) {
+                changes += sw->getStpChanges();
+            }
+            return changes;
+        };
+        // Steps the simulation a link delay at a time so a storm can be cut off
+        auto runTraffic = [&](SimTime duration) {
+            SimTime end = simulator.now() + duration;
+            long long before = framesSwitched();
+            while (simulator.now() < end) {
+                simulator.runUntil(simulator.now() + LINK_DELAY);
+                if (framesSwitched() - before > stormBudget) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        cout << "Topology " << kind << ": " << topology.nodes << " switches, " << topology.links.size() << " links, tree mode " << mode << endl;
+        double computeMicros = 0;
+        if (mode == "rstp") {
+            for (Switch* sw : switches) {
+                sw->enableSpanningTree();
+            }
+            simulator.runUntil(10 * SECOND);
+            long long bpdus = 0;
+            for (Switch* sw : switches) {
+                bpdus += sw->getBpdusSent();
+            }
+            cout << "  RSTP converged in " << (double)lastChange() / MICROSECOND << " us, BPDUs over 10 s: " << bpdus << endl;
+        } else if (mode == "offline") {
+            auto start = chrono::steady_clock::now();
+            computeSpanningTree(switches);
+            computeMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            cout << "  Offline tree computed in " << computeMicros << " us of CPU" << endl;
+        }
+        int expectedBlocked = topology.links.size() - (topology.nodes - 1);
+        cout << "  Blocked ports: " << blockedPorts() << " (links beyond a tree: " << expectedBlocked << ")" << endl;
+
+        SimTime trafficStart = simulator.now();
+        for (int i = 0; i < topology.nodes; i++) {
+            EndDevice* host = hosts[i];
+            string peerIP = hosts[(i + 1 + gen() % (topology.nodes - 1)) % topology.nodes]->getIpAddress();
+            simulator.scheduleAt(trafficStart + gen() % MILLISECOND, [host, peerIP]() { host->sendPacket(peerIP, "data"); });
+        }
+        bool settled = runTraffic(10 * MILLISECOND);
+        long long delivered = 0;
+        for (EndDevice* host : hosts) {
+            delivered += host->getPacketsDelivered();
+        }
+        if (!settled) {
+            cout << "  Broadcast storm: over " << stormBudget << " frames switched after "
+                 << (double)(simulator.now() - trafficStart) / MICROSECOND << " us; " << delivered << "/" << topology.nodes << " packets delivered" << endl;
+        } else {
+            cout << "  Traffic: " << framesSwitched() << " frames switched, " << delivered << "/" << topology.nodes << " packets delivered" << endl;
+        }
+
+        if (mode != "none" && settled) {
+            // Fail the root port link of the last switch
+            Switch* victim = nullptr;
+            Switch* upstream = nullptr;
+            for (Switch* sw : switches) {
+                for (const auto& link : sw->getBridgePorts()) {
+                    if ((int)link.first == sw->getRootPort()) {
+                        victim = sw;
+                        upstream = link.second;
+                    }
+                }
+            }
+            if (victim != nullptr) {
+                SimTime failedAt = simulator.now();
+                long long changesBefore = stpChanges();
+                victim->disconnectSwitch(upstream);
+                double repairMicros = 0;
+                if (mode == "rstp") {
+                    simulator.runUntil(failedAt + 10 * SECOND);
+                } else {
+                    auto start = chrono::steady_clock::now();
+                    computeSpanningTree(switches);
+                    repairMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+                }
+                // Only role and state changes made after the failure count towards the repair
+                long long changes = stpChanges() - changesBefore;
+                if (changes == 0) {
+                    cout << "  Link failure: no port role or state changed";
+                } else {
+                    cout << "  Link failure: tree repaired in " << (double)(lastChange() - failedAt) / MICROSECOND
+                         << " us simulated after " << changes << " port role/state changes";
+                }
+                cout << (mode == "offline" ? " (" + to_string((long long)repairMicros) + " us of CPU)" : "")
+                     << ", blocked ports now " << blockedPorts() << endl;
+            }
+        }
+
+        simulator.reset(); // Drop pending frames before their endpoints go away
+        for (EndDevice* host : hosts) {
+            delete host;
+        }
+        for (Switch* sw : switches) {
+            delete sw;
+        }
+    }
+    verbose = true;
+}
+
+// network_new incast [senders] [frames_per_sender] [frame_bytes]
+// Many-to-one incast through one crossbar switch: every sender blasts at line rate to the
+// same sink, so its egress port is oversubscribed N:1. A victim flow between two other ports
+// runs at 10% load alongside; with virtual output queues it shouldn't see the congestion.
+struct IncastResult {
+    double sink_mbps;
+    long long sink_drops;
+    long long victim_sent;
+    long long victim_delivered;
+    SimTime victim_max_latency;
+    size_t buffer_peak;
+    long long drops[SharedPacketBuffer::DROP_CAUSES];
+};
+
+IncastResult runIncast(int senders, int framesPerSender, int bytes, size_t bufferBytes,
+                       SharedPacketBuffer::Policy policy, bool report) {
+    simulator.reset();
+    verbose = false;
+    Switch fabric(nullptr, nullptr);
+    fabric.enableFabric();
+    fabric.setSharedBuffer(bufferBytes, bufferBytes / 64, policy);
+    vector<EndDevice*> hosts;
+    auto addHost = [&](const string& port) {
+        int i = hosts.size();
+        EndDevice* host = new EndDevice(0, "", i, "Host " + to_string(i), nullptr, benchmarkMAC(i), "255.0.0.0");
+        host->setIpAddress(benchmarkIP(i));
+        fabric.connectDevice(host, port);
+        hosts.push_back(host);
+        return host;
+    };
+    EndDevice* sink = addHost("sink");
+    EndDevice* victim = addHost("victim");
+    EndDevice* victimSink = addHost("victim-sink");
+    vector<EndDevice*> sources;
+    for (int i = 0; i < senders; i++) {
+        sources.push_back(addHost("s" + to_string(i)));
+    }
+
+    // Resolve ARP and let the switch learn every station before measuring
+    string payload(max(bytes - 38, 0), 'x');
+    for (EndDevice* source : sources) {
+        source->sendPacket(sink->getIpAddress(), "warmup");
+    }
+    victim->sendPacket(victimSink->getIpAddress(), "warmup");
+    simulator.run();
+    fabric.resetPortStats();
+
+    SimTime start = simulator.now();
+    SimTime gap = serializationTime(bytes, DEFAULT_PORT_SPEED); // Back to back at line rate
+    for (int i = 0; i < senders; i++) {
+        EndDevice* source = sources[i];
+        string sinkIP = sink->getIpAddress();
+        for (int f = 0; f < framesPerSender; f++) {
+            simulator.scheduleAt(start + f * gap + i, [source, sinkIP, payload]() { source->sendPacket(sinkIP, payload); });
+        }
+    }
+    string victimIP = victimSink->getIpAddress();
+    SimTime span = framesPerSender * gap;
+    for (SimTime t = 0; t < span; t += 10 * gap) {
+        simulator.scheduleAt(start + t, [victim, victimIP, payload]() { victim->sendPacket(victimIP, payload); });
+    }
+    simulator.run();
+
+    if (report) {
+        cout << "Incast: " << senders << " senders x " << framesPerSender << " frames of " << bytes << " bytes into one 1 Gb/s port" << endl;
+        cout << "Offered " << senders << ":1, drained in " << (double)(simulator.now() - start) / MILLISECOND << " ms" << endl;
+        fabric.printPortStats(start);
+    }
+    IncastResult result;
+    Switch::PortQueueStats sinkStats = fabric.getPortStats("sink", true);
+    Switch::PortQueueStats victimIn = fabric.getPortStats("victim", false);
+    Switch::PortQueueStats victimOut = fabric.getPortStats("victim-sink", true);
+    result.sink_mbps = (double)sinkStats.bytes * 8 * SECOND / max(simulator.now() - start, (SimTime)1) / 1e6;
+    result.sink_drops = sinkStats.drops;
+    result.victim_sent = victimIn.frames + victimIn.drops;
+    result.victim_delivered = victimOut.frames;
+    result.victim_max_latency = victimOut.max_latency;
+    const SharedPacketBuffer& buffer = fabric.getSharedBuffer();
+    result.buffer_peak = buffer.getPeak();
+    for (int cause = 0; cause < SharedPacketBuffer::DROP_CAUSES; cause++) {
+        result.drops[cause] = buffer.getDrops((SharedPacketBuffer::DropCause)cause);
+    }
+
+    simulator.reset();
+    for (EndDevice* host : hosts) {
+        delete host;
+    }
+    verbose = true;
+    return result;
+}
+
+void runIncastStudy(int senders, int framesPerSender, int bytes) {
+    runIncast(senders, framesPerSender, bytes, 4 << 20, SharedPacketBuffer::BUFFER_DYNAMIC, true);
+}
+
+// network_new buffer [senders] [frames_per_sender]
+// The incast above across shared-buffer sizes, with every port given a fixed share versus
+// Choudhury-Hahne dynamic thresholds. Static partitioning strands memory on idle ports, so
+// the congested port drops earlier; dynamic thresholds lend it that memory but keep some
+// free for the victim flow.
+void runBufferStudy(int senders, int framesPerSender) {
+    cout << "buffer_kb,policy,sink_mbps,sink_drops,victim_delivered,victim_sent,victim_max_latency_us,peak_kb";
+    for (int cause = 0; cause < SharedPacketBuffer::DROP_CAUSES; cause++) {
+        cout << "," << SharedPacketBuffer::causeName((SharedPacketBuffer::DropCause)cause);
+    }
+    cout << endl;
+    for (size_t kb : {128, 512, 2048, 8192}) {
+        for (SharedPacketBuffer::Policy policy : {SharedPacketBuffer::BUFFER_STATIC, SharedPacketBuffer::BUFFER_DYNAMIC}) {
+            IncastResult result = runIncast(senders, framesPerSender, 1500, kb * 1024, policy, false);
+            cout << kb << "," << (policy == SharedPacketBuffer::BUFFER_DYNAMIC ? "dynamic" : "static") << ","
+                 << result.sink_mbps << "," << result.sink_drops << "," << result.victim_delivered << ","
+                 << result.victim_sent << "," << (double)result.victim_max_latency / MICROSECOND << ","
+                 << result.buffer_peak / 1024;
+            for (long long drops : result.drops) {
+                cout << "," << drops;
+            }
+            cout << endl;
+        }
+    }
+}
+
+// network_new forwarding [hops]
+// One packet between two hosts across a chain of switches, for each forwarding mode, frame
+// size and set of link rates. Store-and-forward pays a full frame time per hop; cut-through
+// pays only the header, except where the egress link is faster than the ingress one. A
+// second pass corrupts 10% of frames to show where each mode discards them.
+struct ForwardingChain {
+    vector<Switch*> switches;
+    EndDevice* source;
+    EndDevice* sink;
+
+    ForwardingChain(int hops, long long edgeSpeed, long long coreSpeed, ForwardingMode mode) {
+        for (int i = 0; i < hops; i++) {
+            switches.push_back(new Switch(nullptr, nullptr));
+            switches.back()->setForwardingMode(mode);
+        }
+        for (int i = 0; i + 1 < hops; i++) {
+            switches[i]->connectSwitch(switches[i + 1], "east", "west");
+            switches[i]->setPortSpeed("east", coreSpeed);
+            switches[i + 1]->setPortSpeed("west", coreSpeed);
+        }
+        source = new EndDevice(0, "", 0, "Source", nullptr, benchmarkMAC(0), "255.0.0.0");
+        sink = new EndDevice(0, "", 1, "Sink", nullptr, benchmarkMAC(1), "255.0.0.0");
+        source->setIpAddress(benchmarkIP(0));
+        sink->setIpAddress(benchmarkIP(1));
+        source->setNicSpeed(edgeSpeed);
+        sink->setNicSpeed(edgeSpeed);
+        switches.front()->connectDevice(source, "host");
+        switches.back()->connectDevice(sink, "host");
+        switches.front()->setPortSpeed("host", edgeSpeed);
+        switches.back()->setPortSpeed("host", edgeSpeed);
+        source->sendPacket(sink->getIpAddress(), "warmup"); // ARP and MAC learning out of the way
+        simulator.run();
+    }
+
+    ~ForwardingChain() {
+        for (Switch* sw : switches) {
+            delete sw;
+        }
+        delete source;
+        delete sink;
+        simulator.reset();
+    }
+};
+
+void runForwardingStudy(int hops) {
+    simulator.reset();
+    verbose = false;
+    struct Rates {
+        const char* name;
+        long long edge;
+        long long core;
+    };
+    vector<Rates> profiles = {{"10G", 10 * DEFAULT_PORT_SPEED, 10 * DEFAULT_PORT_SPEED},
+                              {"1G-edge/10G-core", DEFAULT_PORT_SPEED, 10 * DEFAULT_PORT_SPEED},
+                              {"10G-edge/1G-core", 10 * DEFAULT_PORT_SPEED, DEFAULT_PORT_SPEED}};
+    cout << "Forwarding latency across " << hops << " switches (" << (double)LINK_DELAY / MICROSECOND << " us per cable)" << endl;
+    cout << "rates,frame_bytes,store_and_forward_us,cut_through_us,saved_per_hop_us,hops_cut_through" << endl;
+    for (const Rates& rates : profiles) {
+        for (int bytes : {64, 512, 1500, 9000}) {
+            string payload(bytes - 38, 'x');
+            double latency[2];
+            long long cutThrough = 0;
+            for (ForwardingMode mode : {FORWARD_STORE_AND_FORWARD, FORWARD_CUT_THROUGH}) {
+                ForwardingChain chain(hops, rates.edge, rates.core, mode);
+                SimTime before = chain.sink->getTotalLatency();
+                for (Switch* sw : chain.switches) {
+                    cutThrough -= sw->getFramesCutThrough();
+                }
+                chain.source->sendPacket(chain.sink->getIpAddress(), payload);
+                simulator.run();
+                latency[mode] = (double)(chain.sink->getTotalLatency() - before) / MICROSECOND;
+                for (Switch* sw : chain.switches) {
+                    cutThrough += sw->getFramesCutThrough();
+                }
+            }
+            cout << rates.name << "," << bytes << "," << latency[FORWARD_STORE_AND_FORWARD] << ","
+                 << latency[FORWARD_CUT_THROUGH] << ","
+                 << (latency[FORWARD_STORE_AND_FORWARD] - latency[FORWARD_CUT_THROUGH]) / hops << "," << cutThrough << endl;
+        }
+    }
+
+    int frames = 1000;
+    cout << "Corrupting 10% of " << frames << " frames of 1500 bytes at the source:" << endl;
+    for (ForwardingMode mode : {FORWARD_STORE_AND_FORWARD, FORWARD_CUT_THROUGH}) {
+        ForwardingChain chain(hops, 10 * DEFAULT_PORT_SPEED, 10 * DEFAULT_PORT_SPEED, mode);
+        chain.source->setTransmitErrorRate(0.1);
+        string payload(1500 - 38, 'x');
+        for (int i = 0; i < frames; i++) {
+            chain.source->sendPacket(chain.sink->getIpAddress(), payload);
+        }
+        simulator.run();
+        long long dropped = 0, forwarded = 0;
+        for (Switch* sw : chain.switches) {
+            dropped += sw->getFcsDrops();
+            forwarded += sw->getFcsForwarded();
+        }
+        cout << "  " << (mode == FORWARD_CUT_THROUGH ? "cut-through" : "store-and-forward") << ": "
+             << dropped << " dropped by switches, " << forwarded << " corrupt frame-hops forwarded, "
+             << chain.sink->getFcsErrors() << " caught by the receiver" << endl;
+    }
+    verbose = true;
+}
+
+// network_new domains [nodes] [changes]
+// Builds a random campus of routers, switches, hubs and hosts, then churns it with random
+// cable moves, timing the incremental domain counts against a from-scratch recount.
+void runDomainStudy(int nodes, int changes) {
+    mt19937 gen(11);
+    vector<char> devices(nodes); // Stand-ins; the tracker only needs distinct addresses
+    vector<DomainRole> roles(nodes);
+    vector<int> infrastructure;
+    for (int i = 0; i < nodes; i++) {
+        int pick = gen() % 100;
+        roles[i] = i == 0 || pick < 1 ? DOMAIN_ROUTER : pick < 6 ? DOMAIN_BRIDGE : pick < 16 ? DOMAIN_REPEATER : DOMAIN_HOST;
+        if (roles[i] != DOMAIN_HOST) {
+            infrastructure.push_back(i);
+        }
+    }
+    DomainTracker tracker;
+    vector<pair<int, int>> cables;
+    auto cable = [&](int a, int b) {
+        tracker.connect(&devices[a], roles[a], &devices[b], roles[b]);
+        cables.push_back({a, b});
+    };
+    auto start = chrono::steady_clock::now();
+    vector<int> placed = {0};
+    for (int i = 1; i < nodes; i++) { // Everything hangs off some earlier infrastructure device
+        int parent = placed[gen() % placed.size()];
+        cable(parent, i);
+        if (roles[i] != DOMAIN_HOST) {
+            placed.push_back(i);
+        }
+    }
+    for (size_t i = 0; i < infrastructure.size() / 10; i++) { // Redundant uplinks close some loops
+        int a = infrastructure[gen() % infrastructure.size()];
+        int b = infrastructure[gen() % infrastructure.size()];
+        if (a != b) {
+            cable(a, b);
+        }
+    }
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Topology: " << nodes << " devices (" << infrastructure.size() << " routers, switches and hubs), "
+         << cables.size() << " cables, built in " << buildMs << " ms" << endl;
+    cout << "  Broadcast domains: " << tracker.broadcastDomains() << ", collision domains: " << tracker.collisionDomains() << endl;
+
+    // Moving a host never splits a domain, so this stays on the O(α(N)) path
+    auto move = [&](bool host) {
+        size_t victim;
+        do {
+            victim = gen() % cables.size();
+        } while ((roles[cables[victim].second] == DOMAIN_HOST) != host);
+        pair<int, int> moved = cables[victim];
+        tracker.disconnect(&devices[moved.first], &devices[moved.second]);
+        cables[victim] = cables.back();
+        cables.pop_back();
+        int target = infrastructure[gen() % infrastructure.size()];
+        cable(target != moved.second ? target : moved.first, moved.second);
+    };
+    start = chrono::steady_clock::now();
+    for (int c = 0; c < changes; c++) {
+        move(true);
+        tracker.broadcastDomains();
+        tracker.collisionDomains();
+    }
+    double hostNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / max(changes, 1);
+    cout << "  " << changes << " host moves, counts read after each: " << hostNs << " ns per move" << endl;
+
+    // Pulling an infrastructure tree cable searches the smaller half for another bridging cable
+    int recables = 100;
+    long long splitsBefore = tracker.getSplits();
+    long long replacementsBefore = tracker.getReplacements();
+    long long stepsBefore = tracker.getSearchSteps();
+    start = chrono::steady_clock::now();
+    for (int c = 0; c < recables; c++) {
+        move(false);
+        tracker.broadcastDomains();
+        tracker.collisionDomains();
+    }
+    double infraUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / recables;
+    cout << "  " << recables << " infrastructure re-cablings: " << infraUs << " us each, "
+         << tracker.getSplits() - splitsBefore << " splits, " << tracker.getReplacements() - replacementsBefore
+         << " bridged by another cable, " << (tracker.getSearchSteps() - stepsBefore) / recables << " cables scanned each" << endl;
+    size_t broadcast = tracker.broadcastDomains();
+    size_t collision = tracker.collisionDomains();
+
+    DomainTracker fresh;
+    for (const pair<int, int>& c : cables) {
+        fresh.connect(&devices[c.first], roles[c.first], &devices[c.second], roles[c.second]);
+    }
+    cout << "  Now " << broadcast << " broadcast and " << collision << " collision domains; recount from scratch: "
+         << fresh.broadcastDomains() << " and " << fresh.collisionDomains() << endl;
+}
+
+// network_new bench-crc
+// FCS throughput of each CRC-32 implementation at common frame sizes, after checking they agree
+void runCrcBenchmark() {
+    mt19937 gen(3);
+    vector<uint8_t> data(9018);
+    for (uint8_t& byte : data) {
+        byte = gen();
+    }
+    typedef uint32_t (*CrcFunction)(uint32_t, const uint8_t*, size_t);
+    vector<pair<string, CrcFunction>> variants = {{"bytewise", crc32Bytewise}, {"slice-by-8", crc32SliceBy8}};
+#ifdef CRC32_HAVE_CLMUL
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        variants.push_back({"pclmulqdq", crc32Clmul});
+    }
+#endif
+    for (size_t length = 64; length <= data.size(); length += 7) {
+        uint32_t expected = crc32Bytewise(0xFFFFFFFFu, data.data(), length);
+        for (auto& variant : variants) {
+            if (variant.second(0xFFFFFFFFu, data.data(), length) != expected) {
+                cout << variant.first << " disagrees at " << length << " bytes" << endl;
+                return;
+            }
+        }
+    }
+    cout << "CRC-32 check value: " << hex << crc32("123456789", 9) << dec << " (expected cbf43926)" << endl;
+    cout << "implementation,frame_bytes,ns_per_frame,gbit_per_s" << endl;
+    for (auto& variant : variants) {
+        for (size_t length : {64, 1518, 9018}) {
+            long long total = 64LL << 20; // Bytes per measurement
+            int rounds = total / length;
+            volatile uint32_t sink = 0; // Keeps the loop from being optimised away
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < rounds; i++) {
+                sink ^= variant.second(0xFFFFFFFFu ^ sink, data.data(), length);
+            }
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+            cout << variant.first << "," << length << "," << ns / rounds << "," << (double)rounds * length * 8 / ns << endl;
+        }
+    }
+}
+
+// network_new lag [members] [seed]
+// Two switches joined by an aggregate of 1 Gb/s members, carrying host-to-host flows at 80% of
+// the bundle's capacity. Per-flow hashing only balances well with many more flows than
+// members. A second run cuts one member mid-way to show the frames lost before LACP reacts
+// and how the load redistributes.
+struct LagStudyResult {
+    vector<Switch::LagMember> members;
+    long long sent;
+    long long delivered;
+    SimTime elapsed;
+};
+
+LagStudyResult runLagTraffic(int members, int flows, SimTime duration, int failMember, SimTime failAt, SimTime detection) {
+    simulator.reset();
+    verbose = false;
+    Switch left(nullptr, nullptr);
+    Switch right(nullptr, nullptr);
+    left.connectAggregate(&right, "lag", "lag", members);
+    vector<EndDevice*> sources, sinks;
+    for (int i = 0; i < flows; i++) {
+        EndDevice* source = new EndDevice(0, "", 2 * i, "a" + to_string(i), nullptr, benchmarkMAC(2 * i), "255.0.0.0");
+        EndDevice* sink = new EndDevice(0, "", 2 * i + 1, "b" + to_string(i), nullptr, benchmarkMAC(2 * i + 1), "255.0.0.0");
+        source->setIpAddress(benchmarkIP(2 * i));
+        sink->setIpAddress(benchmarkIP(2 * i + 1));
+        left.connectDevice(source, "a" + to_string(i));
+        right.connectDevice(sink, "b" + to_string(i));
+        sources.push_back(source);
+        sinks.push_back(sink);
+    }
+    for (int i = 0; i < flows; i++) {
+        sources[i]->sendPacket(sinks[i]->getIpAddress(), "warmup");
+    }
+    simulator.run();
+    vector<Switch::LagMember> before = left.getAggregateMembers("lag");
+    long long deliveredBefore = 0;
+    for (EndDevice* sink : sinks) {
+        deliveredBefore += sink->getPacketsDelivered();
+    }
+
+    // Each flow sends 1500-byte packets evenly spaced, with a random phase
+    mt19937 gen(flows);
+    string payload(1500 - 38, 'x');
+    SimTime gap = serializationTime(1500, DEFAULT_PORT_SPEED) * flows * 10 / (members * 8);
+    SimTime start = simulator.now();
+    long long sent = 0;
+    for (int i = 0; i < flows; i++) {
+        EndDevice* source = sources[i];
+        string sinkIP = sinks[i]->getIpAddress();
+        for (SimTime at = start + gen() % gap; at < start + duration; at += gap) {
+            simulator.scheduleAt(at, [source, sinkIP, payload]() { source->sendPacket(sinkIP, payload); });
+            sent++;
+        }
+    }
+    if (failMember >= 0) {
+        simulator.scheduleAt(start + failAt, [&left, failMember, detection]() { left.failAggregateMember("lag", failMember, detection); });
+    }
+    simulator.run();
+
+    LagStudyResult result;
+    result.members = left.getAggregateMembers("lag");
+    for (size_t m = 0; m < result.members.size(); m++) {
+        result.members[m].frames -= before[m].frames;
+        result.members[m].bytes -= before[m].bytes;
+        result.members[m].busy_time -= before[m].busy_time;
+        result.members[m].drops -= before[m].drops;
+    }
+    result.sent = sent;
+    result.elapsed = simulator.now() - start;
+    result.delivered = -deliveredBefore;
+    for (EndDevice* sink : sinks) {
+        result.delivered += sink->getPacketsDelivered();
+    }
+    simulator.reset();
+    for (int i = 0; i < flows; i++) {
+        delete sources[i];
+        delete sinks[i];
+    }
+    verbose = true;
+    return result;
+}
 
-        // Generate random dynamic routes for testing
-        dynamicRoutes["192.168.0.0"] = "192.168.1.1";
-        dynamicRoutes["10.0.0.0"] = "10.0.0.1";
+void runLagStudy(int members) {
+    SimTime duration = 20 * MILLISECOND;
+    cout << "Aggregate of " << members << " x 1 Gb/s, offered 80% of capacity for "
+         << (double)duration / MILLISECOND << " ms" << endl;
+    cout << "flows,busiest_share_pct,idlest_share_pct,imbalance,drain_ms" << endl;
+    for (int flows : {members, 4 * members, 16 * members, 64 * members}) {
+        LagStudyResult result = runLagTraffic(members, flows, duration, -1, 0, 0);
+        double busiest = 0, idlest = -1, total = 0;
+        for (const Switch::LagMember& member : result.members) {
+            busiest = max(busiest, (double)member.bytes);
+            idlest = idlest < 0 ? member.bytes : min(idlest, (double)member.bytes);
+            total += member.bytes;
+        }
+        // drain_ms is how long the busiest member kept sending after the offered load stopped
+        cout << flows << "," << 100 * busiest / total << "," << 100 * idlest / total << ","
+             << busiest / (total / members) << "," << (double)(result.elapsed - duration) / MILLISECOND << endl;
+    }
 
-        routingProtocol->updateRoutingTable(dynamicRoutes);
+    int flows = 16 * members;
+    SimTime detection = 2 * MILLISECOND; // Scaled down from LACP_TIMEOUT to fit the run
+    cout << "Member 0 cut after " << (double)duration / 2 / MILLISECOND << " ms with " << flows << " flows, detected after "
+         << (double)detection / MILLISECOND << " ms:" << endl;
+    LagStudyResult result = runLagTraffic(members, flows, duration, 0, duration / 2, detection);
+    cout << "member,frames,utilisation_pct,drops" << endl;
+    for (size_t m = 0; m < result.members.size(); m++) {
+        const Switch::LagMember& member = result.members[m];
+        cout << m << "," << member.frames << "," << 100.0 * member.busy_time / result.elapsed << "," << member.drops << endl;
     }
+    cout << "Delivered " << result.delivered << " of " << result.sent << " packets" << endl;
+}
 
-    void printRoutingTable() {
-        routingTable.printRoutingTable();
+// network_new acl [rules]
+// Times the tuple space classifier against a first-match scan over synthetic access lists of
+// growing size, checks both pick the same rule, then filters SSH through a switch port ACL and
+// through a router's ingress ACL.
+// Rules use the handful of prefix lengths and port shapes typical of enterprise lists, so the
+// number of tuples levels off while the rule count keeps growing.
+AclRule randomAclRule(mt19937& gen) {
+    static const uint16_t services[] = {22, 25, 53, 80, 110, 123, 143, 161, 443, 3306, 3389, 8080};
+    auto pick = [&](int percent) { return (int)(gen() % 100) < percent; };
+    AclRule rule;
+    rule.action = pick(50) ? ACL_PERMIT : ACL_DENY;
+    int srcLengths[] = {0, 0, 24, 32};
+    int dstLengths[] = {16, 24, 32};
+    rule.src_len = srcLengths[gen() % 4];
+    rule.dst_len = dstLengths[gen() % 3];
+    rule.src_ip = (0x0A000000u | (gen() & 0x00FFFFFFu)) & AclRule::prefixMask(rule.src_len);
+    rule.dst_ip = (0x0A000000u | (gen() & 0x00FFFFFFu)) & AclRule::prefixMask(rule.dst_len);
+    if (pick(80)) {
+        rule.protocol = pick(60) ? IP_PROTO_TCP : IP_PROTO_UDP;
+        if (pick(70)) {
+            rule.dst_port_low = rule.dst_port_high = services[gen() % 12];
+        } else if (pick(50)) {
+            rule.dst_port_low = 1024; // Ephemeral range, split into 6 prefixes
+        }
+    }
+    if (pick(5)) {
+        rule.vlan = 1 + gen() % 16;
     }
+    return rule;
+}
 
+// A header inside a random rule half the time, otherwise anywhere in 10.0.0.0/8
+PacketHeader randomAclHeader(mt19937& gen, const vector<AclRule>& rules) {
+    PacketHeader header;
+    header.src_ip = 0x0A000000u | (gen() & 0x00FFFFFFu);
+    header.dst_ip = 0x0A000000u | (gen() & 0x00FFFFFFu);
+    header.protocol = gen() % 2 ? IP_PROTO_TCP : IP_PROTO_UDP;
+    header.src_port = 1024 + gen() % 64512;
+    header.dst_port = gen() % 2 ? 443 : gen() % 65536;
+    header.vlan = 1 + gen() % 16;
+    header.src_mac = 0x020000000000ULL + gen() % 4096;
+    header.dst_mac = 0x020000000000ULL + gen() % 4096;
+    if (gen() % 2) {
+        const AclRule& rule = rules[gen() % rules.size()];
+        uint32_t srcMask = AclRule::prefixMask(rule.src_len), dstMask = AclRule::prefixMask(rule.dst_len);
+        header.src_ip = (rule.src_ip & srcMask) | (header.src_ip & ~srcMask);
+        header.dst_ip = (rule.dst_ip & dstMask) | (header.dst_ip & ~dstMask);
+        header.src_port = rule.src_port_low + gen() % (rule.src_port_high - rule.src_port_low + 1);
+        header.dst_port = rule.dst_port_low + gen() % (rule.dst_port_high - rule.dst_port_low + 1);
+        header.protocol = rule.protocol != 0 ? rule.protocol : header.protocol;
+        header.vlan = rule.vlan != 0 ? rule.vlan : header.vlan;
+    }
+    return header;
+}
 
-    void performStaticRouting(const string& destinationIP) {
-        string nextHopIP = routingTable.getNextHop(destinationIP);
-        if (!nextHopIP.empty()) {
-            cout << "Performing static routing for destination IP: " << destinationIP << endl;
-            cout << "Next hop IP: " << nextHopIP << endl;
-        } else {
-            cout << "No static route found for destination IP: " << destinationIP << endl;
+void runAclStudy(int maxRules) {
+    mt19937 gen(42);
+    const int packets = 200000;
+    cout << "rules,tuples,entries,probes_per_packet,classifier_ns,linear_ns,mismatches" << endl;
+    for (int count = 10; count <= maxRules; count *= 10) {
+        PacketClassifier classifier;
+        vector<AclRule> rules;
+        gen.seed(count);
+        for (int i = 0; i < count; i++) {
+            rules.push_back(randomAclRule(gen));
+            classifier.addRule(rules.back());
+        }
+        vector<PacketHeader> headers;
+        for (int i = 0; i < packets; i++) {
+            headers.push_back(randomAclHeader(gen, rules));
+        }
+        classifier.getTupleCount(); // Compile outside the timed loop
+        classifier.resetStats();
+        volatile int sink = 0;
+        auto start = chrono::steady_clock::now();
+        for (const PacketHeader& header : headers) {
+            sink = sink + classifier.match(header);
+        }
+        double tupleNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / packets;
+        // The scan is too slow to run every header through at the larger sizes
+        int sampled = min(packets, 20000000 / count);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < sampled; i++) {
+            sink = sink + classifier.matchLinear(headers[i]);
+        }
+        double linearNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / sampled;
+        double probes = classifier.getMeanProbes();
+        long long mismatches = 0;
+        for (int i = 0; i < sampled; i++) {
+            mismatches += classifier.matchTuples(headers[i]) != classifier.matchLinear(headers[i]);
         }
+        cout << count << "," << classifier.getTupleCount() << "," << classifier.getEntryCount() << "," << probes << ","
+             << tupleNs << "," << linearNs << "," << mismatches << endl;
     }
-};
 
+    // Port ACL on a switch: block SSH from one host, permit everything else
+    verbose = false;
+    Switch sw(nullptr, nullptr);
+    EndDevice client(0, "", 1, "client", nullptr, benchmarkMAC(1), "255.0.0.0");
+    EndDevice server(0, "", 2, "server", nullptr, benchmarkMAC(2), "255.0.0.0");
+    client.setIpAddress(benchmarkIP(1));
+    server.setIpAddress(benchmarkIP(2));
+    sw.connectDevice(&client, "client");
+    sw.connectDevice(&server, "server");
+    PacketClassifier acl(ACL_PERMIT);
+    AclRule ssh;
+    ssh.action = ACL_DENY;
+    ssh.protocol = IP_PROTO_TCP;
+    ssh.dst_ip = ArpCache::packIP(server.getIpAddress());
+    ssh.dst_len = 32;
+    ssh.dst_port_low = ssh.dst_port_high = 22;
+    acl.addRule(ssh);
+    sw.setIngressAcl("client", &acl);
+    for (int i = 0; i < 10; i++) {
+        client.sendPacket(server.getIpAddress(), "ssh", IP_PROTO_TCP, 40000 + i, 22);
+        client.sendPacket(server.getIpAddress(), "https", IP_PROTO_TCP, 40000 + i, 443);
+    }
+    simulator.run();
+    cout << "Switch port ACL denying TCP/22 to the server: " << server.getPacketsDelivered() << " of 20 packets delivered, "
+         << sw.getAclDrops() << " dropped" << endl;
+
+    // The same list as a router's ingress ACL: the client now sends to the router's MAC and the
+    // router routes the packets back out to the server
+    sw.setIngressAcl("client", nullptr);
+    Router router(1, "R1", 3, "R1", benchmarkIP(3), benchmarkMAC(3), "255.0.0.0");
+    sw.connectDevice(&router, "router");
+    router.addStaticRoute(server.getIpAddress(), server.getIpAddress());
+    router.setIngressAcl(&acl);
+    long long deliveredBefore = server.getPacketsDelivered();
+    auto sendViaRouter = [&](const string& data, uint16_t srcPort, uint16_t dstPort) {
+        Frame frame;
+        frame.src_mac = client.getMacAddress();
+        frame.src_key = macKey(frame.src_mac);
+        frame.dst_mac = router.getMacAddress();
+        frame.dst_key = macKey(frame.dst_mac);
+        frame.sender_ip = client.getIpAddress();
+        frame.target_ip = server.getIpAddress();
+        frame.ip_protocol = IP_PROTO_TCP;
+        frame.src_port = srcPort;
+        frame.dst_port = dstPort;
+        frame.payload = data;
+        frame.created_at = simulator.now();
+        client.sendFrame(frame);
+    };
+    for (int i = 0; i < 10; i++) {
+        sendViaRouter("ssh", 40000 + i, 22);
+        sendViaRouter("https", 40000 + i, 443);
+    }
+    simulator.run();
+    cout << "Router ingress ACL denying TCP/22 to the server: " << server.getPacketsDelivered() - deliveredBefore
+         << " of 20 packets delivered, " << router.getPacketsRouted() << " routed, " << router.getAclDrops()
+         << " dropped" << endl;
+
+    // Two routers whose static routes point at each other: the TTL ends the loop
+    Router peer(2, "R2", 4, "R2", benchmarkIP(4), benchmarkMAC(4), "255.0.0.0");
+    sw.connectDevice(&peer, "peer");
+    router.addStaticRoute(benchmarkIP(9), peer.getIpAddress());
+    peer.addStaticRoute(benchmarkIP(9), router.getIpAddress());
+    long long routedBefore = router.getPacketsRouted();
+    Frame looped;
+    looped.src_mac = client.getMacAddress();
+    looped.src_key = macKey(looped.src_mac);
+    looped.dst_mac = router.getMacAddress();
+    looped.dst_key = macKey(looped.dst_mac);
+    looped.sender_ip = client.getIpAddress();
+    looped.target_ip = benchmarkIP(9);
+    looped.payload = "loop";
+    client.sendFrame(looped);
+    simulator.run();
+    cout << "Routing loop between two routers: " << router.getPacketsRouted() - routedBefore + peer.getPacketsRouted()
+         << " hops before " << router.getTtlDrops() + peer.getTtlDrops() << " TTL drop" << endl;
+    simulator.reset();
+    verbose = true;
+}
 
-class FlowControlProtocol {
-public:
-    virtual bool canSendPacket(const std::string& destination_mac, int seqNum) = 0;
-    virtual void receiveAck(int ackNum) = 0;
+// network_new csma-cd [stations]
+// Stations on one 10 Mb/s hub segment under CSMA/CD, each fed Poisson traffic, swept over the
+// offered load G (frames per frame time, all stations together). Efficiency is the share of
+// the run spent carrying frames that got through. The Metcalfe-Boggs estimate 1 / (1 + 5.4a),
+// with a the one-way propagation delay over the frame time, is printed for comparison.
+struct CsmaCdResult {
+    double efficiency;
+    double mean_delay;     // Microseconds
+    double collisions;     // Per frame sent
+    long long excess;
+    long long backlog;     // Frames still queued when the run ended
 };
 
-class GoBackN : public FlowControlProtocol {
-    private:
-    int windowSize_;
-    int Sf;     
-    int Sn;   
-    int timer; // Timer variable to track the timeout
-
-public:
-    GoBackN(int windowSize) : windowSize_(windowSize), Sf(1), Sn(1), timer(0) {
+CsmaCdResult runCsmaCdLoad(int stations, int frameBytes, SimTime propagation, double load, double frameTimes) {
+    simulator.reset();
+    CsmaCd medium(10000000LL, propagation, stations);
+    for (int i = 0; i < stations; i++) {
+        medium.addStation();
     }
-
-    bool canSendPacket(const std::string& destination_mac, int seqNum) override {
-        if (Sn < Sf + windowSize_) {
-            std::cout << "Sending packet with sequence number " << seqNum << std::endl;
-            Sn++;
-            // Start the timer
-            timer = 10; // Setting the timer value to 10 (example value)
-            return true;
+    Frame frame;
+    frame.payload.assign(frameBytes - 38, 'x');
+    SimTime frameTime = (frameBytes + ETHERNET_PREAMBLE) * 8LL * SECOND / medium.getBitRate();
+    SimTime duration = (SimTime)(frameTimes * frameTime);
+    double meanGap = frameTime * stations / load; // Per station
+    mt19937_64 gen(stations * 7919 + frameBytes);
+    exponential_distribution<double> gap(1.0 / meanGap);
+    long long offered = 0;
+    for (int station = 0; station < stations; station++) {
+        for (SimTime at = (SimTime)gap(gen); at < duration; at += (SimTime)gap(gen) + 1) {
+            simulator.scheduleAt(at, [&medium, station, &frame]() { medium.enqueue(station, frame); });
+            offered++;
         }
-        std::cout << "Window is full. Waiting for acknowledgements..." << std::endl;
-        return false;
     }
+    simulator.runUntil(duration);
+    const CsmaCd::Stats& stats = medium.getStats();
+    CsmaCdResult result;
+    result.efficiency = (double)stats.bits_sent * SECOND / medium.getBitRate() / duration;
+    result.mean_delay = stats.frames_sent > 0 ? (double)stats.total_delay / stats.frames_sent / MICROSECOND : 0;
+    result.collisions = stats.frames_sent > 0 ? (double)stats.collisions / stats.frames_sent : 0;
+    result.excess = stats.excess_collisions;
+    result.backlog = offered - stats.frames_sent - stats.excess_collisions;
+    simulator.reset();
+    return result;
+}
 
-    void receiveAck(int ackNum) override {
-        std::cout << "Received acknowledgement for packet with sequence number " << ackNum << std::endl;
-        Sf = ackNum + 1;
-        // Reset the timer when an acknowledgment is received
-        timer = 0;
+void runCsmaCdStudy(int stations) {
+    cout << "frame_bytes,propagation_us,a,metcalfe_boggs,G,efficiency,mean_delay_us,collisions_per_frame,excess_drops,backlog"
+         << endl;
+    for (int frameBytes : {64, 1518}) {
+        for (SimTime propagation : {2 * LINK_DELAY, 25 * MICROSECOND}) {
+            SimTime frameTime = (frameBytes + ETHERNET_PREAMBLE) * 8LL * SECOND / 10000000LL;
+            double a = (double)propagation / frameTime;
+            for (double load : {0.1, 0.3, 0.5, 0.7, 0.9, 1.2, 2.0, 5.0}) {
+                CsmaCdResult result = runCsmaCdLoad(stations, frameBytes, propagation, load, 20000);
+                cout << frameBytes << "," << (double)propagation / MICROSECOND << "," << a << "," << 1 / (1 + 5.4 * a) << ","
+                     << load << "," << result.efficiency << "," << result.mean_delay << "," << result.collisions << ","
+                     << result.excess << "," << result.backlog << endl;
+            }
+        }
     }
-};
 
-class StopNWait : public FlowControlProtocol {
-private:
-    int expected_seq_num;
+    // The same MAC behind real hosts: every host on a hub sends to every other one
+    verbose = false;
+    Hub hub(1, "hub", 0, "hub", "", "00:00:00:00:01:00", nullptr);
+    hub.enableCsmaCd();
+    vector<EndDevice*> hosts;
+    for (int i = 0; i < 16; i++) {
+        hosts.push_back(new EndDevice(0, "", i + 1, "h" + to_string(i), nullptr, benchmarkMAC(i + 1), "255.0.0.0"));
+        hosts.back()->setIpAddress(benchmarkIP(i + 1));
+        hub.connectDevice(hosts.back());
+    }
+    for (EndDevice* from : hosts) {
+        for (EndDevice* to : hosts) {
+            if (from != to) {
+                from->sendPacket(to->getIpAddress(), string(500, 'x'));
+            }
+        }
+    }
+    simulator.run();
+    long long delivered = 0;
+    for (EndDevice* host : hosts) {
+        delivered += host->getPacketsDelivered();
+    }
+    const CsmaCd::Stats& stats = hub.getCsmaCd()->getStats();
+    cout << "Hub segment of 16 hosts, all-to-all: " << delivered << " of 240 packets delivered, " << stats.frames_sent
+         << " frames on the wire, " << stats.collisions << " collisions, " << stats.excess_collisions
+         << " frames lost to excess collisions" << endl;
+    simulator.reset();
+    for (EndDevice* host : hosts) {
+        delete host;
+    }
+    verbose = true;
+}
 
-int timer; // Timer variable to track the timeout
+// network_new csma-ca [stations]
+// Saturated 802.11 stations sending 1500-byte frames to one access point at 54 Mb/s, with and
+// without RTS/CTS. With every station in range of every other, throughput is set against
+// Bianchi's analytic model. Then stations are scattered over a disc around the access point
+// and only hear neighbours within a sensing range, so some are hidden from each other.
+
+// Bianchi (2000): saturation throughput of DCF for n stations in range of each other
+double bianchiThroughput(const CsmaCa& medium, int n, bool rtsCts) {
+    const double W = CsmaCa::CW_MIN + 1;
+    const int m = (int)round(log2((CsmaCa::CW_MAX + 1) / W));
+    auto tauOf = [&](double p) {
+        return 2 * (1 - 2 * p) / ((1 - 2 * p) * (W + 1) + p * W * (1 - pow(2 * p, m)));
+    };
+    double low = 0, high = 1; // Fixed point of tau = f(p(tau)), by bisection
+    for (int i = 0; i < 100; i++) {
+        double tau = (low + high) / 2;
+        double p = 1 - pow(1 - tau, n - 1);
+        (tauOf(p) > tau ? low : high) = tau;
+    }
+    double tau = (low + high) / 2;
+    double transmit = 1 - pow(1 - tau, n);
+    double success = n * tau * pow(1 - tau, n - 1) / transmit;
+    double data = medium.dataAirtime(), ack = medium.controlAirtime(CsmaCa::ACK_BYTES);
+    double successTime, collisionTime;
+    if (rtsCts) {
+        double rts = medium.controlAirtime(CsmaCa::RTS_BYTES), cts = medium.controlAirtime(CsmaCa::CTS_BYTES);
+        successTime = rts + cts + data + ack + 3 * CsmaCa::SIFS + CsmaCa::DIFS;
+        collisionTime = rts + CsmaCa::DIFS;
+    } else {
+        successTime = data + ack + CsmaCa::SIFS + CsmaCa::DIFS;
+        collisionTime = data + CsmaCa::DIFS;
+    }
+    double payload = 1500 * 8.0 * SECOND / 54000000LL;
+    return success * transmit * payload /
+           ((1 - transmit) * CsmaCa::SLOT + transmit * success * successTime + transmit * (1 - success) * collisionTime);
+}
 
-public:
-    StopNWait() {
-        expected_seq_num = 0;
-        timer = 0;
+void runCsmaCaStudy(int maxStations) {
+    SimTime duration = 2 * SECOND;
+    // Bianchi's model never drops a frame, so it is checked against a run without the retry limit
+    cout << "stations,rts_cts,throughput,collision_probability,fairness,mean_delay_ms,drops,"
+         << "throughput_no_retry_limit,bianchi" << endl;
+    for (int stations : {2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000}) {
+        if (stations > maxStations) {
+            break;
+        }
+        for (bool rtsCts : {false, true}) {
+            double throughput[2];
+            for (int unlimited = 0; unlimited < 2; unlimited++) {
+                simulator.reset();
+                CsmaCa medium(stations, 54000000LL, 1500, rtsCts, stations);
+                if (unlimited) {
+                    medium.setRetryLimit(numeric_limits<int>::max());
+                }
+                medium.setSaturated(true);
+                simulator.runUntil(duration);
+                throughput[unlimited] = medium.throughput(duration);
+                const CsmaCa::Stats& stats = medium.getStats();
+                if (!unlimited) {
+                    cout << stations << "," << rtsCts << "," << throughput[0] << ","
+                         << (double)stats.collisions / max(stats.attempts, 1LL) << "," << medium.fairness() << ","
+                         << (stats.frames_sent > 0 ? (double)stats.total_delay / stats.frames_sent / MILLISECOND : 0) << ","
+                         << stats.drops << ",";
+                } else {
+                    cout << throughput[1] << "," << bianchiThroughput(medium, stations, rtsCts) << endl;
+                }
+                simulator.reset();
+            }
+        }
     }
 
-    bool canSendPacket(const std::string& destination_mac, int seqNum) {
-        if (seqNum == expected_seq_num) {
-            std::cout << "Sending packet with sequence number " << seqNum << std::endl;
-            // Start the timer
-            timer = 10; // Setting the timer value to 10 (example value)
-            return true;
+    int stations = min(maxStations, 50);
+    cout << "Hidden terminals, " << stations << " stations within radius 1 of the access point:" << endl;
+    cout << "sensing_range,hidden_pairs_pct,rts_cts,throughput,collision_probability,fairness" << endl;
+    mt19937 gen(11);
+    uniform_real_distribution<double> unit(0, 1);
+    vector<pair<double, double>> positions;
+    for (int i = 0; i < stations; i++) {
+        double radius = sqrt(unit(gen)), angle = 2 * M_PI * unit(gen);
+        positions.push_back({radius * cos(angle), radius * sin(angle)});
+    }
+    for (double range : {2.0, 1.2, 0.8}) {
+        for (bool rtsCts : {false, true}) {
+            simulator.reset();
+            CsmaCa medium(stations, 54000000LL, 1500, rtsCts, 7);
+            long long hidden = 0;
+            for (int a = 0; a < stations; a++) {
+                for (int b = a + 1; b < stations; b++) {
+                    double dx = positions[a].first - positions[b].first, dy = positions[a].second - positions[b].second;
+                    if (dx * dx + dy * dy > range * range) {
+                        medium.setReachable(a, b, false);
+                        hidden++;
+                    }
+                }
+            }
+            medium.setSaturated(true);
+            simulator.runUntil(duration);
+            const CsmaCa::Stats& stats = medium.getStats();
+            cout << range << "," << 200.0 * hidden / ((long long)stations * (stations - 1)) << "," << rtsCts << ","
+                 << medium.throughput(duration) << "," << (double)stats.collisions / max(stats.attempts, 1LL) << ","
+                 << medium.fairness() << endl;
+            simulator.reset();
         }
-        return false;
     }
+}
 
-    void receiveAck(int ackNum) {
-        if (ackNum == expected_seq_num) {
-            expected_seq_num++;
-            std::cout << "Received acknowledgement for packet with sequence number " << ackNum << std::endl;
-            // Reset the timer when an acknowledgment is received
-            timer = 0;
+// network_new aloha [frames]
+// Pure ALOHA swept over the offered load G, in attempts per frame time. Attempts from an
+// unbounded population arrive as a Poisson process, the model behind S = G e^(-2G), so the
+// measured throughput should land on the curve, peaking at 1/(2e) = 0.184 at G = 0.5.
+void runPureAlohaStudy(long long frames) {
+    cout << "G,measured_G,S,G_exp_minus_2G,error" << endl;
+    for (double load : {0.05, 0.1, 0.25, 0.4, 0.5, 0.6, 0.75, 1.0, 1.5, 2.0, 3.0}) {
+        simulator.reset();
+        PureAloha channel;
+        SimTime frameTime = channel.getFrameTime();
+        mt19937_64 gen((uint64_t)(load * 1000));
+        exponential_distribution<double> gap(load / frameTime);
+        long long remaining = frames;
+        function<void()> arrive = [&]() {
+            channel.transmit((int)(gen() % 1000));
+            if (--remaining > 0) {
+                simulator.schedule((SimTime)gap(gen), arrive);
+            }
+        };
+        simulator.schedule((SimTime)gap(gen), arrive);
+        simulator.run();
+        SimTime elapsed = simulator.now();
+        const PureAloha::Stats& stats = channel.getStats();
+        double measuredLoad = (double)stats.frames_sent * frameTime / elapsed;
+        double throughput = (double)stats.busy_time / elapsed;
+        double theory = load * exp(-2 * load);
+        cout << load << "," << measuredLoad << "," << throughput << "," << theory << "," << throughput - theory << endl;
+        simulator.reset();
+    }
+}
+
+// network_new slotted-aloha [slots]
+// Slotted ALOHA swept over the offered load G, in attempts per slot, two ways: Poisson arrivals
+// through the event scheduler, and a batch loop that draws each slot's transmitter count and
+// hands it straight to the resolver. Both should land on S = G e^(-G), peaking at 1/e = 0.368
+// at G = 1; the batch loop also shows how many slots per second the resolver sustains.
+void runSlottedAlohaStudy(long long slots) {
+    long long eventSlots = min(slots, 500000LL);
+    cout << "G,event_S,batch_S,G_exp_minus_G,batch_error,batch_slots_per_sec" << endl;
+    for (double load : {0.1, 0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 5.0}) {
+        simulator.reset();
+        SlottedAloha channel;
+        SimTime slotTime = channel.getSlotTime();
+        SimTime horizon = eventSlots * slotTime;
+        mt19937_64 gen((uint64_t)(load * 1000));
+        exponential_distribution<double> gap(load / slotTime);
+        function<void()> arrive = [&]() {
+            channel.transmit((int)(gen() % 1000));
+            SimTime next = (SimTime)gap(gen);
+            if (simulator.now() + next < horizon) {
+                simulator.schedule(next, arrive);
+            }
+        };
+        simulator.schedule((SimTime)gap(gen), arrive);
+        simulator.run();
+        channel.syncClock();
+        double eventThroughput = (double)channel.getStats().successes / channel.getStats().slots;
+        simulator.reset();
+
+        SlottedAloha batch;
+        poisson_distribution<int> attempts(load);
+        auto start = chrono::steady_clock::now();
+        for (long long slot = 0; slot < slots; slot++) {
+            batch.resolveSlot(attempts(gen));
         }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double batchThroughput = (double)batch.getStats().successes / batch.getStats().slots;
+        double theory = load * exp(-load);
+        cout << load << "," << eventThroughput << "," << batchThroughput << "," << theory << ","
+             << batchThroughput - theory << "," << slots / max(seconds, 1e-9) << endl;
     }
-    
-};
+}
 
-class SelectiveRepeat : public FlowControlProtocol {
-private:
-int window_size;
-vector<bool> received;       //Whether the packet with the given sequence no. received.
-vector<string> buffer;      //which packets have been acknowledged.
-int Sf;
-int Sn;
-int timer; // Timer variable to track the timeout
+// network_new montecarlo [stations] [slots]
+// Batch random-access studies on RandomAccessMonteCarlo, each row 16 replications with 95%
+// confidence intervals. Saturated Slotted ALOHA is checked against N p (1 - p)^(N - 1), frames
+// of 16 mini-slots started anywhere against Pure ALOHA's G e^(-2G) (over the 2K - 1 mini-slot
+// vulnerable period a K mini-slot frame really has), and queued Slotted ALOHA, where S should
+// equal the arrival rate while it is stable, shows the delay climbing toward the 1/e limit.
+// Ends with the lane generator against per-draw mt19937.
+void runMonteCarloStudy(int stations, long long slots) {
+    cout << "model,frame_slots,arrival_rate,persistence,G,G_ci,S,S_ci,theory,delay,delay_ci,mslots_per_sec" << endl;
+    auto report = [&](const string& model, const RandomAccessConfig& config, function<double(double)> theoryAt) {
+        RandomAccessResult result = RandomAccessMonteCarlo(config).run();
+        double theory = theoryAt(result.offered_load.mean);
+        double arrivalRate = config.arrival >= 1 ? 1 : config.arrival * config.stations * config.frame_slots;
+        cout << model << "," << config.frame_slots << "," << arrivalRate << "," << config.persistence << ","
+             << result.offered_load.mean << "," << result.offered_load.half_width << "," << result.throughput.mean << ","
+             << result.throughput.half_width << "," << theory << "," << result.delay.mean << ","
+             << result.delay.half_width << "," << result.slots / result.seconds / 1e6 << endl;
+    };
+
+    RandomAccessConfig config;
+    config.stations = stations;
+    config.slots = slots;
+    for (double load : {0.25, 0.5, 1.0, 1.5, 2.0, 3.0}) {
+        config.persistence = load / stations;
+        double persistence = config.persistence;
+        report("slotted", config, [&](double) { return load * pow(1 - persistence, stations - 1); });
+    }
 
-public:
-    SelectiveRepeat(int window_size) {
-        this->window_size = window_size;
-        received.resize(window_size);
-        Sf = 0;
-        Sn = 0;
-        timer = 0;
+    RandomAccessConfig pure = config;
+    pure.frame_slots = 16;
+    pure.slots = slots * pure.frame_slots / 4;
+    pure.warmup = config.warmup * pure.frame_slots;
+    for (double load : {0.1, 0.25, 0.5, 0.75, 1.0, 2.0}) {
+        pure.persistence = load / stations / pure.frame_slots;
+        double vulnerable = (2.0 * pure.frame_slots - 1) / pure.frame_slots;
+        report("unslotted", pure, [&](double measured) { return measured * exp(-vulnerable * measured); });
     }
 
-    bool canSendPacket(const std::string& destination_mac, int seqNum) {
-        if (seqNum >= Sf && seqNum < Sf + window_size && !received[seqNum % window_size]) {
-            std::cout << "Sending packet with sequence number " << seqNum << std::endl;
-            // Start the timer
-            timer = 10; // Setting the timer value to 10 (example value)
-            return true;
-        }
-        return false;
+    config.persistence = 1.0 / stations;
+    for (double rate : {0.1, 0.2, 0.3, 0.34}) {
+        config.arrival = rate / stations;
+        report("slotted-queued", config, [&](double) { return rate; });
     }
 
-    void receiveAck(int ack_num) {
-        if (ack_num >= Sf && ack_num < Sf + window_size) {
-            int index = ack_num % window_size;
-            received[index] = true;
-            while (received[Sf % window_size]) {
-                buffer.push_back("Packet " + to_string(Sf) + " acknowledged.");
-                Sf++;
-            }
-            std::cout << "Received acknowledgement for packet with sequence number " << ack_num << std::endl;
-            // Reset the timer when an acknowledgment is received
-            timer = 0;
-        }
+    const long long draws = 64LL * 4000000;
+    XoshiroLanes lanes(1);
+    auto start = chrono::steady_clock::now();
+    long long hits = 0;
+    for (long long i = 0; i < draws / 64; i++) {
+        hits += __builtin_popcountll(lanes.bernoulliMask(0.1));
+    }
+    double laneSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    mt19937 gen(1);
+    bernoulli_distribution coin(0.1);
+    start = chrono::steady_clock::now();
+    for (long long i = 0; i < draws; i++) {
+        hits += coin(gen);
     }
-vector<string> getBuffer() {
-    return buffer;
+    double mtSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "generator,draws_per_sec" << endl;
+    cout << "xoshiro_lanes," << draws / laneSeconds << endl;
+    cout << "mt19937," << draws / mtSeconds << endl;
+    cout << "hit_rate," << (double)hits / (2 * draws) << endl;
 }
-};
 
-class AccessControlProtocol {
-public:
-    virtual bool canSendPacket() = 0;
+struct ArqStudyResult {
+    double goodput_mbps;
+    double transmissions_per_segment;
+    long long timeouts;
+    long long fast_retransmits;
 };
 
-class PureAloha : public AccessControlProtocol {
-public:
-    bool canSendPacket() override {
-        // Generate a random number between 0 and 1
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(0, 1);
-        double probability = dis(gen);
-
-        // If the random number is less than the probability of success, the station can send the packet
-        if (probability < p) {
-            return true;
-        } else {
-            return false;
-        }
+// Pushes segments of segmentBytes through a sender and receiver joined by a lossy link each
+// way and times the transfer
+ArqStudyResult runGoBackNTransfer(int window, double loss, long long segments, int segmentBytes, SimTime delay, double bitsPerSecond) {
+    simulator.reset();
+    const int ackBytes = 40;
+    LossyLink forward(delay, bitsPerSecond, loss, 1 + window);
+    LossyLink reverse(delay, bitsPerSecond, loss, 2 + window);
+    GoBackN sender(window);
+    GoBackNReceiver receiver([&](int ack) { reverse.transmit(ackBytes, [&sender, ack]() { sender.receiveAck(ack); }); });
+    // Long enough for a full window queued at the sender plus a round trip
+    SimTime timeout = 2 * (2 * delay + forward.frameTime(ackBytes)) + window * forward.frameTime(segmentBytes);
+    sender.connect([&](const ArqSegment& segment) {
+        forward.transmit(segment.bytes, [&receiver, segment]() { receiver.receive(segment); });
+    }, timeout);
+    for (long long i = 0; i < segments; i++) {
+        sender.send("", segmentBytes);
     }
+    simulator.run();
+    ArqStudyResult result;
+    result.goodput_mbps = receiver.getDelivered() * segmentBytes * 8.0 / simulator.now() * SECOND / 1e6;
+    result.transmissions_per_segment = (double)sender.getStats().segments_sent / max(receiver.getDelivered(), 1LL);
+    result.timeouts = sender.getStats().timeouts;
+    result.fast_retransmits = 0; // Go-Back-N only resends on its timer
+    simulator.reset();
+    return result;
+}
 
-private:
-    double p = 0.1; // Probability of success
-};
-
-class SlottedAloha : public AccessControlProtocol {
-public:
-    bool canSendPacket() override {
-        // Calculate the current time slot
-        auto now = std::chrono::system_clock::now();
-        auto slot = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() / timeSlotSize;
-
-        // Generate a random number between 0 and 1
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(0, 1);
-        double probability = dis(gen);
-
-        // If the random number is less than the probability of success, and the station is the first to attempt transmission in the current slot, it can send the packet
-        if (probability < p && slot != lastSlot) {
-            lastSlot = slot;
-            return true;
-        } else {
-            return false;
+// network_new gbn [segments]
+// Go-Back-N goodput against window size and loss rate on a 100 Mbit/s link with 5 ms
+// one-way delay, so 1000-byte segments need a window of about 126 to fill the pipe. Loss
+// hits data and ACKs alike; every loss costs a timeout and a whole window resent.
+void runGoBackNStudy(long long segments) {
+    bool wasVerbose = verbose;
+    verbose = false;
+    const double bitsPerSecond = 100e6;
+    const SimTime delay = 5 * MILLISECOND;
+    cout << "window,loss,goodput_mbps,transmissions_per_segment,timeouts" << endl;
+    for (int window : {1, 8, 32, 128, 512}) {
+        for (double loss : {0.0, 0.001, 0.01, 0.05}) {
+            ArqStudyResult result = runGoBackNTransfer(window, loss, segments, 1000, delay, bitsPerSecond);
+            cout << window << "," << loss << "," << result.goodput_mbps << "," << result.transmissions_per_segment << ","
+                 << result.timeouts << endl;
         }
     }
+    verbose = wasVerbose;
+}
 
-private:
-    double p = 0.1; // Probability of success
-    int timeSlotSize = 1000; // Time slot size in milliseconds
-    int lastSlot = -1; // The last slot in which the station attempted transmission
-};
+// Selective Repeat counterpart of runGoBackNTransfer; also times the run on the host
+ArqStudyResult runSelectiveRepeatTransfer(int window, double loss, long long segments, int segmentBytes, SimTime delay,
+                                          double bitsPerSecond, double* wallSeconds = nullptr) {
+    simulator.reset();
+    const int ackBytes = 48; // Cumulative ACK plus the 64-bit SACK bitmap
+    LossyLink forward(delay, bitsPerSecond, loss, 1 + window);
+    LossyLink reverse(delay, bitsPerSecond, loss, 2 + window);
+    SelectiveRepeat sender(window);
+    SelectiveRepeatReceiver receiver(window, [&](const SackAck& ack) {
+        reverse.transmit(ackBytes, [&sender, ack]() { sender.onAck(ack); });
+    });
+    SimTime timeout = 2 * (2 * delay + forward.frameTime(ackBytes)) + window * forward.frameTime(segmentBytes);
+    sender.connect([&](const ArqSegment& segment) {
+        forward.transmit(segment.bytes, [&receiver, segment]() { receiver.receive(segment); });
+    }, timeout);
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < segments; i++) {
+        sender.send("", segmentBytes);
+    }
+    simulator.run();
+    if (wallSeconds != nullptr) {
+        *wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    ArqStudyResult result;
+    result.goodput_mbps = receiver.getDelivered() * segmentBytes * 8.0 / simulator.now() * SECOND / 1e6;
+    result.transmissions_per_segment = (double)sender.getStats().segments_sent / max(receiver.getDelivered(), 1LL);
+    result.timeouts = sender.getStats().timeouts;
+    result.fast_retransmits = sender.getStats().fast_retransmits;
+    simulator.reset();
+    return result;
+}
 
-class ApplicationLayer {
-public:
-    virtual void use() = 0;
-};
+// network_new sr [segments]
+// Selective Repeat first on the gbn study's link (100 Mbit/s, 5 ms each way) against
+// Go-Back-N with the same window and loss, then on a 10 Gbit/s link with 25 ms each way,
+// where 1000-byte segments need a window of about 62500 to fill the pipe. Host time per
+// segment should stay flat as the window grows, since an ACK costs O(1) whatever its size.
+void runSelectiveRepeatStudy(long long segments) {
+    bool wasVerbose = verbose;
+    verbose = false;
+    cout << "window,loss,sr_goodput_mbps,gbn_goodput_mbps,sr_transmissions_per_segment,gbn_transmissions_per_segment" << endl;
+    for (int window : {128, 512}) {
+        for (double loss : {0.0, 0.01, 0.05}) {
+            ArqStudyResult selective = runSelectiveRepeatTransfer(window, loss, segments / 10, 1000, 5 * MILLISECOND, 100e6);
+            ArqStudyResult goBack = runGoBackNTransfer(window, loss, segments / 10, 1000, 5 * MILLISECOND, 100e6);
+            cout << window << "," << loss << "," << selective.goodput_mbps << "," << goBack.goodput_mbps << ","
+                 << selective.transmissions_per_segment << "," << goBack.transmissions_per_segment << endl;
+        }
+    }
+    cout << "window,loss,goodput_mbps,transmissions_per_segment,fast_retransmits,timeouts,host_ns_per_segment" << endl;
+    for (int window : {1024, 8192, 65536}) {
+        for (double loss : {0.0, 0.001, 0.01}) {
+            double wallSeconds = 0;
+            ArqStudyResult result = runSelectiveRepeatTransfer(window, loss, segments, 1000, 25 * MILLISECOND, 10e9, &wallSeconds);
+            cout << window << "," << loss << "," << result.goodput_mbps << "," << result.transmissions_per_segment << ","
+                 << result.fast_retransmits << "," << result.timeouts << "," << wallSeconds * 1e9 / segments << endl;
+        }
+    }
+    verbose = wasVerbose;
+}
 
-class HTTP : public ApplicationLayer {
-private:
-    int id;
-    int port;
+// network_new bench-fdb [entries] [lookups]
+// Learn+lookup throughput of the switch FDB against the string-keyed map it replaced
+void runFdbBenchmark(int entries, int lookups) {
+    mt19937 gen(3);
+    vector<string> macs;
+    for (int i = 0; i < entries; i++) {
+        macs.push_back(benchmarkMAC(gen() % 0xFFFFFF)); // Random, so hashing isn't helped by sequential keys
+    }
+    vector<uint32_t> order(lookups);
+    for (int i = 0; i < lookups; i++) {
+        order[i] = gen() % entries;
+    }
+    const int ports = 48;
 
-public:
-    HTTP(int id) : id(id), port(80) {}
+    auto start = chrono::steady_clock::now();
+    unordered_map<string, string> baseline;
+    long long hits = 0;
+    for (int i = 0; i < entries; i++) {
+        baseline[macs[i]] = "port" + to_string(i % ports);
+    }
+    for (uint32_t index : order) {
+        auto it = baseline.find(macs[index]);
+        hits += it != baseline.end() && !it->second.empty();
+    }
+    double baselineSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-    void use() override {
-        std::cout << "Using HTTP Application" << std::endl;
+    // Frames carry packed keys, so the key parse is done once per MAC, as EndDevice does
+    vector<uint64_t> keys;
+    for (const string& mac : macs) {
+        keys.push_back(macKey(mac));
     }
-};
+    start = chrono::steady_clock::now();
+    MacForwardingTable<uint32_t> table(entries);
+    long long tableHits = 0;
+    for (int i = 0; i < entries; i++) {
+        table.insert(keys[i], i % ports);
+    }
+    for (uint32_t index : order) {
+        tableHits += table.find(keys[index]) != nullptr;
+    }
+    double tableSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double operations = entries + lookups;
+    cout << fixed << setprecision(2);
+    cout << "FDB benchmark: " << entries << " entries, " << lookups << " lookups" << endl;
+    cout << "unordered_map<string,string>: " << operations / baselineSeconds / 1e6 << " Mops/s (" << hits << " hits)" << endl;
+    cout << "MacForwardingTable:           " << operations / tableSeconds / 1e6 << " Mops/s (" << tableHits << " hits, "
+         << table.size() << "/" << table.capacity() << " slots, " << table.evictions() << " evictions)" << endl;
+    cout << "Speedup: " << baselineSeconds / tableSeconds << "x" << endl;
+}
 
-class SSH : public ApplicationLayer {
-private:
-    int id;
-    int port;
+int main(int argc, char* argv[]) {
 
-public:
-    SSH(int id) : id(id), port(22) {}
+    if (argc > 1 && string(argv[1]) == "arp-storm") {
+        int hosts = argc > 2 ? atoi(argv[2]) : 1000;
+        int hostsPerSwitch = argc > 3 ? atoi(argv[3]) : 48;
+        runArpStormStudy(max(hosts, 2), max(hostsPerSwitch, 1));
+        return 0;
+    }
 
-    void use() override {
-        std::cout << "Using SSH Application" << std::endl;
+    if (argc > 1 && string(argv[1]) == "vlan") {
+        int hosts = argc > 2 ? atoi(argv[2]) : 1000;
+        int hostsPerSwitch = argc > 3 ? atoi(argv[3]) : 48;
+        int tenants = argc > 4 ? atoi(argv[4]) : 10;
+        tenants = min(max(tenants, 1), 4000);
+        hosts = max(hosts, 2 * tenants); // At least two hosts per tenant
+        runArpStormStudy(hosts, max(hostsPerSwitch, 1), tenants, false);
+        runArpStormStudy(hosts, max(hostsPerSwitch, 1), tenants, true);
+        return 0;
     }
-};
 
-class Bridge : public FlowControlProtocol, public AccessControlProtocol {
-private:
-vector<Hub*> connected_hubs;
-FlowControlProtocol* flow_control_protocol;
-AccessControlProtocol* access_control_protocol;
+    if (argc > 1 && string(argv[1]) == "bench-fdb") {
+        int entries = argc > 2 ? atoi(argv[2]) : 100000;
+        int lookups = argc > 3 ? atoi(argv[3]) : 10000000;
+        runFdbBenchmark(max(entries, 1), max(lookups, 1));
+        return 0;
+    }
 
-public:
-Bridge(FlowControlProtocol* flow_control) {
-flow_control_protocol = flow_control;
-}
+    if (argc > 1 && string(argv[1]) == "incast") {
+        int senders = argc > 2 ? atoi(argv[2]) : 16;
+        int frames = argc > 3 ? atoi(argv[3]) : 200;
+        int bytes = argc > 4 ? atoi(argv[4]) : 1500;
+        runIncastStudy(max(senders, 1), max(frames, 1), min(max(bytes, 64), 9000));
+        return 0;
+    }
 
-void connectHub(Hub* hub) {
-    connected_hubs.push_back(hub);
-}
+    if (argc > 1 && string(argv[1]) == "lag") {
+        int members = argc > 2 ? atoi(argv[2]) : 4;
+        runLagStudy(min(max(members, 1), 64));
+        return 0;
+    }
 
-void disconnectHub(Hub* hub) {
-    connected_hubs.erase(remove(connected_hubs.begin(), connected_hubs.end(), hub), connected_hubs.end());
-}
+    if (argc > 1 && string(argv[1]) == "acl") {
+        runAclStudy(argc > 2 ? atoi(argv[2]) : 10000);
+        return 0;
+    }
 
-bool canSendPacket(const std::string& destination_mac, int seqNum) override {
-    return flow_control_protocol->canSendPacket(destination_mac, seqNum);
-}
+    if (argc > 1 && string(argv[1]) == "csma-cd") {
+        runCsmaCdStudy(argc > 2 ? max(atoi(argv[2]), 1) : 200);
+        return 0;
+    }
 
-bool canSendPacket() override {
-    
-    if (access_control_protocol->canSendPacket()) {
-        return true;
-    } else {
-        return false;
+    if (argc > 1 && string(argv[1]) == "csma-ca") {
+        runCsmaCaStudy(argc > 2 ? max(atoi(argv[2]), 2) : 2000);
+        return 0;
     }
-}
-};
 
-class Switch : public FlowControlProtocol, public AccessControlProtocol{
-private:
-     RoutingTable routingTable; // Add an instance of the RoutingTable class
-    unordered_map<string, EndDevice*> connected_devices;
-    unordered_map<string, string> mac_address_table;  // MAC address table
-    FlowControlProtocol* flow_control_protocol;
-     AccessControlProtocol* access_control_protocol;
+    if (argc > 1 && string(argv[1]) == "aloha") {
+        runPureAlohaStudy(argc > 2 ? max(atoll(argv[2]), 1LL) : 2000000);
+        return 0;
+    }
 
-public:
-    Switch(FlowControlProtocol* flow_control, AccessControlProtocol* acp) {
-        flow_control_protocol = flow_control;
-        access_control_protocol = acp;
+    if (argc > 1 && string(argv[1]) == "slotted-aloha") {
+        runSlottedAlohaStudy(argc > 2 ? max(atoll(argv[2]), 1LL) : 10000000);
+        return 0;
     }
 
-    void connectDevice(EndDevice* device, string port, string mac_address) {
-        connected_devices[port] = device;
-        mac_address_table[mac_address] = port;  // Update MAC address table
-        device->connect();
+    if (argc > 1 && string(argv[1]) == "montecarlo") {
+        runMonteCarloStudy(argc > 2 ? max(atoi(argv[2]), 1) : 128, argc > 3 ? max(atoll(argv[3]), 1LL) : 500000);
+        return 0;
     }
 
-    void disconnectDevice(EndDevice* device, string port, string mac_address) {
-        connected_devices.erase(port);
-        mac_address_table.erase(mac_address);  // Remove MAC address from the table
-        device->disconnect();
+    if (argc > 1 && string(argv[1]) == "gbn") {
+        runGoBackNStudy(argc > 2 ? max(atoll(argv[2]), 1LL) : 100000);
+        return 0;
     }
 
-     string resolveMACAddress(const string& ip_address) {
-        for (const auto& device : connected_devices) {
-            if (device.second->getIpAddress() == ip_address) {
-                return device.second->getMacAddress();
-            }
-        }
-        return "";  // MAC address not found
+    if (argc > 1 && string(argv[1]) == "sr") {
+        runSelectiveRepeatStudy(argc > 2 ? max(atoll(argv[2]), 10LL) : 1000000);
+        return 0;
     }
 
-    void performStaticRouting(const string& destinationIP) {
-        string nextHopIP = routingTable.getNextHop(destinationIP);
-        if (!nextHopIP.empty()) {
-            cout << "Performing static routing for destination IP: " << destinationIP << endl;
-            cout << "Next hop IP: " << nextHopIP << endl;
-        } else {
-            cout << "No static route found for destination IP: " << destinationIP << endl;
-        }
+    if (argc > 1 && string(argv[1]) == "bench-crc") {
+        runCrcBenchmark();
+        return 0;
     }
 
-    bool canSendPacket(const string& destination_mac, int seqNum) override {
-    // Check if the destination MAC address is in the table
-    if (mac_address_table.count(destination_mac) > 0) {
-        bool accessControlResult = access_control_protocol->canSendPacket();
-        bool flowControlResult = flow_control_protocol->canSendPacket(destination_mac, seqNum);
+    if (argc > 1 && string(argv[1]) == "domains") {
+        int nodes = argc > 2 ? atoi(argv[2]) : 1000000;
+        int changes = argc > 3 ? atoi(argv[3]) : 1000000;
+        runDomainStudy(max(nodes, 2), max(changes, 0));
+        return 0;
+    }
 
-        if (accessControlResult && flowControlResult) {
-            cout << "Sending packet to MAC address " << destination_mac << " with sequence number " << seqNum << endl;
-        } else {
-            cout << "Packet sending to MAC address " << destination_mac << " with sequence number " << seqNum << " is blocked by access control or flow control." << endl;
-        }
+    if (argc > 1 && string(argv[1]) == "forwarding") {
+        int hops = argc > 2 ? atoi(argv[2]) : 5;
+        runForwardingStudy(max(hops, 1));
+        return 0;
+    }
 
-        return flowControlResult;
+    if (argc > 1 && string(argv[1]) == "buffer") {
+        int senders = argc > 2 ? atoi(argv[2]) : 16;
+        int frames = argc > 3 ? atoi(argv[3]) : 200;
+        runBufferStudy(max(senders, 1), max(frames, 1));
+        return 0;
     }
 
-    cout << "Destination MAC address " << destination_mac << " not found in the table." << endl;
-    return false;
-}
+    if (argc > 1 && string(argv[1]) == "stp") {
+        string kind = argc > 2 ? argv[2] : "grid";
+        int size = argc > 3 ? atoi(argv[3]) : 64;
+        unsigned seed = argc > 4 ? atoi(argv[4]) : 1;
+        runSpanningTreeStudy(kind, max(size, 2), seed);
+        return 0;
+    }
 
-bool canSendPacket() override {
-    
-    if (access_control_protocol->canSendPacket()) {
-        return true;
-    } else {
-        return false;
+    if (argc > 1 && string(argv[1]) == "bench-routing") {
+        runRoutingBenchmark(argc, argv);
+        return 0;
     }
-}
 
-void receiveAck(int ackNum) override {
-     // Process the acknowledgement
-    cout << "Received acknowledgement for packet with sequence number " << ackNum << endl;
+    if (argc > 1 && string(argv[1]) == "flap") {
+        runFlapDampingStudy(false);
+        runFlapDampingStudy(true);
+        return 0;
     }
-};
 
-int main() {
+    if (argc > 1 && string(argv[1]) == "frr") {
+        SimTime detectionDelay = 50 * MICROSECOND; // BFD-style failure detection
+        SimTime spfDelay = 200 * MILLISECOND;      // LSA flooding plus SPF hold-down
+        runFastRerouteStudy(false, detectionDelay, spfDelay);
+        runFastRerouteStudy(true, detectionDelay, spfDelay);
+        return 0;
+    }
 
     FlowControlProtocol* flow_control_protocol = new GoBackN(2);
     AccessControlProtocol* access_control_protocol = new PureAloha();
@@ -726,9 +8874,8 @@ int main() {
     }
 
     // Report the total number of broadcast and collision domains in the given network
-    // There is one broadcast domain and one collision domain in the given network
-    std::cout << "Number of broadcast domains: 1\n";
-    std::cout << "Number of collision domains: 1\n";
+    std::cout << "Number of broadcast domains: " << domains.broadcastDomains() << "\n";
+    std::cout << "Number of collision domains: " << domains.collisionDomains() << "\n";
 
     // Create two star topologies with five end devices connected to a hub in each case
     Hub hub1(1, "Hub 1", 3, "Hub 1 Device", "192.168.1.3", "00:00:00:00:00:06", &network);
@@ -807,6 +8954,7 @@ switch_obj.connectDevice(&hub2, "port7", "00:00:00:00:00:07");
 
     // Update the routing table
     router1.updateRoutingTable();
+    simulator.run(); // Let the batched update commit
 
     // Print the routing table
     routingTable.printRoutingTable();
@@ -815,6 +8963,7 @@ switch_obj.connectDevice(&hub2, "port7", "00:00:00:00:00:07");
 
     // Update the routing table
     router1.updateRoutingTable();
+    simulator.run(); // Let the batched update commit
 
     // Print the routing table
     routingTable.printRoutingTable();
@@ -874,9 +9023,8 @@ ApplicationLayer* httpApp = new HTTP(1);
 
 
 // Report the total number of broadcast and collision domains in the given network
-// There are two broadcast domains and two collision domains in the given network
-std::cout << "Number of broadcast domains: 2\n";
-std::cout << "Number of collision domains: 2\n";
+std::cout << "Number of broadcast domains: " << domains.broadcastDomains() << "\n";
+std::cout << "Number of collision domains: " << domains.collisionDomains() << "\n";
 
 return 0;
 };
\ No newline at end of file